@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <linux/mempolicy.h>
+#include "echo_main.h"
+
+/***********************************************************************
+* Function Name  : echoCpuListParse()
+* Description    : Parse a CPU list in the kernel's cpulist format
+* Input          : szList - e.g. "0-3,8,10-11"
+				   pList - filled with the CPUs in the given order
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The order is kept, so "4,0" puts the first worker on
+				   CPU 4; CPUs the host does not have are refused here,
+				   offline or not allowed ones fail when a thread is
+				   pinned;
+************************************************************************/
+ECHO_STATUS echoCpuListParse(const char *szList, echoCpuList *pList)
+{
+	const char *p = szList;
+	char *pEnd = NULL;
+	long first = 0;
+	long last = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+	if (cpus < 1 || cpus > CPU_SETSIZE)
+		cpus = CPU_SETSIZE;
+
+	pList->count = 0;
+	while (*p)
+	{
+		first = strtol(p, &pEnd, 10);
+		if (pEnd == p || first < 0 || first >= cpus)
+			return ECHO_BAD_PARAM;
+		last = first;
+		p = pEnd;
+
+		if (*p == '-')
+		{
+			last = strtol(++p, &pEnd, 10);
+			if (pEnd == p || last < first || last >= cpus)
+				return ECHO_BAD_PARAM;
+			p = pEnd;
+		}
+
+		for (; first <= last; first++)
+		{
+			if (pList->count == ECHO_AFFINITY_MAX_CPUS)
+				return ECHO_BAD_PARAM;
+			pList->cpus[pList->count++] = first;
+		}
+
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return ECHO_BAD_PARAM;
+	}
+
+	return pList->count > 0 ? ECHO_OK : ECHO_BAD_PARAM;
+}
+
+/*CPU of the index-th thread, -1 when the list is empty*/
+int echoAffinityCpu(const echoCpuList *pList, int index)
+{
+	return pList->count > 0 ? pList->cpus[index % pList->count] : -1;
+}
+
+/*Fill pSet with one CPU of the list (index >= 0) or all of them*/
+static void echoAffinitySet(const echoCpuList *pList, int index, cpu_set_t *pSet)
+{
+	int i = 0;
+
+	CPU_ZERO(pSet);
+	if (index >= 0)
+		CPU_SET(echoAffinityCpu(pList, index), pSet);
+	else
+		for (i = 0; i < pList->count; i++)
+			CPU_SET(pList->cpus[i], pSet);
+}
+
+/***********************************************************************
+* Function Name  : echoAffinityAttrInit()
+* Description    : Thread attributes that start a thread on its CPU(s)
+* Input          : pAttr - initialized here, destroy after pthread_create()
+				   pList - CPUs given on the command line
+				   index - the thread runs on the index-th CPU of the
+				   list; -1 - on any CPU of the list
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The affinity is set before the thread exists, so it
+				   never runs (and touches its stack) on another CPU;
+				   an empty list leaves the default attributes;
+************************************************************************/
+ECHO_STATUS echoAffinityAttrInit(pthread_attr_t *pAttr, const echoCpuList *pList, int index)
+{
+	cpu_set_t set;
+	int err = 0;
+
+	if (0 != pthread_attr_init(pAttr))
+		return ECHO_PTHREAD_ERR;
+
+	if (pList->count == 0)
+		return ECHO_OK;
+
+	echoAffinitySet(pList, index, &set);
+	if (0 != (err = pthread_attr_setaffinity_np(pAttr, sizeof set, &set)))
+	{
+		log_echo_err("pthread_attr_setaffinity_np failed errno %d", err);
+		pthread_attr_destroy(pAttr);
+		return ECHO_PTHREAD_ERR;
+	}
+
+	return ECHO_OK;
+}
+
+/*Pin the calling thread to all CPUs of the list*/
+ECHO_STATUS echoAffinityPinSelf(const echoCpuList *pList)
+{
+	cpu_set_t set;
+	int err = 0;
+
+	if (pList->count == 0)
+		return ECHO_OK;
+
+	echoAffinitySet(pList, -1, &set);
+	if (0 != (err = pthread_setaffinity_np(pthread_self(), sizeof set, &set)))
+	{
+		log_echo_err("pthread_setaffinity_np failed errno %d", err);
+		return ECHO_PTHREAD_ERR;
+	}
+
+	return ECHO_OK;
+}
+
+/*NUMA node of a CPU from sysfs, -1 when unknown (kernel without NUMA)*/
+int echoAffinityCpuNode(int cpu)
+{
+	char szPath[64];
+	struct dirent *pEntry = NULL;
+	DIR *pDir = NULL;
+	int node = -1;
+
+	if (cpu < 0)
+		return -1;
+
+	snprintf(szPath, sizeof szPath, "/sys/devices/system/cpu/cpu%d", cpu);
+	if (NULL == (pDir = opendir(szPath)))
+		return -1;
+
+	while (node < 0 && NULL != (pEntry = readdir(pDir)))
+	{
+		if (strncmp(pEntry->d_name, "node", 4) == 0)
+			sscanf(pEntry->d_name + 4, "%d", &node);
+	}
+
+	closedir(pDir);
+	return node;
+}
+
+/***********************************************************************
+* Function Name  : echoAffinityMemPrefer()
+* Description    : Place the pages the calling thread touches from now on
+				   on one NUMA node
+* Input          : node - the node; -1 - back to the default (local)
+				   policy
+* Logic          : The workers' buffers are allocated and populated by
+				   the main thread before the workers start; preferring
+				   the node of the worker's CPU meanwhile puts them next
+				   to the worker instead of next to the main thread.
+				   MPOL_PREFERRED falls back to other nodes when the node
+				   is full;
+************************************************************************/
+void echoAffinityMemPrefer(int node)
+{
+	unsigned long nodeMask = 0;
+
+	if (node >= (int)(8 * sizeof nodeMask))
+		return;
+
+	if (node < 0)
+		syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0);
+	else
+	{
+		nodeMask = 1UL << node;
+		if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask, 8 * sizeof nodeMask) < 0)
+			log_echo_warn("set_mempolicy(node %d) failed errno %d, buffers are not placed", node, errno);
+	}
+}
+
+/***********************************************************************
+* Function Name  : echoAffinityIncomingCpu()
+* Description    : Ask the kernel to steer the flows received on cpu to
+				   this SO_REUSEPORT socket
+* Input          : sock - one socket of the SO_REUSEPORT group
+				   cpu - the CPU its worker is pinned to
+* Logic          : Since Linux 6.2 the reuseport group prefers the socket
+				   whose SO_INCOMING_CPU is the CPU that processes the
+				   packet, so with the RX queue interrupts (or RPS) of a
+				   queue on the CPU of a worker the whole flow - softirq,
+				   socket and worker - stays on one core. Older kernels
+				   keep the hash based spreading;
+************************************************************************/
+void echoAffinityIncomingCpu(int sock, int cpu)
+{
+	if (sock >= 0 && cpu >= 0 && setsockopt(sock, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof cpu) < 0)
+		log_echo_warn("setsockopt(SO_INCOMING_CPU %d) failed errno %d", cpu, errno);
+}
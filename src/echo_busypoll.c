@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "echo_main.h"
+#include "echo_busypoll.h"
+
+static unsigned long long echoBusyPollNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/***********************************************************************
+* Function Name  : echoBusyPollSocket()
+* Description    : Let the kernel busy poll the device queue of a socket
+* Input          : sock - server socket, accepted TCP sockets inherit
+				   the settings
+				   usecs - how long a blocking receive polls the queue
+				   before it sleeps
+* Logic          : SO_PREFER_BUSY_POLL keeps the softirq from processing
+				   the queue while the application polls it. Busy
+				   polling needs a NIC queue (NAPI); on loopback only the
+				   spinning of the worker itself is left;
+************************************************************************/
+void echoBusyPollSocket(int sock, int usecs)
+{
+	if (sock < 0 || usecs <= 0)
+		return;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof usecs) < 0)
+		log_echo_warn("setsockopt(SO_BUSY_POLL %d) failed errno %d", usecs, errno);
+	if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &(int){1}, sizeof(int)) < 0)
+		log_echo_warn("setsockopt(SO_PREFER_BUSY_POLL) failed errno %d", errno);
+	if (setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &(int){ECHO_BUSY_POLL_BUDGET}, sizeof(int)) < 0)
+		log_echo_warn("setsockopt(SO_BUSY_POLL_BUDGET) failed errno %d", errno);
+}
+
+void echoBusyPollInit(echoBusyPoll *pBusy, int usecs, echoStatsSlot *pStats)
+{
+	bzero(pBusy, sizeof(echoBusyPoll));
+	pBusy->spinNs = usecs > 0 ? (unsigned long long)usecs * 1000ULL : 0;
+	pBusy->pStats = pStats;
+}
+
+/***********************************************************************
+* Function Name  : echoBusyPollTimeout()
+* Description    : Timeout of the worker's next wait
+* Input          : pBusy - spin state of the worker
+				   blockMs - timeout of a blocking wait (-1 - forever)
+* Return         : 0 - poll without blocking, otherwise blockMs
+* Logic          : The spin starts with the first poll that finds
+				   nothing; once it lasted spinNs the worker gives up,
+				   counts the spin and blocks (adaptive fallback);
+************************************************************************/
+int echoBusyPollTimeout(echoBusyPoll *pBusy, int blockMs)
+{
+	unsigned long long now = echoBusyPollNowNs();
+
+	if (pBusy->idleSince == 0)
+		pBusy->idleSince = now;
+
+	if (now - pBusy->idleSince < pBusy->spinNs)
+		return 0;
+
+	ECHO_STAT_ADD(pBusy->pStats->busySpinNs, now - pBusy->idleSince);
+	ECHO_STAT_ADD(pBusy->pStats->busySleeps, 1);
+	pBusy->idleSince = 0;
+	pBusy->blocked = 1;
+	return blockMs;
+}
+
+/*After a wait: events found end the spin and start the work on them*/
+void echoBusyPollWoke(echoBusyPoll *pBusy, int events)
+{
+	unsigned long long now = 0;
+
+	if (events <= 0 && !pBusy->blocked)
+		return;
+
+	now = echoBusyPollNowNs();
+	if (pBusy->idleSince)
+		ECHO_STAT_ADD(pBusy->pStats->busySpinNs, now - pBusy->idleSince);
+	pBusy->idleSince = 0;
+	pBusy->blocked = 0;
+	pBusy->workSince = now;
+}
+
+/*The events of the last wait are handled*/
+void echoBusyPollWorked(echoBusyPoll *pBusy)
+{
+	if (pBusy->workSince == 0)
+		return;
+
+	ECHO_STAT_ADD(pBusy->pStats->busyWorkNs, echoBusyPollNowNs() - pBusy->workSince);
+	pBusy->workSince = 0;
+}
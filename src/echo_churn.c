@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "echo_main.h"
+#include "echo_load.h"
+#include "echo_churn.h"
+#include "echo_tls.h"
+
+/*Open one connection; with TFO the request goes out with the SYN (once
+  the client holds a cookie of the server) and sendto() stands in for
+  connect(). Returns the bytes of the request already sent, -1 on error*/
+static int echoChurnConnect(echoChurnThread *pThread, int fd)
+{
+	echoClientGlobal_t *pClient = pThread->pClient;
+	int size = pClient->config.size;
+
+	if (pClient->config.fastOpen > 0)
+		return sendto(fd, pThread->pRequest, size, MSG_FASTOPEN | MSG_NOSIGNAL,
+					  &pClient->servAddr.sa, pClient->servAddrLen);
+
+	return connect(fd, &pClient->servAddr.sa, pClient->servAddrLen) == 0 ? 0 : -1;
+}
+
+/***********************************************************************
+* Function Name  : echoChurnCycle()
+* Description    : Connect, echo one request and close
+* Input          : pThread - the churn thread
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Both latencies start before socket(), so the cost of
+				   a new socket is part of them; the close is included
+				   in the cycle - a health checker pays for it as well;
+************************************************************************/
+static ECHO_STATUS echoChurnCycle(echoChurnThread *pThread)
+{
+	echoClientConfig *pConfig = &pThread->pClient->config;
+	struct timeval timeout = {pConfig->timeoutMs / 1000, (pConfig->timeoutMs % 1000) * 1000};
+	struct tcp_info info;
+	socklen_t infoLen = sizeof info;
+	struct ssl_st *pTls = NULL;
+	unsigned long long start = echoClientNowNs();
+	unsigned long long connected = 0;
+	int done = 0;
+	int n = 0;
+	int fd = -1;
+
+	if ((fd = socket(pThread->pClient->servAddr.sa.sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	{
+		pThread->stats.errors++;
+		return ECHO_OPEN_SOCK_ERR;
+	}
+
+	/*SO_SNDTIMEO bounds connect() as well*/
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+	if (pThread->pClient->servAddr.sa.sa_family == AF_INET)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+	echoSocketBuffers(fd, pConfig->sndBuf, pConfig->rcvBuf);
+
+	if ((done = echoChurnConnect(pThread, fd)) < 0)
+		goto fail;
+	/*with --tls a connection is usable once the handshake is done*/
+	if (pConfig->tls && ECHO_OK != echoTlsConnect(fd, &pTls))
+		goto fail;
+	connected = echoClientNowNs();
+
+	for (; done < pConfig->size; done += n)
+	{
+		if ((n = echoTlsSend(pTls, fd, pThread->pRequest + done, pConfig->size - done)) <= 0)
+			goto fail;
+	}
+
+	for (done = 0; done < pConfig->size; done += n)
+	{
+		if ((n = echoTlsRecv(pTls, fd, pThread->pEcho + done, pConfig->size - done)) <= 0)
+			goto fail;
+	}
+
+	if (memcmp(pThread->pEcho, pThread->pRequest, pConfig->size) != 0)
+	{
+		errno = 0;
+		goto fail;
+	}
+
+	if (pConfig->fastOpen > 0 && getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &infoLen) == 0 &&
+		(info.tcpi_options & TCPI_OPT_SYN_DATA))
+		pThread->stats.synData++;
+
+	echoTlsFree(pTls, 1);
+	close(fd);
+	pThread->stats.connections++;
+	echoHistRecord(&pThread->connectLatency, connected - start);
+	echoHistRecord(&pThread->cycleLatency, echoClientNowNs() - start);
+	return ECHO_OK;
+
+fail:
+	if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINPROGRESS)
+		pThread->stats.timeouts++;
+	else
+		pThread->stats.errors++;
+	echoTlsFree(pTls, 0);
+	close(fd);
+	return ECHO_FAIL;
+}
+
+/************************************************************************
+* Function Name  : echoChurnWorker()
+* Description    : A function that will be executed by pthread; opens
+				   short-lived connections back to back until the end
+				   of the test time;
+* Input          : pThreadPar - the churn thread;
+* Return         : ECHO_STATUS to indicate error/success
+*************************************************************************/
+void *echoChurnWorker(void *pThreadPar)
+{
+	echoChurnThread *pThread = (echoChurnThread *)pThreadPar;
+	static ECHO_STATUS ret;
+
+	while (echoClientNowNs() < pThread->endNs)
+		echoChurnCycle(pThread);
+
+	ret = ECHO_OK;
+	pthread_exit(&ret);
+}
+
+/***********************************************************************
+* Function Name  : echoChurnStart()
+* Description    : Connection churn mode of the echo client
+* Input          : arg_values - <ip> <protocol>, TCP or a unix stream socket only
+				   pConfig - threads, duration, request size, timeout
+				   and fastOpen
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Every thread runs connect + echo + close cycles one
+				   after the other for the test time; the result is the
+				   connections/s and the connect and cycle latencies.
+				   With --tls every cycle makes a full handshake, no
+				   session is resumed - the rate is the handshake rate.
+				   The client side of every connection ends in
+				   TIME_WAIT, so a long run may need tcp_tw_reuse or
+				   more local ports;
+************************************************************************/
+ECHO_STATUS echoChurnStart(char **arg_values, echoClientConfig *pConfig)
+{
+	echoClientGlobal_t *pClient = NULL;
+	echoChurnThread *pThreads = NULL;
+	echoChurnStats total;
+	echoHist connectLatency;
+	echoHist cycleLatency;
+	pthread_attr_t attr;
+	unsigned long long start = 0;
+	double elapsed = 0;
+	int started = 0;
+	int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (ECHO_OK != (iRet = echoClientGlobalInit(&pClient)))
+		return iRet;
+
+	pClient->config = *pConfig;
+	if (ECHO_OK != (iRet = echoClientSetServer(pClient, arg_values[0], arg_values[1])))
+	{
+		log_echo("%s", arrErrors[iRet]);
+		return iRet;
+	}
+
+	/*UDP has no connections to churn, a unix socket no Fast Open; a TLS
+	  request can not go with the SYN, the handshake comes first*/
+	if (pClient->protocol != IPPROTO_TCP ||
+		(pConfig->fastOpen > 0 && (pClient->servAddr.sa.sa_family != AF_INET || pConfig->tls)) ||
+		pConfig->threads < 1 || pConfig->threads > ECHO_LOAD_MAX_THREADS ||
+		pConfig->duration < 1 || pConfig->size < 1 || pConfig->size > ECHO_LOAD_MAX_TCP_SIZE || pConfig->timeoutMs < 1)
+	{
+		log_echo("%s", arrErrors[ECHO_BAD_PARAM]);
+		return ECHO_BAD_PARAM;
+	}
+
+	if (NULL == (pThreads = calloc(pConfig->threads, sizeof(echoChurnThread))))
+		return ECHO_NO_MEM_ERR;
+
+	for (i = 0; i < pConfig->threads; i++)
+	{
+		pThreads[i].id = i;
+		pThreads[i].pClient = pClient;
+		pThreads[i].pRequest = malloc(pConfig->size);
+		pThreads[i].pEcho = malloc(pConfig->size);
+		if (!pThreads[i].pRequest || !pThreads[i].pEcho)
+			return ECHO_NO_MEM_ERR;
+		memset(pThreads[i].pRequest, 'a' + i % 26, pConfig->size);
+		echoHistInit(&pThreads[i].connectLatency);
+		echoHistInit(&pThreads[i].cycleLatency);
+	}
+
+	log_echo("Churn: %d thread(s), %s, connect + %d byte echo + close%s, %d s", pConfig->threads,
+			 echoClientProtoName(pClient), pConfig->size, pConfig->fastOpen > 0 ? " with TCP Fast Open" : "", pConfig->duration);
+
+	start = echoClientNowNs();
+	for (started = 0; started < pConfig->threads; started++)
+	{
+		pThreads[started].endNs = start + (unsigned long long)pConfig->duration * 1000000000ULL;
+		if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pConfig->cpus, started)))
+			break;
+		if (pthread_create(&pThreads[started].threadId, &attr, echoChurnWorker, (void*)&pThreads[started]) != 0)
+			iRet = ECHO_PTHREAD_ERR;
+		pthread_attr_destroy(&attr);
+		if (ECHO_OK != iRet)
+		{
+			perror("could not create thread - echoChurnWorker!");
+			break;
+		}
+	}
+
+	bzero(&total, sizeof total);
+	echoHistInit(&connectLatency);
+	echoHistInit(&cycleLatency);
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(pThreads[i].threadId, NULL);
+		total.connections += pThreads[i].stats.connections;
+		total.errors += pThreads[i].stats.errors;
+		total.timeouts += pThreads[i].stats.timeouts;
+		total.synData += pThreads[i].stats.synData;
+		echoHistMerge(&connectLatency, &pThreads[i].connectLatency);
+		echoHistMerge(&cycleLatency, &pThreads[i].cycleLatency);
+	}
+
+	elapsed = (echoClientNowNs() - start) / 1e9;
+	log_echo("connections %lu, %.0f connections/s, errors %lu, timeouts %lu", total.connections,
+			 total.connections / elapsed, total.errors, total.timeouts);
+	if (pConfig->fastOpen > 0)
+		log_echo("tfo: %lu of %lu connections carried their request in the SYN", total.synData, total.connections);
+	echoTlsClientReport();
+	echoHistPrint(&connectLatency, pConfig->tls ? "connect+handshake latency" : "connect latency");
+	echoHistPrint(&cycleLatency, "connect+echo+close latency");
+
+	return iRet == ECHO_OK && total.connections > 0 ? ECHO_OK : ECHO_FAIL;
+}
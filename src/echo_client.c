@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
@@ -14,10 +15,115 @@
 #include <sys/reboot.h>
 #include <dlfcn.h>
 #include <sys/socket.h>
+#include <netinet/udp.h>
+#include <netinet/in.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
 #include "echo_main.h"
+#include "echo_shm.h"
+#include "echo_tls.h"
 
 echoClientGlobal_t *pClientGlobal = NULL;
 
+/*Nanoseconds of CLOCK_MONOTONIC - unlike gettimeofday() it does not jump
+  when the wall clock is set*/
+unsigned long long echoClientNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/***********************************************************************
+* Function Name  : echoClientTimestampEnable()
+* Description    : Ask the kernel for software TX and RX timestamps
+* Input          : sockfd - connected client socket
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The RX time comes with every recvmsg() as a cmsg; for
+				   every send a TX time is queued on the error queue,
+				   without a copy of the data (OPT_TSONLY) and tagged
+				   with a key (OPT_ID): the number of the datagram for
+				   UDP, the offset of the last byte of the send for TCP.
+				   TCP counts from the moment this is called, so it has
+				   to be called after connect();
+************************************************************************/
+ECHO_STATUS echoClientTimestampEnable(int sockfd)
+{
+	int flags = SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+				SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+
+	if (setsockopt(sockfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof flags) < 0)
+	{
+		log_echo("setsockopt(SO_TIMESTAMPING) failed errno %d", errno);
+		return ECHO_SET_SOCK_FLG_ERR;
+	}
+
+	return ECHO_OK;
+}
+
+/*Software timestamp (CLOCK_REALTIME ns) of a message read with
+  recvmsg(); 0 if it has none*/
+unsigned long long echoClientCmsgTimestamp(struct msghdr *pMsg)
+{
+	struct cmsghdr *pCmsg = NULL;
+	struct scm_timestamping *pTs = NULL;
+
+	for (pCmsg = CMSG_FIRSTHDR(pMsg); pCmsg; pCmsg = CMSG_NXTHDR(pMsg, pCmsg))
+	{
+		if (pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SO_TIMESTAMPING)
+		{
+			pTs = (struct scm_timestamping *)CMSG_DATA(pCmsg);
+			return (unsigned long long)pTs->ts[0].tv_sec * 1000000000ULL + pTs->ts[0].tv_nsec;
+		}
+	}
+
+	return 0;
+}
+
+/***********************************************************************
+* Function Name  : echoClientTxTimestamp()
+* Description    : Read one TX timestamp from the error queue
+* Input          : sockfd - socket with echoClientTimestampEnable()
+* Output         : pKey - OPT_ID key of the send
+				   pNs - CLOCK_REALTIME ns the kernel passed the data
+				   to the device
+* Return         : ECHO_OK, ECHO_NOT_FOUND if the queue holds no TX
+				   timestamp
+************************************************************************/
+ECHO_STATUS echoClientTxTimestamp(int sockfd, unsigned int *pKey, unsigned long long *pNs)
+{
+	char control[ECHO_CMSG_TIMESTAMP_SPACE];
+	struct msghdr msg;
+	struct cmsghdr *pCmsg = NULL;
+	struct sock_extended_err *pErr = NULL;
+
+	while (1)
+	{
+		bzero(&msg, sizeof msg);
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof control;
+		if (recvmsg(sockfd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			return ECHO_NOT_FOUND;
+
+		*pNs = echoClientCmsgTimestamp(&msg);
+		for (pCmsg = CMSG_FIRSTHDR(&msg); pCmsg; pCmsg = CMSG_NXTHDR(&msg, pCmsg))
+		{
+			if ((pCmsg->cmsg_level == SOL_IP && pCmsg->cmsg_type == IP_RECVERR) ||
+				(pCmsg->cmsg_level == SOL_IPV6 && pCmsg->cmsg_type == IPV6_RECVERR))
+				pErr = (struct sock_extended_err *)CMSG_DATA(pCmsg);
+		}
+
+		/*anything else on the queue is skipped*/
+		if (*pNs && pErr && pErr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING && pErr->ee_info == SCM_TSTAMP_SND)
+		{
+			*pKey = pErr->ee_data;
+			return ECHO_OK;
+		}
+		pErr = NULL;
+	}
+}
+
 /*********************************************************************
 * Function Name  : echoClientTimeout()
 * Description    : Procedure that is executed when the message is not 
@@ -31,57 +137,90 @@ ECHO_STATUS echoClientTimeout()
 	bzero(pClientGlobal->lastEchoResponse, sizeof pClientGlobal->lastEchoResponse);
 	strcpy(pClientGlobal->lastEchoResponse, "Echo request timed out.");
 	log_echo("%s", pClientGlobal->lastEchoResponse);
-	close(pClientGlobal->sockfd);
-	pClientGlobal->sockfd = -1;
+	echoClientClose(pClientGlobal);
 	
 	return ECHO_OK;
 } 
 
-/*************************************************************************
-* Function Name  : echoClientReceive()
-* Description    : Receive messages from echo tcp/udp server
-* Input          : clData - pointer to global echo client structure
-* Return         : ECHO_STATUS to indicate error/success
-* Logic          : If the message is received succesfully check for 
-				   inconsitencies, calculate the time it took to 
-				   receive the message and generate appropriate massages;
-**************************************************************************/
-ECHO_STATUS echoClientReceive(echoClientGlobal_t* clData)
+/*Read one piece of the echo into recvMesg + recvMsgLen: a datagram, a
+  shared-memory message or what the TCP socket holds; with timestamps
+  *pRxNs is the receive time of the piece*/
+static int echoClientRecvPart(echoClientGlobal_t* clData, unsigned long long *pRxNs)
 {
 	socklen_t addrlen = sizeof(clData->servAddr);
-	char recvBuffer[ECHO_BUFSIZE];
-	struct timeval vResTime;
-	struct timeval vEndTime;
+	char control[ECHO_CMSG_TIMESTAMP_SPACE];
+	struct iovec iov = {clData->recvMesg + clData->recvMsgLen, clData->msgLen + 1 - clData->recvMsgLen};
+	struct msghdr msg;
 	int numBytesRecv = 0;
-	double resTime;
 
-	bzero(recvBuffer, sizeof recvBuffer);
-	numBytesRecv = 0;
-	
-	gettimeofday(&clData->startTime, NULL);
+	/*shared memory: nothing to block in, the client waits on the ring*/
+	if (clData->protocol == ECHO_PROTO_SHM)
+	{
+		if (echoShmWait(clData->pShm, clData->startNs + (unsigned long long)clData->waitTime * 1000000ULL))
+			return echoShmRecv(clData->pShm, iov.iov_base, iov.iov_len);
+		errno = EAGAIN;
+		return -1;
+	}
 	
-	/*Set the time of waiting to receive the message back, i.e timeout*/
-	/*The setsockopt() function set the SO_RCVTIMEO option, at the SOL_SOCKET protocol level, 
-	  to the clData->timeout value for the clData->sockfd socket*/
-	if (setsockopt(clData->sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&clData->timeout, sizeof clData->timeout) < 0)
+	/*with timestamps the echo is read with recvmsg(), its RX time comes along*/
+	if (clData->config.timestamping)
 	{
-		log_echo("setsockopt(SO_RCVTIMEO) failed errno %d", errno);
-		return ECHO_SET_SOCK_FLG_ERR;
+		bzero(&msg, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof control;
+		numBytesRecv = recvmsg(clData->sockfd, &msg, 0);
+		if (numBytesRecv > 0)
+			*pRxNs = echoClientCmsgTimestamp(&msg);
+		return numBytesRecv;
 	}
 	
 	switch(clData->protocol)
 	{
 		case IPPROTO_TCP:
 		    //The recv() call is used to receive messages from a socket. It is used to receive data on connection-oriented sockets (TCP)
-			numBytesRecv = recv(clData->sockfd, recvBuffer, ECHO_BUFSIZE, 0);
-			break;
+			return echoTlsRecv(clData->pTls, clData->sockfd, iov.iov_base, iov.iov_len);
 		
 		case IPPROTO_UDP:
 		    //The recvfrom() call is used to receive messages from a socket. It is used to receive data on connectionless sockets (UDP)
-			numBytesRecv = recvfrom(clData->sockfd, recvBuffer, ECHO_BUFSIZE, 0, (struct sockaddr *)&clData->servAddr, &addrlen );
-			break;
+			return recvfrom(clData->sockfd, iov.iov_base, iov.iov_len, 0, (struct sockaddr *)&clData->servAddr, &addrlen );
 	}
 	
+	return -1;
+}
+
+/*************************************************************************
+* Function Name  : echoClientReceive()
+* Description    : Receive messages from echo tcp/udp server
+* Input          : clData - pointer to global echo client structure
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : If the message is received succesfully check for 
+				   inconsitencies, calculate the time it took to 
+				   receive the message and generate appropriate massages.
+				   A TCP echo may arrive in pieces, it is read until
+				   it has the length of the message; messages longer
+				   than ECHO_MSG_SHOW_MAX are shown cut;
+**************************************************************************/
+ECHO_STATUS echoClientReceive(echoClientGlobal_t* clData)
+{
+	unsigned long long rxNs = 0;
+	unsigned long long txNs = 0;
+	unsigned int txKey = 0;
+	int show = clData->msgLen < ECHO_MSG_SHOW_MAX ? clData->msgLen : ECHO_MSG_SHOW_MAX;
+	const char *szCut = clData->msgLen > ECHO_MSG_SHOW_MAX ? "..." : "";
+	int numBytesRecv = 0;
+	double resTime;
+
+	clData->recvMsgLen = 0;
+	do
+	{
+		numBytesRecv = echoClientRecvPart(clData, &rxNs);
+		if (numBytesRecv > 0)
+			clData->recvMsgLen += numBytesRecv;
+	}
+	while (numBytesRecv > 0 && clData->protocol == IPPROTO_TCP && clData->recvMsgLen < clData->msgLen);
+	
 	switch(numBytesRecv)
 	{
 		/* These calls return the number of bytes received, or -1 if an error
@@ -89,6 +228,13 @@ ECHO_STATUS echoClientReceive(echoClientGlobal_t* clData)
 		case -1: 
 			if(errno == EAGAIN) //timeout
 				echoClientTimeout();
+			else
+			{
+				/*ECONNREFUSED - the connected UDP socket got an ICMP port unreachable*/
+				log_echo("echoClientReceive recv() failed, errno %d", errno);
+				echoHandleErrors(errno);
+				echoClientClose(clData);
+			}
 				
 			return ECHO_OK;
 			break;
@@ -106,61 +252,48 @@ ECHO_STATUS echoClientReceive(echoClientGlobal_t* clData)
 			break;
 			
 		default:
-			if( strlen(recvBuffer) > strlen(clData->message) )
+			if( clData->recvMsgLen > clData->msgLen )
 			{
-				sprintf(clData->lastEchoResponse, 
-				"Something went wrong! Recieved more data than expected. Sent '%s' but recieved '%s%s'.", 
-				clData->message, recvBuffer);
+				snprintf(clData->lastEchoResponse, sizeof clData->lastEchoResponse,
+				"Something went wrong! Recieved more data than expected. Sent '%.*s%s' but recieved %d bytes.", 
+				show, clData->message, szCut, clData->recvMsgLen);
 				
 				log_echo("%s", clData->lastEchoResponse);
-				
-				bzero(clData->message, sizeof(clData->message) );
-				bzero(clData->recvMesg, sizeof(clData->recvMesg) );
-				close(clData->sockfd);					
+				echoClientClose(clData);
 				return ECHO_OK;
 			}
-			
-			recvBuffer[numBytesRecv] = '\0';
-			strncpy(clData->recvMesg, recvBuffer, strlen(recvBuffer));
-			clData->recvMesg[clData->msgLen] = '\0';
-			clData->recvMsgLen = strlen(recvBuffer);
 			break;
 	}
 	
-	/*Calculate for how much time the message was received*/	
-	gettimeofday(&vEndTime, NULL);
-	vResTime.tv_sec = vEndTime.tv_sec - clData->startTime.tv_sec;
-	
-	if(clData->startTime.tv_usec > vEndTime.tv_usec)
-	{
-		vResTime.tv_sec--;
-		vResTime.tv_usec = clData->startTime.tv_usec - vEndTime.tv_usec;
-	}
-	else
-	{
-		vResTime.tv_usec = vEndTime.tv_usec - clData->startTime.tv_usec;
-	}
-	
-	resTime = (double) vResTime.tv_sec*1000 + (double)vResTime.tv_usec/1000;
+	/*Calculate for how much time the message was received - since it was sent*/	
+	resTime = (echoClientNowNs() - clData->startNs) / 1e6;
 	
 	bzero(clData->lastEchoResponse, sizeof clData->lastEchoResponse);
+	clData->recvMesg[clData->recvMsgLen] = '\0';
 
-	if( strlen(clData->recvMesg) != clData->msgLen || 0 != strncmp(clData->recvMesg, clData->message, strlen(clData->message)) )
+	if( clData->recvMsgLen != clData->msgLen || 0 != memcmp(clData->recvMesg, clData->message, clData->msgLen) )
 	{
-		sprintf(clData->lastEchoResponse, "Error: sent message '%s' with size %d, received message '%s' with size %d",
-				clData->message, clData->msgLen, clData->recvMesg, strlen(clData->recvMesg) );
+		snprintf(clData->lastEchoResponse, sizeof clData->lastEchoResponse,
+				 "Error: sent message '%.*s%s' with size %d, received message '%.*s%s' with size %d",
+				 show, clData->message, szCut, clData->msgLen,
+				 clData->recvMsgLen < show ? clData->recvMsgLen : show, clData->recvMesg,
+				 clData->recvMsgLen > show ? "..." : "", clData->recvMsgLen);
 		
 		log_echo("%s", clData->lastEchoResponse);
 	}
 	else
 	{
-		sprintf(clData->lastEchoResponse, "Message '%s' was received for %.17gms", clData->recvMesg, resTime);
+		snprintf(clData->lastEchoResponse, sizeof clData->lastEchoResponse, "Message '%.*s%s' was received for %.17gms",
+				 show, clData->recvMesg, szCut, resTime);
 		log_echo("%s", clData->lastEchoResponse);
+		
+		/*kernel to kernel: from the send passing to the device to the echo
+		  arriving, without the wakeups and syscalls of this process*/
+		if (rxNs && ECHO_OK == echoClientTxTimestamp(clData->sockfd, &txKey, &txNs) && rxNs > txNs)
+			log_echo("wire rtt %.3f ms, host overhead %.3f ms", (rxNs - txNs) / 1e6, resTime - (rxNs - txNs) / 1e6);
 	}
 		
-	bzero(clData->message, sizeof(clData->message) );
-	bzero(clData->recvMesg, sizeof(clData->recvMesg) );
-	close(clData->sockfd);	
+	echoClientClose(clData);
 	
 	return ECHO_OK;
 } 
@@ -177,27 +310,39 @@ ECHO_STATUS echoHandleErrors(int err)
 }
 
 /********************************************************************
-* Function Name  : echoClientSend()
-* Description    : Connect to server (in case of TCP) 
-				   and send the massage;
-* Input          : clData - pointer to global echo client structure;
+* Function Name  : echoClientOpen()
+* Description    : Open the client socket and connect it to the server
+* Input          : clData - pointer to echo client structure; the new
+				   socket is stored in clData->sockfd;
 * Return         : ECHO_STATUS to indicate error/success
-* Logic          : Follows standart procedure - open socket, connect
-				   to echo server for TCP and send the message;
+* Logic          : UDP sockets are connected as well, so only datagrams
+				   of the server are received and an unreachable port
+				   is reported (ICMP) instead of running into the timeout.
+				   A unix datagram socket is bound to an autobind
+				   address, the server has nowhere to echo to otherwise.
+				   ECHO_PROTO_SHM takes a channel of the shared-memory
+				   server into clData->pShm instead. With --tls the
+				   handshake follows the connect, the session is kept
+				   in clData->pTls;
 *********************************************************************/
-ECHO_STATUS echoClientSend(echoClientGlobal_t* clData)
+ECHO_STATUS echoClientOpen(echoClientGlobal_t* clData)
 {
-	socklen_t addrlen = sizeof(clData->servAddr);
 	int res = 0;
 	
+	if (clData->protocol == ECHO_PROTO_SHM)
+	{
+		clData->sockfd = -1;
+		return echoShmOpen(clData->szServer, clData->config.busyPoll, &clData->pShm);
+	}
+	
 	switch(clData->protocol)
 	{
 		case IPPROTO_TCP:
-			clData->sockfd = socket(AF_INET, SOCK_STREAM, 0);
+			clData->sockfd = socket(clData->servAddr.sa.sa_family, SOCK_STREAM, 0);
 			break;
 		
 		case IPPROTO_UDP:
-			clData->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+			clData->sockfd = socket(clData->servAddr.sa.sa_family, SOCK_DGRAM, 0);
 			break;
 	}
 	
@@ -207,40 +352,120 @@ ECHO_STATUS echoClientSend(echoClientGlobal_t* clData)
 		return ECHO_OPEN_SOCK_ERR;
 	}
 	
+	if (clData->servAddr.sa.sa_family == AF_UNIX && clData->protocol == IPPROTO_UDP &&
+		bind(clData->sockfd, &(struct sockaddr){.sa_family = AF_UNIX}, sizeof(sa_family_t)) < 0)
+	{
+		log_echo("echoClientSend autobind failed errno %d", errno);
+		close(clData->sockfd);
+		return ECHO_BIND_ERR;
+	}
+	
+	/*With UDP_SEGMENT one sendto() of a large buffer leaves the host as
+	  datagrams of udpGso bytes each, segmented by the kernel (GSO);
+	  UDP_GRO coalesces the echoed datagrams back on receive*/
+	if(clData->protocol == IPPROTO_UDP && clData->servAddr.sa.sa_family == AF_INET && clData->config.udpGso > 0)
+	{
+		if(setsockopt(clData->sockfd, SOL_UDP, UDP_SEGMENT, &clData->config.udpGso, sizeof(int)) < 0 ||
+		   setsockopt(clData->sockfd, SOL_UDP, UDP_GRO, &(int){1}, sizeof(int)) < 0)
+		{
+			log_echo("setsockopt(UDP_SEGMENT/UDP_GRO) failed errno %d", errno);
+			close(clData->sockfd);
+			return ECHO_SET_SOCK_FLG_ERR;
+		}
+	}
+	
+	echoSocketBuffers(clData->sockfd, clData->config.sndBuf, clData->config.rcvBuf);
+	
+	//system call that connects the socket referred to by the file
+	//descriptor sockfd to the address specified by servAddr.
+	res = connect(clData->sockfd, &clData->servAddr.sa, clData->servAddrLen);
+	if ( res != 0 )
+	{
+		sprintf(clData->lastEchoResponse, "Failed to connect echo %s server!", echoClientProtoName(clData));
+		log_echo("echoClientSend connect() failed, errno %d", errno);
+		log_echo("%s", clData->lastEchoResponse);
+		echoHandleErrors(errno);
+		close(clData->sockfd);
+		return ECHO_CONNECT_ERR;
+	}
+	
+	if (clData->config.tls && ECHO_OK != (res = echoTlsConnect(clData->sockfd, &clData->pTls)))
+	{
+		close(clData->sockfd);
+		return res;
+	}
+	
+	return ECHO_OK;
+}
+
+/********************************************************************
+* Function Name  : echoClientSend()
+* Description    : Connect to server (in case of TCP) 
+				   and send the massage;
+* Input          : clData - pointer to global echo client structure;
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Follows standart procedure - open socket, connect
+				   to echo server for TCP and send the message;
+*********************************************************************/
+ECHO_STATUS echoClientSend(echoClientGlobal_t* clData)
+{
+	ECHO_STATUS iRet = ECHO_OK;
+	int numBytesSent = 0;
+	
+	if (ECHO_OK != (iRet = echoClientOpen(clData)))
+		return iRet;
+	
+	if (clData->protocol == ECHO_PROTO_SHM)
+	{
+		clData->startNs = echoClientNowNs();
+		if (ECHO_OK != (iRet = echoShmSend(clData->pShm, clData->message, clData->msgLen)))
+			echoClientClose(clData);
+		clData->sendBytes = clData->msgLen;
+		return iRet;
+	}
+	
+	/*Set the time of waiting to receive the message back, i.e timeout*/
+	/*The setsockopt() function set the SO_RCVTIMEO option, at the SOL_SOCKET protocol level, 
+	  to the clData->timeout value for the clData->sockfd socket; it is set
+	  before the send, so the call is not part of the measured time*/
+	if (setsockopt(clData->sockfd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&clData->timeout, sizeof clData->timeout) < 0)
+	{
+		log_echo("setsockopt(SO_RCVTIMEO) failed errno %d", errno);
+		echoClientClose(clData);
+		return ECHO_SET_SOCK_FLG_ERR;
+	}
+	
+	if (clData->config.timestamping && ECHO_OK != (iRet = echoClientTimestampEnable(clData->sockfd)))
+	{
+		echoClientClose(clData);
+		return iRet;
+	}
+	
+	clData->startNs = echoClientNowNs();
 	switch(clData->protocol)
 	{
 		case IPPROTO_TCP:
-			//system call that connects the socket referred to by the file
-			//descriptor sockfd to the address specified by servAddr.
-			res = connect(clData->sockfd, (struct sockaddr*)&clData->servAddr, sizeof(clData->servAddr));
-			if ( res != 0 )
-			{
-				sprintf(clData->lastEchoResponse, "Failed to connect echo tcp server!");
-				log_echo("echoClientSend connect() failed, errno %d", errno);
-				log_echo("%s", clData->lastEchoResponse);
-				echoHandleErrors(errno);
-				close(clData->sockfd);
-				return ECHO_CONNECT_ERR;
-			}
-			
 			/*The system calls send() is used to transmit a message to another socket. It is used only when 
-			  the socket is in a connected state (so that the intended recipient is known - TCP).*/
-			clData->sendBytes = send(clData->sockfd, clData->message, clData->msgLen, 0);
+			  the socket is in a connected state (so that the intended recipient is known - TCP).
+			  A TLS session may take a long message in parts.*/
+			for (clData->sendBytes = 0; clData->sendBytes < clData->msgLen && numBytesSent >= 0; clData->sendBytes += numBytesSent)
+				numBytesSent = echoTlsSend(clData->pTls, clData->sockfd, clData->message + clData->sendBytes,
+								   clData->msgLen - clData->sendBytes);
 			//log_echo("echoClientSend send() %d", clData->sendBytes);
 			
-			if(clData->sendBytes < 0 )
+			if(numBytesSent < 0 )
 			{
 				log_echo("echoClientSend send() failed, errno %d", errno);
 				log_echo("%s", clData->lastEchoResponse);
 				echoHandleErrors(errno);
-				close(clData->sockfd);
+				echoClientClose(clData);
 				return ECHO_SEND_ERR;
 			}
 			break;
 			
 		case IPPROTO_UDP:
 		     //The system call sendto() is used to transmit a message to another UDP socket;
-			if((clData->sendBytes = sendto(clData->sockfd, clData->message, (size_t)clData->msgLen, 0, (struct sockaddr *)&clData->servAddr, addrlen)) < 0 )
+			if((clData->sendBytes = sendto(clData->sockfd, clData->message, (size_t)clData->msgLen, 0, &clData->servAddr.sa, clData->servAddrLen)) < 0 )
 			{
 				sprintf(clData->lastEchoResponse, "Failed to connect echo udp server!");
 				log_echo("echoClientSend sendto() failed, errno %d", errno);
@@ -275,8 +500,6 @@ ECHO_STATUS echoClientGlobalInit(echoClientGlobal_t **ppGlobal)
 	pClGlobal->sendBytes = 0;
 	pClGlobal->recvMsgLen = 0;
 	
-	bzero(pClGlobal->message, sizeof(pClGlobal->message) );
-	bzero(pClGlobal->recvMesg, sizeof(pClGlobal->recvMesg) );
 	bzero(pClGlobal->lastEchoResponse, sizeof(pClGlobal->lastEchoResponse) );
 			
 	*ppGlobal = pClGlobal;
@@ -284,7 +507,74 @@ ECHO_STATUS echoClientGlobalInit(echoClientGlobal_t **ppGlobal)
      return ECHO_OK;
 } 
 
-ECHO_STATUS echoClientStart(char** arg_values) 
+/*Fill in the server address and the protocol given on the command line;
+  the port comes from clData->config. A path (or @name) is a unix
+  socket - stream for protocol 6, datagram for 17; protocol "shm" takes
+  the --shm name of the server instead of an address. --tls needs TCP
+  over IPv4 and prepares the client context*/
+ECHO_STATUS echoClientSetServer(echoClientGlobal_t *clData, char *szIp, char *szProtocol)
+{
+	clData->szServer = szIp;
+	if (0 == strcmp(szProtocol, "shm"))
+	{
+		clData->protocol = ECHO_PROTO_SHM;
+		return szIp[0] != '\0' && strchr(szIp, '/') == NULL && !clData->config.tls ? ECHO_OK : ECHO_BAD_PARAM;
+	}
+	
+	sscanf (szProtocol, "%d", &clData->protocol);
+	if (clData->protocol != IPPROTO_TCP && clData->protocol != IPPROTO_UDP)
+		return ECHO_BAD_PARAM;
+	
+	if (szIp[0] == '/' || szIp[0] == '@')
+	{
+		clData->servAddrLen = echoUnixAddr(szIp, &clData->servAddr.un);
+		return clData->servAddrLen && !clData->config.tls ? ECHO_OK : ECHO_BAD_PARAM;
+	}
+	
+	if (0 == inet_aton(szIp, &clData->servAddr.in.sin_addr))
+		return ECHO_BAD_PARAM;
+	clData->servAddr.in.sin_family = AF_INET;
+	clData->servAddr.in.sin_port = htons(clData->config.port);
+	clData->servAddrLen = sizeof(struct sockaddr_in);
+	
+	/*kernel timestamps read the socket, not the session*/
+	if (clData->config.tls)
+	{
+		if (clData->protocol != IPPROTO_TCP || clData->config.timestamping)
+			return ECHO_BAD_PARAM;
+		return echoTlsClientInit(&clData->config);
+	}
+	
+	return ECHO_OK;
+}
+
+/*Name of the transport, as the reports and the CSV output show it*/
+const char *echoClientProtoName(echoClientGlobal_t *clData)
+{
+	if (clData->protocol == ECHO_PROTO_SHM)
+		return "shm";
+	if (clData->servAddr.sa.sa_family == AF_UNIX)
+		return clData->protocol == IPPROTO_TCP ? "unix-stream" : "unix-dgram";
+	if (clData->config.tls)
+		return "tls";
+	return clData->protocol == IPPROTO_TCP ? "tcp" : "udp";
+}
+
+/*Close the socket (after close_notify of a TLS session) or give back
+  the shared-memory channel*/
+void echoClientClose(echoClientGlobal_t *clData)
+{
+	echoTlsFree(clData->pTls, 1);
+	clData->pTls = NULL;
+	if (clData->pShm)
+		echoShmClose(clData->pShm);
+	clData->pShm = NULL;
+	if (clData->sockfd >= 0)
+		close(clData->sockfd);
+	clData->sockfd = -1;
+}
+
+ECHO_STATUS echoClientStart(char** arg_values, echoClientConfig *pConfig) 
 {
 	ECHO_STATUS iRet = 0;
 	
@@ -295,22 +585,30 @@ ECHO_STATUS echoClientStart(char** arg_values)
 		return iRet;
 	}
 	
-	/*2: ip of the server
-	  3: protocol to use - TCP/UDP
-	  4: message to send
-	  5: timeout
+	pClientGlobal->config = *pConfig;
+	
+	/*0: ip of the server
+	  1: protocol to use - TCP/UDP
+	  2: message to send
+	  3: timeout
 	  */
 	
-	inet_aton(arg_values[2], &pClientGlobal->servAddr.sin_addr);
-	pClientGlobal->servAddr.sin_family = AF_INET;
-	pClientGlobal->servAddr.sin_port = htons(ECHO_PORT_DEFAULT);
-		
-	sscanf (arg_values[3], "%d", &pClientGlobal->protocol);
-	sscanf (arg_values[5], "%d", &pClientGlobal->waitTime);
-	pClientGlobal->timeout.tv_usec = pClientGlobal->waitTime;
+	iRet = echoClientSetServer(pClientGlobal, arg_values[0], arg_values[1]);
+	if (ECHO_OK != iRet)
+	{
+		log_echo("%s", arrErrors[iRet]);
+		return iRet;
+	}
 	
-	strncpy(pClientGlobal->message, arg_values[4], ECHO_MAX_MSG_SIZE);
+	sscanf (arg_values[3], "%d", &pClientGlobal->waitTime);
+	/*the wait time is in milliseconds*/
+	pClientGlobal->timeout.tv_sec = pClientGlobal->waitTime / 1000;
+	pClientGlobal->timeout.tv_usec = (pClientGlobal->waitTime % 1000) * 1000;
+	
+	pClientGlobal->message = arg_values[2];
 	pClientGlobal->msgLen = strlen(pClientGlobal->message);
+	if (NULL == (pClientGlobal->recvMesg = malloc(pClientGlobal->msgLen + 2)))
+		return ECHO_NO_MEM_ERR;
 		
 	iRet = echoClientSend(pClientGlobal);
 	if (ECHO_OK != iRet)
@@ -0,0 +1,1316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include "echo_main.h"
+#include "echo_epoll.h"
+#include "echo_reflect.h"
+#include "echo_tls.h"
+
+/*Register fd in the worker's epoll instance; edge-triggered, so every
+  handler below drains its descriptor until EAGAIN*/
+static ECHO_STATUS echoEpollAdd(echoWorker *pWorker, echoConn *pConn, unsigned int events)
+{
+	struct epoll_event ev;
+
+	bzero(&ev, sizeof ev);
+	ev.events = events;
+	ev.data.ptr = pConn;
+
+	if (epoll_ctl(pWorker->epfd, EPOLL_CTL_ADD, pConn->fd, &ev) < 0)
+	{
+		log_echo_err("epoll_ctl(ADD) fd %d failed errno %d", pConn->fd, errno);
+		return ECHO_FAIL;
+	}
+
+	return ECHO_OK;
+}
+
+/*Stop (events = 0) or restart (EPOLLIN | EPOLLET) reporting new connections
+  on the TCP and TLS listeners. EPOLL_CTL_MOD re-evaluates readiness, so
+  connections that queued up in the backlog while paused are reported right
+  after the listener is resumed*/
+static void echoEpollListenerPause(echoWorker *pWorker, int pause)
+{
+	echoConn *listeners[2] = {&pWorker->tcpListenConn, &pWorker->tlsListenConn};
+	struct epoll_event ev;
+	int i = 0;
+
+	if (pWorker->listenPaused == pause)
+		return;
+
+	for (i = 0; i < 2; i++)
+	{
+		if (listeners[i]->type == 0)
+			continue;
+
+		bzero(&ev, sizeof ev);
+		ev.events = pause ? 0 : EPOLLIN | EPOLLET;
+		ev.data.ptr = listeners[i];
+
+		if (epoll_ctl(pWorker->epfd, EPOLL_CTL_MOD, listeners[i]->fd, &ev) < 0)
+		{
+			log_echo_err("epoll_ctl(MOD) listener %d failed errno %d", listeners[i]->fd, errno);
+			return;
+		}
+	}
+
+	pWorker->listenPaused = pause;
+}
+
+/*Borrow an idle pipe from the reactor pool, create one if the pool is empty*/
+static ECHO_STATUS echoEpollPipeGet(echoWorker *pWorker, echoConn *pConn)
+{
+	echoPipePool *pPool = pWorker->pPipePool;
+
+	if (pPool->count > 0)
+	{
+		pPool->count--;
+		pConn->pipeFds[0] = pPool->fds[pPool->count][0];
+		pConn->pipeFds[1] = pPool->fds[pPool->count][1];
+		return ECHO_OK;
+	}
+
+	if (pipe2(pConn->pipeFds, O_NONBLOCK | O_CLOEXEC) < 0)
+	{
+		log_echo_err("pipe2 failed errno %d", errno);
+		pConn->pipeFds[0] = pConn->pipeFds[1] = -1;
+		return ECHO_FAIL;
+	}
+
+	/*a bigger pipe moves more per splice(); the default is 64 KB*/
+	fcntl(pConn->pipeFds[1], F_SETPIPE_SZ, pPool->pipeSize);
+
+	return ECHO_OK;
+}
+
+/*Give the pipe back; a pipe that still holds data can not be reused*/
+static void echoEpollPipePut(echoWorker *pWorker, echoConn *pConn)
+{
+	echoPipePool *pPool = pWorker->pPipePool;
+
+	if (pConn->pipeFds[0] < 0)
+		return;
+
+	if (pConn->pipeBytes == 0 && pPool->count < ECHO_SPLICE_POOL_MAX)
+	{
+		pPool->fds[pPool->count][0] = pConn->pipeFds[0];
+		pPool->fds[pPool->count][1] = pConn->pipeFds[1];
+		pPool->count++;
+	}
+	else
+	{
+		close(pConn->pipeFds[0]);
+		close(pConn->pipeFds[1]);
+	}
+
+	pConn->pipeFds[0] = pConn->pipeFds[1] = -1;
+	pConn->pipeBytes = 0;
+}
+
+static unsigned long long echoEpollNowMs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/*The descriptor of a client is closed - it no longer counts against
+  tcpMaxConnections*/
+static void echoEpollClientGone(echoWorker *pWorker)
+{
+	echoServersData *pData = &pWorker->pGlobal->echoServersData;
+
+	__atomic_sub_fetch(&pData->iClientsCount, 1, __ATOMIC_RELAXED);
+	ECHO_STAT_ADD(pWorker->pStats->closed, 1);
+	if (pWorker->listenPaused)
+		echoEpollListenerPause(pWorker, 0);
+}
+
+/*Queue a closing client behind the others; every one waits the same
+  ECHO_ZC_CLOSE_MS, so the list stays ordered by deadline*/
+static void echoEpollZcClosingAdd(echoWorker *pWorker, echoConn *pConn)
+{
+	pConn->pNextClosing = NULL;
+	pConn->closeDeadlineMs = echoEpollNowMs() + ECHO_ZC_CLOSE_MS;
+	if (pWorker->pClosingTail)
+		pWorker->pClosingTail->pNextClosing = pConn;
+	else
+		pWorker->pClosingHead = pConn;
+	pWorker->pClosingTail = pConn;
+}
+
+/*Closing client: wait for the completions of its zerocopy sends, they
+  arrive as EPOLLERR; the descriptor goes once no buffer is pinned, the
+  state when echoEpollZcSweep() reaches it*/
+static void echoEpollZcClosing(echoWorker *pWorker, echoConn *pConn)
+{
+	if (pConn->fd < 0)
+		return;
+
+	echoZcReap(pConn->fd, &pConn->zc, &pWorker->bufPool, pWorker->pStats);
+	if (pConn->zc.count > 0)
+		return;
+
+	close(pConn->fd);
+	pConn->fd = -1;
+	echoEpollClientGone(pWorker);
+}
+
+/***********************************************************************
+* Function Name  : echoEpollZcSweep()
+* Description    : Release the closing clients that are done or waited
+				   too long
+* Input          : pWorker - the reactor
+* Return         : ms until the oldest closing client is due, -1 - none
+* Logic          : A peer that stays connected but does not read never
+				   acknowledges the pinned data, so its completions do
+				   not come. After ECHO_ZC_CLOSE_MS its socket is reset
+				   (SO_LINGER 0) - the kernel drops the unsent data -
+				   and the buffers wait another ECHO_ZC_CLOSE_MS for
+				   copies still in a device queue before they go back
+				   to the pool;
+************************************************************************/
+static int echoEpollZcSweep(echoWorker *pWorker)
+{
+	struct linger linger = {1, 0};
+	echoConn *pConn = NULL;
+	unsigned long long now = echoEpollNowMs();
+
+	while ((pConn = pWorker->pClosingHead))
+	{
+		if (pConn->closeDeadlineMs > now && (pConn->fd >= 0 || pConn->zc.count > 0))
+			return pConn->closeDeadlineMs - now;
+
+		pWorker->pClosingHead = pConn->pNextClosing;
+		if (pWorker->pClosingHead == NULL)
+			pWorker->pClosingTail = NULL;
+
+		if (pConn->fd >= 0)
+		{
+			log_echo_warn("%d zerocopy send(s) of closed client %d not complete after %d ms, resetting it",
+						  pConn->zc.count, pConn->fd, ECHO_ZC_CLOSE_MS);
+			setsockopt(pConn->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof linger);
+			close(pConn->fd);
+			pConn->fd = -1;
+			echoEpollClientGone(pWorker);
+			echoEpollZcClosingAdd(pWorker, pConn);
+			continue;
+		}
+
+		echoZcDrop(&pConn->zc, &pWorker->bufPool);
+		echoSlabFree(&pWorker->connSlab, pConn);
+	}
+
+	return -1;
+}
+
+static void echoEpollCloseClient(echoWorker *pWorker, echoConn *pConn)
+{
+	struct epoll_event ev;
+
+	if (pWorker->pPipePool)
+		echoEpollPipePut(pWorker, pConn);
+	if (pConn->pOut)
+		echoBufPut(&pWorker->bufPool, pConn->pOut);
+	echoTlsFree(pConn->pTls, 0);
+
+	/*the kernel may still send from pinned buffers - closing the socket
+	  would lose their completions, so only its input is shut off. The
+	  client counts against tcpMaxConnections until the socket is closed*/
+	if (pConn->zc.count > 0)
+		echoZcReap(pConn->fd, &pConn->zc, &pWorker->bufPool, pWorker->pStats);
+	ev.events = EPOLLET;
+	ev.data.ptr = pConn;
+	if (pConn->zc.count > 0 && epoll_ctl(pWorker->epfd, EPOLL_CTL_MOD, pConn->fd, &ev) == 0)
+	{
+		shutdown(pConn->fd, SHUT_RD);
+		pConn->type = ECHO_CONN_TCP_ZC_CLOSING;
+		echoEpollZcClosingAdd(pWorker, pConn);
+		return;
+	}
+
+	/*close() removes the descriptor from the epoll set as well*/
+	close(pConn->fd);
+	echoSlabFree(&pWorker->connSlab, pConn);
+	echoEpollClientGone(pWorker);
+}
+
+/***********************************************************************
+* Function Name  : echoEpollAccept()
+* Description    : Accept every pending connection on a listening
+				   socket and register the clients in the reactor;
+* Input          : pWorker - reactor that owns the listening socket
+				   pListen - the TCP or the TLS listener
+* Logic          : Stops accepting once tcpMaxConnections clients are
+				   served - the listeners are then paused and the pending
+				   connections wait in the kernel backlog. A client of
+				   the TLS listener starts with a server session, its
+				   handshake is driven by its events;
+************************************************************************/
+static void echoEpollAccept(echoWorker *pWorker, echoConn *pListen)
+{
+	echoServersData *pData = &pWorker->pGlobal->echoServersData;
+	echoConn *pConn = NULL;
+	int clientSock = -1;
+
+	while (1)
+	{
+		if (__atomic_load_n(&pData->iClientsCount, __ATOMIC_RELAXED) >= pData->tcpMaxConnections)
+		{
+			echoEpollListenerPause(pWorker, 1);
+			return;
+		}
+
+		/*accept4() hands the socket over non-blocking, no fcntl() per client*/
+		clientSock = accept4(pListen->fd, (struct sockaddr*)NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (clientSock == -1)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+				log_echo_warn("accept() on sock %d failed errno %d", pListen->fd, errno);
+
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
+		}
+
+		/*an echo bigger than the read buffer goes out in pieces - Nagle
+		  would hold the last one until the client's delayed ACK*/
+		if (!pWorker->local)
+			setsockopt(clientSock, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+		if (NULL == (pConn = echoSlabAlloc(&pWorker->connSlab)))
+		{
+			log_echo_err("Could not allocate memory for client %d", clientSock);
+			close(clientSock);
+			continue;
+		}
+
+		pConn->fd = clientSock;
+		pConn->type = ECHO_CONN_TCP;
+		pConn->pipeFds[0] = pConn->pipeFds[1] = -1;
+		pConn->pipeBytes = 0;
+		pConn->pOut = NULL;
+		pConn->outHead = 0;
+		pConn->outBlocked = 0;
+		pConn->readPaused = 0;
+		pConn->eof = 0;
+		pConn->pTls = NULL;
+		pConn->zeroCopy = pWorker->zcThreshold && pListen->type == ECHO_CONN_TCP_LISTEN;
+		bzero(&pConn->zc, sizeof pConn->zc);
+
+		if (pListen->type == ECHO_CONN_TLS_LISTEN)
+		{
+			pConn->type = ECHO_CONN_TLS_HANDSHAKE;
+			if (NULL == (pConn->pTls = echoTlsAccept(clientSock)))
+			{
+				log_echo_err("Could not create the TLS session of client %d", clientSock);
+				close(clientSock);
+				echoSlabFree(&pWorker->connSlab, pConn);
+				continue;
+			}
+		}
+
+		/*EPOLLOUT tells a connection with queued data when a full socket drained*/
+		if (ECHO_OK != echoEpollAdd(pWorker, pConn, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET))
+		{
+			echoTlsFree(pConn->pTls, 0);
+			close(clientSock);
+			echoSlabFree(&pWorker->connSlab, pConn);
+			continue;
+		}
+
+		__atomic_add_fetch(&pData->iClientsCount, 1, __ATOMIC_RELAXED);
+		ECHO_STAT_ADD(pWorker->pStats->accepted, 1);
+	}
+}
+
+/*Describe the queued bytes (queued = 1) or the free space (queued = 0)
+  of a connection's output ring; a wrapped region needs two iovecs*/
+static int echoEpollRingIov(echoConn *pConn, int queued, struct iovec *pIov)
+{
+	echoBuf *pOut = pConn->pOut;
+	unsigned int start = queued ? pConn->outHead : (pConn->outHead + pOut->len) % pOut->cap;
+	unsigned int len = queued ? pOut->len : pOut->cap - pOut->len;
+	unsigned int first = pOut->cap - start;
+
+	pIov[0].iov_base = pOut->data + start;
+	pIov[0].iov_len = len < first ? len : first;
+	if (len <= first)
+		return 1;
+
+	pIov[1].iov_base = pOut->data;
+	pIov[1].iov_len = len - first;
+	return 2;
+}
+
+/*Send what is queued on a connection until the socket is full; an empty
+  ring goes back to the pool, so idle clients do not hold a buffer*/
+static ECHO_STATUS echoEpollRingFlush(echoWorker *pWorker, echoConn *pConn)
+{
+	struct iovec iov[2];
+	struct msghdr msg;
+	ssize_t numBytesSent = 0;
+
+	bzero(&msg, sizeof msg);
+	msg.msg_iov = iov;
+
+	while (pConn->pOut && pConn->pOut->len > 0 && !pConn->outBlocked)
+	{
+		msg.msg_iovlen = echoEpollRingIov(pConn, 1, iov);
+		numBytesSent = sendmsg(pConn->fd, &msg, MSG_NOSIGNAL);
+		if (numBytesSent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+				return ECHO_FAIL;
+			}
+
+			pConn->outBlocked = 1;
+			break;
+		}
+
+		ECHO_STAT_ADD(pWorker->pStats->bytesOut, numBytesSent);
+		if ((size_t)numBytesSent < iov[0].iov_len + (msg.msg_iovlen > 1 ? iov[1].iov_len : 0))
+			ECHO_STAT_ADD(pWorker->pStats->shortWrites, 1);
+		pConn->outHead = (pConn->outHead + numBytesSent) % pConn->pOut->cap;
+		pConn->pOut->len -= numBytesSent;
+	}
+
+	if (pConn->pOut && pConn->pOut->len == 0)
+	{
+		echoBufPut(&pWorker->bufPool, pConn->pOut);
+		pConn->pOut = NULL;
+		pConn->outHead = 0;
+	}
+
+	return ECHO_OK;
+}
+
+/*Output ring for the unsent part of an echo. Every client holds at most
+  one, so when all of them are in use the pool grows instead of turning
+  a slow reader away - tcpMaxConnections bounds it. NULL only when no
+  memory is left*/
+static echoBuf *echoEpollRingGet(echoWorker *pWorker)
+{
+	echoBufPool *pPool = &pWorker->bufPool;
+	echoBuf *pBuf = echoBufGet(pPool);
+
+	if (pBuf)
+		return pBuf;
+
+	if (ECHO_OK != echoBufPoolGrow(pPool, ECHO_POOL_GROW_BUFFERS))
+	{
+		log_echo_warn("No memory to queue the echo of a client, closing it");
+		ECHO_STAT_ADD(pWorker->pStats->tcpRingsExhausted, 1);
+		return NULL;
+	}
+
+	log_echo("Reactor %d: all output rings in use, the pool grew to %d", pWorker->id, pPool->count);
+	return echoBufGet(pPool);
+}
+
+/*Echo the reactor buffer with MSG_ZEROCOPY when it is big enough and a
+  spare buffer can take its place; the sent buffer stays pinned on the
+  connection and the spare receives from now on. A quarter of the pool
+  is kept for the output rings*/
+static ssize_t echoEpollZcSend(echoWorker *pWorker, echoConn *pConn, echoBuf *pBuf)
+{
+	echoBufPool *pPool = &pWorker->bufPool;
+	echoBuf *pSpare = NULL;
+	ssize_t n = 0;
+
+	if (pBuf->len < pWorker->zcThreshold || pPool->freeCount <= ECHO_ZC_RESERVE(pPool->count) ||
+		NULL == (pSpare = echoBufGet(pPool)))
+	{
+		ECHO_STAT_ADD(pWorker->pStats->zcFallbacks, 1);
+		return send(pConn->fd, pBuf->data, pBuf->len, MSG_NOSIGNAL);
+	}
+
+	n = echoZcSend(pConn->fd, &pConn->zc, pBuf, 0, pBuf->len, pWorker->pStats);
+	if (echoZcPin(&pConn->zc, pBuf))
+		pWorker->pRecvBuf = pSpare;
+	else
+		echoBufPut(pPool, pSpare);
+	return n;
+}
+
+/***********************************************************************
+* Function Name  : echoEpollTcpEcho()
+* Description    : Echo everything that is readable on a TCP client
+* Input          : pWorker - the reactor
+				   pConn - the client
+* Return         : ECHO_FAIL when the connection has to be closed
+* Logic          : While nothing is queued, data is received into the
+				   reactor buffer and sent straight back. Whatever the
+				   socket does not take is copied to an output ring
+				   borrowed from the pool (which grows when all rings
+				   are in use), and later data is received
+				   behind it to keep the order. Above the high-water
+				   mark the client is not read any more - its data
+				   stays in the kernel and TCP flow control slows it
+				   down - until EPOLLOUT drains the ring. A zerocopy
+				   send replaces the reactor buffer, so it is looked up
+				   again for every read;
+************************************************************************/
+static ECHO_STATUS echoEpollTcpEcho(echoWorker *pWorker, echoConn *pConn)
+{
+	echoBuf *pBuf = NULL;
+	struct iovec iov[2];
+	int numBytesRecv = 0;
+	int numBytesSent = 0;
+
+	while (1)
+	{
+		pBuf = pWorker->pRecvBuf;
+		if (ECHO_OK != echoEpollRingFlush(pWorker, pConn))
+			return ECHO_FAIL;
+
+		/*a client that finished sending is closed once its echo is out*/
+		if (pConn->eof)
+			return pConn->pOut ? ECHO_OK : ECHO_FAIL;
+
+		if (pConn->pOut && pConn->pOut->len >= ECHO_TCP_RING_HIGH_WATER(pConn->pOut->cap))
+		{
+			if (!pConn->readPaused)
+				ECHO_STAT_ADD(pWorker->pStats->tcpReadPauses, 1);
+			pConn->readPaused = 1;
+			return ECHO_OK;
+		}
+		pConn->readPaused = 0;
+
+		if (pConn->pOut)
+			numBytesRecv = readv(pConn->fd, iov, echoEpollRingIov(pConn, 0, iov));
+		else
+			numBytesRecv = recv(pConn->fd, pBuf->data, pBuf->cap, 0);
+
+		if (numBytesRecv == 0)
+		{
+			pConn->eof = 1;
+			continue;
+		}
+
+		if (numBytesRecv < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return ECHO_OK;
+			return ECHO_FAIL;
+		}
+
+		ECHO_STAT_ADD(pWorker->pStats->bytesIn, numBytesRecv);
+		if (pConn->pOut)
+		{
+			pConn->pOut->len += numBytesRecv;
+			ECHO_STAT_ADD(pWorker->pStats->tcpQueuedBytes, numBytesRecv);
+			continue;
+		}
+
+		pBuf->len = numBytesRecv;
+		if (pConn->zeroCopy)
+			numBytesSent = echoEpollZcSend(pWorker, pConn, pBuf);
+		else
+			numBytesSent = send(pConn->fd, pBuf->data, pBuf->len, MSG_NOSIGNAL);
+		if (numBytesSent < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+				return ECHO_FAIL;
+			}
+			numBytesSent = 0;
+		}
+
+		ECHO_STAT_ADD(pWorker->pStats->bytesOut, numBytesSent);
+		if ((unsigned int)numBytesSent == pBuf->len)
+			continue;
+
+		/*a short write means the socket buffer is full*/
+		ECHO_STAT_ADD(pWorker->pStats->shortWrites, 1);
+		if (NULL == (pConn->pOut = echoEpollRingGet(pWorker)))
+			return ECHO_FAIL;
+
+		pConn->outHead = 0;
+		pConn->outBlocked = 1;
+		pConn->pOut->len = pBuf->len - numBytesSent;
+		memcpy(pConn->pOut->data, pBuf->data + numBytesSent, pConn->pOut->len);
+		ECHO_STAT_ADD(pWorker->pStats->tcpQueuedBytes, pConn->pOut->len);
+	}
+}
+
+/***********************************************************************
+* Function Name  : echoEpollTcpSplice()
+* Description    : Zero-copy echo of a TCP client
+* Input          : pWorker - the reactor
+				   pConn - the client
+* Return         : ECHO_FAIL when the connection has to be closed
+* Logic          : Move the data socket -> pipe -> socket with splice();
+				   the payload stays in kernel pages and is never copied
+				   to user space. Whatever is left in the pipe is sent
+				   first, so when the socket is full the client is not
+				   read any more until EPOLLOUT; the pipe goes back to
+				   the pool as soon as it is empty;
+************************************************************************/
+static ECHO_STATUS echoEpollTcpSplice(echoWorker *pWorker, echoConn *pConn)
+{
+	ssize_t n = 0;
+
+	if (pConn->pipeFds[0] < 0 && ECHO_OK != echoEpollPipeGet(pWorker, pConn))
+		return ECHO_FAIL;
+
+	while (1)
+	{
+		while (pConn->pipeBytes > 0)
+		{
+			n = splice(pConn->pipeFds[0], NULL, pConn->fd, NULL, pConn->pipeBytes, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN)
+					return ECHO_OK;
+				ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+				return ECHO_FAIL;
+			}
+			ECHO_STAT_ADD(pWorker->pStats->bytesOut, n);
+			if (n < pConn->pipeBytes)
+				ECHO_STAT_ADD(pWorker->pStats->shortWrites, 1);
+			pConn->pipeBytes -= n;
+		}
+
+		n = splice(pConn->fd, NULL, pConn->pipeFds[1], NULL, pWorker->pPipePool->pipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (n == 0)
+			return ECHO_FAIL;
+
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				return ECHO_FAIL;
+
+			echoEpollPipePut(pWorker, pConn);
+			return ECHO_OK;
+		}
+
+		ECHO_STAT_ADD(pWorker->pStats->bytesIn, n);
+		pConn->pipeBytes += n;
+	}
+}
+
+/*Handle the events of a TCP client; a half-closed client is closed once
+  everything it sent has been echoed*/
+static void echoEpollTcpEvent(echoWorker *pWorker, echoConn *pConn, unsigned int events)
+{
+	socklen_t optLen = sizeof(int);
+	int sockErr = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	/*zerocopy completions wait on the error queue, they signal EPOLLERR
+	  as well; only a pending socket error closes the client*/
+	if ((events & EPOLLERR) && pConn->zeroCopy)
+	{
+		echoZcReap(pConn->fd, &pConn->zc, &pWorker->bufPool, pWorker->pStats);
+		if (getsockopt(pConn->fd, SOL_SOCKET, SO_ERROR, &sockErr, &optLen) == 0 && sockErr == 0)
+			events &= ~EPOLLERR;
+	}
+
+	if (events & (EPOLLERR | EPOLLHUP))
+	{
+		echoEpollCloseClient(pWorker, pConn);
+		return;
+	}
+
+	if (events & EPOLLOUT)
+		pConn->outBlocked = 0;
+
+	if (pWorker->pPipePool)
+	{
+		iRet = echoEpollTcpSplice(pWorker, pConn);
+		if ((events & EPOLLRDHUP) && pConn->pipeBytes == 0)
+			iRet = ECHO_FAIL;
+	}
+	else
+		iRet = echoEpollTcpEcho(pWorker, pConn);
+
+	if (ECHO_OK != iRet)
+		echoEpollCloseClient(pWorker, pConn);
+}
+
+/***********************************************************************
+* Function Name  : echoEpollTlsEcho()
+* Description    : Echo everything that is readable on a TLS client
+				   whose record layer (or part of it) is in user space
+* Input          : pWorker - the reactor
+				   pConn - the client
+* Return         : ECHO_FAIL when the connection has to be closed
+* Logic          : A record is decrypted into the reactor buffer and
+				   written back through the session. What the session
+				   does not take is kept in a buffer from the pool and
+				   written first on the next event - a write that has
+				   to be retried must carry the same data - and the
+				   client is not read meanwhile. OpenSSL buffers no
+				   more than one record, so edge-triggered events are
+				   not missed once SSL_read() wants the socket again;
+************************************************************************/
+static ECHO_STATUS echoEpollTlsEcho(echoWorker *pWorker, echoConn *pConn)
+{
+	echoBuf *pBuf = pWorker->pRecvBuf;
+	ssize_t numBytesRecv = 0;
+	ssize_t numBytesSent = 0;
+
+	while (1)
+	{
+		while (pConn->pOut)
+		{
+			numBytesSent = echoTlsSend(pConn->pTls, pConn->fd, pConn->pOut->data + pConn->outHead, pConn->pOut->len);
+			if (numBytesSent < 0)
+			{
+				if (errno == EAGAIN)
+					return ECHO_OK;
+				ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+				return ECHO_FAIL;
+			}
+
+			ECHO_STAT_ADD(pWorker->pStats->bytesOut, numBytesSent);
+			pConn->outHead += numBytesSent;
+			pConn->pOut->len -= numBytesSent;
+			if (pConn->pOut->len == 0)
+			{
+				echoBufPut(&pWorker->bufPool, pConn->pOut);
+				pConn->pOut = NULL;
+				pConn->outHead = 0;
+			}
+		}
+
+		numBytesRecv = echoTlsRecv(pConn->pTls, pConn->fd, pBuf->data, pBuf->cap);
+		if (numBytesRecv == 0)
+			return ECHO_FAIL;
+		if (numBytesRecv < 0)
+			return errno == EAGAIN ? ECHO_OK : ECHO_FAIL;
+
+		ECHO_STAT_ADD(pWorker->pStats->bytesIn, numBytesRecv);
+		numBytesSent = echoTlsSend(pConn->pTls, pConn->fd, pBuf->data, numBytesRecv);
+		if (numBytesSent < 0)
+		{
+			if (errno != EAGAIN)
+			{
+				ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+				return ECHO_FAIL;
+			}
+			numBytesSent = 0;
+		}
+
+		ECHO_STAT_ADD(pWorker->pStats->bytesOut, numBytesSent);
+		if (numBytesSent == numBytesRecv)
+			continue;
+
+		ECHO_STAT_ADD(pWorker->pStats->shortWrites, 1);
+		if (NULL == (pConn->pOut = echoEpollRingGet(pWorker)))
+			return ECHO_FAIL;
+
+		pConn->outHead = 0;
+		pConn->pOut->len = numBytesRecv - numBytesSent;
+		memcpy(pConn->pOut->data, pBuf->data + numBytesSent, pConn->pOut->len);
+		ECHO_STAT_ADD(pWorker->pStats->tcpQueuedBytes, pConn->pOut->len);
+	}
+}
+
+/*Handle the events of a TLS client: drive the handshake, then echo. A
+  session the kernel runs both ways (kTLS) turns into a plain TCP client,
+  its echo is recv()/send() or splice() of clear text*/
+static void echoEpollTlsEvent(echoWorker *pWorker, echoConn *pConn, unsigned int events)
+{
+	int ktls = 0;
+	int res = 0;
+
+	if (events & (EPOLLERR | EPOLLHUP))
+	{
+		echoEpollCloseClient(pWorker, pConn);
+		return;
+	}
+
+	if (pConn->type == ECHO_CONN_TLS_HANDSHAKE)
+	{
+		if ((res = echoTlsHandshake(pConn->pTls)) <= 0)
+		{
+			if (res < 0)
+			{
+				ECHO_STAT_ADD(pWorker->pStats->tlsFailed, 1);
+				echoEpollCloseClient(pWorker, pConn);
+			}
+			return;
+		}
+
+		ktls = echoTlsKernel(pConn->pTls);
+		ECHO_STAT_ADD(pWorker->pStats->tlsHandshakes, 1);
+		if (ktls & ECHO_TLS_KTLS_TX)
+			ECHO_STAT_ADD(pWorker->pStats->tlsKtlsTx, 1);
+		if (ktls & ECHO_TLS_KTLS_RX)
+			ECHO_STAT_ADD(pWorker->pStats->tlsKtlsRx, 1);
+
+		/*the records that may already wait are not reported again*/
+		pConn->type = ktls == ECHO_TLS_KTLS_BOTH ? ECHO_CONN_TCP : ECHO_CONN_TLS;
+		if (pConn->type == ECHO_CONN_TCP)
+		{
+			echoEpollTcpEvent(pWorker, pConn, EPOLLIN | EPOLLOUT);
+			return;
+		}
+	}
+
+	if (ECHO_OK != echoEpollTlsEcho(pWorker, pConn))
+		echoEpollCloseClient(pWorker, pConn);
+}
+
+/*Turn the UDP_GRO cmsg of a received datagram into the UDP_SEGMENT cmsg
+  of its echo; plain datagrams are sent without ancillary data*/
+static void echoEpollUdpGsoPrepare(echoWorker *pWorker, struct msghdr *pMsg, unsigned int len)
+{
+	struct cmsghdr *pCmsg = NULL;
+	int segSize = 0;
+
+	for (pCmsg = CMSG_FIRSTHDR(pMsg); pCmsg != NULL; pCmsg = CMSG_NXTHDR(pMsg, pCmsg))
+	{
+		if (pCmsg->cmsg_level == SOL_UDP && pCmsg->cmsg_type == UDP_GRO)
+			memcpy(&segSize, CMSG_DATA(pCmsg), sizeof segSize);
+	}
+
+	if (segSize <= 0 || len <= (unsigned int)segSize)
+	{
+		pMsg->msg_control = NULL;
+		pMsg->msg_controllen = 0;
+		return;
+	}
+
+	ECHO_STAT_ADD(pWorker->pStats->udpGroSegments, (len + segSize - 1) / segSize);
+
+	pMsg->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+	pCmsg = CMSG_FIRSTHDR(pMsg);
+	pCmsg->cmsg_level = SOL_UDP;
+	pCmsg->cmsg_type = UDP_SEGMENT;
+	pCmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+	*(uint16_t *)CMSG_DATA(pCmsg) = (uint16_t)segSize;
+}
+
+/*Reflect datagrams first .. first + count - 1 of the batch; what the
+  socket does not take is dropped, the reactor may not block*/
+static void echoEpollUdpSend(echoWorker *pWorker, int first, int count)
+{
+	echoUdpBatch *pBatch = &pWorker->udpBatch;
+	int numSent = 0;
+	int res = 0;
+	int i = 0;
+
+	for (numSent = 0; numSent < count; numSent += res)
+	{
+		res = sendmmsg(pWorker->udpSocket, &pBatch->msgs[first + numSent], count - numSent, 0);
+		if (res < 0)
+		{
+			if (errno == EINTR)
+			{
+				res = 0;
+				continue;
+			}
+
+			ECHO_STAT_ADD(pWorker->pStats->udpDropped, count - numSent);
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+			return;
+		}
+
+		for (i = first + numSent; i < first + numSent + res; i++)
+			ECHO_STAT_ADD(pWorker->pStats->bytesOut, pBatch->iovs[i].iov_len);
+	}
+}
+
+/***********************************************************************
+* Function Name  : echoEpollUdpEcho()
+* Description    : Reflect every datagram queued on the UDP socket
+* Input          : pWorker - reactor that owns the UDP socket
+* Logic          : Drain up to udpBatch.size datagrams per recvmmsg()
+				   into the preallocated buffers and send them back to
+				   their sources with a single sendmmsg(); repeat until
+				   the socket is empty. In GRO mode a datagram may be a
+				   super-packet of equally sized segments - it is echoed
+				   with the same UDP_SEGMENT size, so the kernel splits
+				   it again and the client sees the original datagrams.
+				   In reflector mode test datagrams get the receive and
+				   transmit times of the server stamped in. A datagram
+				   bigger than its slot (MSG_TRUNC) is dropped, not
+				   echoed cut - the datagrams around it are sent in
+				   runs;
+************************************************************************/
+static void echoEpollUdpEcho(echoWorker *pWorker)
+{
+	echoUdpBatch *pBatch = &pWorker->udpBatch;
+	int numRecv = 0;
+	int first = 0;
+	int i = 0;
+
+	while (1)
+	{
+		for (i = 0; i < pBatch->size; i++)
+		{
+			pBatch->iovs[i].iov_len = pBatch->slotSize;
+			pBatch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+			if (pBatch->gro || pBatch->reflect)
+			{
+				pBatch->msgs[i].msg_hdr.msg_control = pBatch->controls[i].buf;
+				pBatch->msgs[i].msg_hdr.msg_controllen = sizeof(echoUdpControl);
+			}
+		}
+
+		numRecv = recvmmsg(pWorker->udpSocket, pBatch->msgs, pBatch->size, 0, NULL);
+		if (numRecv <= 0)
+		{
+			if (numRecv < 0 && errno == EINTR)
+				continue;
+			return;
+		}
+
+		ECHO_STAT_ADD(pWorker->pStats->udpBatches, 1);
+		ECHO_STAT_ADD(pWorker->pStats->datagrams, numRecv);
+
+		/*echo exactly what was received*/
+		for (i = 0; i < numRecv; i++)
+		{
+			ECHO_STAT_ADD(pWorker->pStats->bytesIn, pBatch->msgs[i].msg_len);
+			if (pBatch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+				continue;
+			pBatch->iovs[i].iov_len = pBatch->msgs[i].msg_len;
+			if (pBatch->reflect)
+				echoReflectStamp(pBatch->iovs[i].iov_base, pBatch->msgs[i].msg_len,
+								 echoReflectRxNs(&pBatch->msgs[i].msg_hdr), &pBatch->reflectSeq);
+			/*the echo carries no ancillary data but a UDP_SEGMENT size*/
+			if (pBatch->gro)
+				echoEpollUdpGsoPrepare(pWorker, &pBatch->msgs[i].msg_hdr, pBatch->msgs[i].msg_len);
+			else if (pBatch->reflect)
+				pBatch->msgs[i].msg_hdr.msg_controllen = 0;
+		}
+
+		for (first = 0, i = 0; i <= numRecv; i++)
+		{
+			if (i < numRecv && !(pBatch->msgs[i].msg_hdr.msg_flags & MSG_TRUNC))
+				continue;
+			if (i > first)
+				echoEpollUdpSend(pWorker, first, i - first);
+			if (i < numRecv)
+				ECHO_STAT_ADD(pWorker->pStats->udpDropped, 1);
+			first = i + 1;
+		}
+
+		if (numRecv < pBatch->size)
+			return;
+	}
+}
+
+/*Allocate the recvmmsg()/sendmmsg() vectors of one reactor; a datagram
+  bigger than slotSize is dropped*/
+static ECHO_STATUS echoEpollUdpBatchInit(echoUdpBatch *pBatch, int size, int slotSize, int gro, int reflect, int hugePages)
+{
+	int i = 0;
+
+	pBatch->size = size;
+	pBatch->gro = gro;
+	pBatch->reflect = reflect;
+	pBatch->slotSize = ECHO_ALIGN_UP(gro ? ECHO_UDP_GRO_BUFSIZE : slotSize, ECHO_CACHE_LINE);
+	pBatch->msgs = calloc(size, sizeof(struct mmsghdr));
+	pBatch->iovs = calloc(size, sizeof(struct iovec));
+	pBatch->addrs = calloc(size, sizeof(struct sockaddr_storage));
+	pBatch->controls = calloc(size, sizeof(echoUdpControl));
+	pBatch->buffers = echoPoolRegionAlloc((size_t)size * pBatch->slotSize, hugePages, &pBatch->buffersSize);
+
+	if (!pBatch->msgs || !pBatch->iovs || !pBatch->addrs || !pBatch->controls || !pBatch->buffers)
+	{
+		log_echo_err("Could not allocate memory for %d UDP batch buffers", size);
+		return ECHO_NO_MEM_ERR;
+	}
+
+	for (i = 0; i < size; i++)
+	{
+		pBatch->iovs[i].iov_base = pBatch->buffers + (size_t)i * pBatch->slotSize;
+		pBatch->msgs[i].msg_hdr.msg_iov = &pBatch->iovs[i];
+		pBatch->msgs[i].msg_hdr.msg_iovlen = 1;
+		pBatch->msgs[i].msg_hdr.msg_name = &pBatch->addrs[i];
+	}
+
+	return ECHO_OK;
+}
+
+/************************************************************************
+* Function Name  : echoEpollWorker()
+* Description    : A function that will be executed by pthread; runs
+				   the edge-triggered event loop of one reactor;
+* Input          : pWorker - reactor with the sockets to serve;
+* Return         : ECHO_STATUS to indicate error/success
+*************************************************************************/
+void *echoEpollWorker(void *pWorkerPar)
+{
+	echoWorker *pWorker = (echoWorker *)pWorkerPar;
+	struct epoll_event events[ECHO_EPOLL_MAX_EVENTS];
+	echoConn *pConn = NULL;
+	int nEvents = 0;
+	int blockMs = -1;
+	int closingMs = -1;
+	int i = 0;
+	static ECHO_STATUS ret;
+
+	log_echo("Reactor %d is serving %s sock=[%d] %s sock=[%d] tls sock=[%d] on cpu %d", pWorker->id,
+			 pWorker->local ? "unix stream" : "tcp", pWorker->tcpSocket, pWorker->local ? "unix dgram" : "udp",
+			 pWorker->udpSocket, pWorker->tlsSocket, sched_getcpu());
+
+	while (1)
+	{
+		/*A paused listener has to notice connections released by other
+		  reactors, so it wakes up periodically, and so does a reactor
+		  with closing zerocopy clients; otherwise block. In busy poll
+		  mode an idle reactor polls without blocking for a while first*/
+		closingMs = pWorker->pClosingHead ? echoEpollZcSweep(pWorker) : -1;
+		blockMs = pWorker->listenPaused ? ECHO_EPOLL_PAUSE_MS : -1;
+		if (closingMs >= 0 && (blockMs < 0 || closingMs < blockMs))
+			blockMs = closingMs;
+		if (pWorker->busyPoll.spinNs)
+			blockMs = echoBusyPollTimeout(&pWorker->busyPoll, blockMs);
+
+		nEvents = epoll_wait(pWorker->epfd, events, ECHO_EPOLL_MAX_EVENTS, blockMs);
+		if (pWorker->busyPoll.spinNs)
+			echoBusyPollWoke(&pWorker->busyPoll, nEvents);
+		if (nEvents < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			log_echo_err("epoll_wait failed errno %d", errno);
+			ret = ECHO_FAIL;
+			pthread_exit(&ret);
+		}
+
+		if (pWorker->listenPaused)
+		{
+			if (pWorker->tcpSocket >= 0)
+				echoEpollAccept(pWorker, &pWorker->tcpListenConn);
+			if (pWorker->tlsSocket >= 0)
+				echoEpollAccept(pWorker, &pWorker->tlsListenConn);
+		}
+
+		for (i = 0; i < nEvents; i++)
+		{
+			pConn = (echoConn *)events[i].data.ptr;
+
+			switch (pConn->type)
+			{
+				case ECHO_CONN_TCP_LISTEN:
+				case ECHO_CONN_TLS_LISTEN:
+					echoEpollAccept(pWorker, pConn);
+					break;
+
+				case ECHO_CONN_UDP:
+					echoEpollUdpEcho(pWorker);
+					break;
+
+				case ECHO_CONN_TCP:
+					echoEpollTcpEvent(pWorker, pConn, events[i].events);
+					break;
+
+				case ECHO_CONN_TLS_HANDSHAKE:
+				case ECHO_CONN_TLS:
+					echoEpollTlsEvent(pWorker, pConn, events[i].events);
+					break;
+
+				case ECHO_CONN_TCP_ZC_CLOSING:
+					echoEpollZcClosing(pWorker, pConn);
+					break;
+			}
+		}
+
+		if (pWorker->busyPoll.spinNs)
+			echoBusyPollWorked(&pWorker->busyPoll);
+	}
+
+	ret = ECHO_OK;
+	pthread_exit(&ret);
+}
+
+/*Prepare one reactor around the already opened server sockets; local -
+  the stream and datagram sockets are unix domain sockets*/
+static ECHO_STATUS echoEpollWorkerInit(echoWorker *pWorker, EchoGlobal_t *pGlobal, int id, int tcpSocket, int udpSocket,
+									   int tlsSocket, int local)
+{
+	bzero(pWorker, sizeof(echoWorker));
+
+	pWorker->id = id;
+	pWorker->local = local;
+	pWorker->pGlobal = pGlobal;
+	pWorker->tcpSocket = tcpSocket;
+	pWorker->udpSocket = udpSocket;
+	pWorker->tlsSocket = tlsSocket;
+	pWorker->pStats = echoStatsSlotGet(id);
+	echoSlabInit(&pWorker->connSlab, sizeof(echoConn));
+
+	if ((pWorker->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		log_echo_err("epoll_create1 failed errno %d", errno);
+		return ECHO_FAIL;
+	}
+
+	/*a blocking epoll_wait() busy polls the queues of its sockets first
+	  (Linux >= 6.9; before, net.core.busy_poll does the same for all)*/
+	echoBusyPollInit(&pWorker->busyPoll, pGlobal->config.busyPoll, pWorker->pStats);
+	if (pGlobal->config.busyPoll > 0 &&
+		ioctl(pWorker->epfd, EPIOCSPARAMS, &(struct epoll_params){.busy_poll_usecs = pGlobal->config.busyPoll,
+																 .busy_poll_budget = ECHO_BUSY_POLL_BUDGET,
+																 .prefer_busy_poll = 1}) < 0)
+		log_echo_warn("ioctl(EPIOCSPARAMS) failed errno %d, set net.core.busy_poll instead", errno);
+
+	if ((tcpSocket >= 0 || tlsSocket >= 0) && pGlobal->config.tcpSplice)
+	{
+		if (NULL == (pWorker->pPipePool = calloc(1, sizeof(echoPipePool))))
+			return ECHO_NO_MEM_ERR;
+		pWorker->pPipePool->pipeSize = ECHO_SPLICE_PIPE_SIZE;
+	}
+
+	/*one buffer receives, the others are output rings of slow readers;
+	  TLS in user space needs them with --splice too*/
+	if ((tcpSocket >= 0 && !pGlobal->config.tcpSplice) || tlsSocket >= 0)
+	{
+		if (ECHO_OK != echoBufPoolInit(&pWorker->bufPool, pGlobal->config.poolBuffers + 1,
+									   ECHO_CONFIG_BUFSIZE(&pGlobal->config, ECHO_TCP_RING_SIZE), pGlobal->config.hugePages))
+			return ECHO_NO_MEM_ERR;
+		pWorker->pRecvBuf = echoBufGet(&pWorker->bufPool);
+	}
+
+	/*splice moves the data without a user buffer to pin; unix sockets
+	  and TLS do not take MSG_ZEROCOPY*/
+	if (tcpSocket >= 0 && !local && !pGlobal->config.tcpSplice)
+		pWorker->zcThreshold = pGlobal->config.zeroCopy;
+
+	if (tcpSocket >= 0)
+	{
+
+		pWorker->tcpListenConn.fd = tcpSocket;
+		pWorker->tcpListenConn.type = ECHO_CONN_TCP_LISTEN;
+		if (ECHO_OK != echoEpollAdd(pWorker, &pWorker->tcpListenConn, EPOLLIN | EPOLLET))
+			return ECHO_FAIL;
+	}
+
+	if (tlsSocket >= 0)
+	{
+		pWorker->tlsListenConn.fd = tlsSocket;
+		pWorker->tlsListenConn.type = ECHO_CONN_TLS_LISTEN;
+		if (ECHO_OK != echoEpollAdd(pWorker, &pWorker->tlsListenConn, EPOLLIN | EPOLLET))
+			return ECHO_FAIL;
+	}
+
+	if (udpSocket >= 0)
+	{
+		pWorker->udpConn.fd = udpSocket;
+		pWorker->udpConn.type = ECHO_CONN_UDP;
+
+		/*UDP_GRO lets the kernel hand over a train of same-sized datagrams
+		  from one flow as a single super-packet (Linux >= 5.0)*/
+		if (pGlobal->config.udpGro && !local &&
+			setsockopt(udpSocket, SOL_UDP, UDP_GRO, &(int){1}, sizeof(int)) < 0)
+		{
+			log_echo_err("setsockopt(UDP_GRO) failed errno %d", errno);
+			return ECHO_SET_SOCK_FLG_ERR;
+		}
+
+		/*without kernel times the reflector stamps when it reads the batch*/
+		if (pGlobal->config.udpReflect)
+			echoReflectEnable(udpSocket);
+
+		if (ECHO_OK != echoEpollUdpBatchInit(&pWorker->udpBatch, pGlobal->config.udpBatch,
+											 ECHO_CONFIG_BUFSIZE(&pGlobal->config, ECHO_UDP_BUFSIZE), pGlobal->config.udpGro && !local,
+											 pGlobal->config.udpReflect, pGlobal->config.hugePages))
+			return ECHO_NO_MEM_ERR;
+		if (ECHO_OK != echoEpollAdd(pWorker, &pWorker->udpConn, EPOLLIN | EPOLLET))
+			return ECHO_FAIL;
+	}
+
+	return ECHO_OK;
+}
+
+/*********************************************************************
+* Function Name  : echoEpollServersStart()
+* Description    : Start echo tcp/udp servers on epoll reactors
+* Input          : pGlobal - reference to global echo servers DB
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Start config.workers reactor threads that serve all
+				   clients without creating a thread per connection;
+				   with more than one worker every reactor opens its
+				   own SO_REUSEPORT TCP and UDP sockets, so the kernel
+				   spreads connections and flows across the workers
+				   and no socket is shared between threads;
+***********************************************************************/
+ECHO_STATUS echoEpollServersStart(EchoGlobal_t *pGlobal)
+{
+	echoServersData *pData = &pGlobal->echoServersData;
+	echoWorker *pWorkers = NULL;
+	int workers = pGlobal->config.workers;
+	int reusePort = workers > 1;
+	pthread_attr_t attr;
+	int tcpSocket = -1;
+	int udpSocket = -1;
+	int tlsSocket = -1;
+	int cpu = -1;
+	int started = 0;
+	int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	echoServerCloseConnections(pGlobal, IPPROTO_TCP);
+	echoServerCloseConnections(pGlobal, IPPROTO_UDP);
+
+	/*one counter slot per worker, then the unix, shared-memory and AF_XDP threads*/
+	if (ECHO_OK != (iRet = echoStatsInit(&pGlobal->config, workers + echoAuxSlots(&pGlobal->config))))
+		return iRet;
+
+	if (NULL == (pWorkers = calloc(workers, sizeof(echoWorker))))
+	{
+		log_echo_err("Could not allocate memory for %d reactors", workers);
+		return ECHO_NO_MEM_ERR;
+	}
+
+	for (i = 0; i < workers && ECHO_OK == iRet; i++)
+	{
+		tcpSocket = -1;
+		udpSocket = -1;
+		tlsSocket = -1;
+		cpu = echoAffinityCpu(&pGlobal->config.cpus, i);
+
+		/*the buffers of a pinned worker go to the NUMA node of its CPU*/
+		if (cpu >= 0)
+			echoAffinityMemPrefer(echoAffinityCpuNode(cpu));
+
+		if (pData->tcpStatus)
+			iRet = echoOpenServerSocket(IPPROTO_TCP, &pGlobal->config, reusePort, &tcpSocket);
+
+		if (ECHO_OK == iRet && pData->udpStatus)
+			iRet = echoOpenServerSocket(IPPROTO_UDP, &pGlobal->config, reusePort, &udpSocket);
+
+		/*every worker accepts and encrypts TLS clients as well*/
+		if (ECHO_OK == iRet && pGlobal->config.tlsPort)
+			iRet = echoOpenServerSocket(ECHO_PROTO_TLS, &pGlobal->config, reusePort, &tlsSocket);
+
+		/*the sockets of the first worker are the ones the global DB knows about*/
+		if (i == 0)
+		{
+			pData->tcpSocket = tcpSocket;
+			pData->udpSocket = udpSocket;
+		}
+
+		if (ECHO_OK == iRet && pGlobal->config.incomingCpu)
+		{
+			echoAffinityIncomingCpu(tcpSocket, cpu);
+			echoAffinityIncomingCpu(udpSocket, cpu);
+			echoAffinityIncomingCpu(tlsSocket, cpu);
+		}
+
+		if (ECHO_OK == iRet)
+			iRet = echoEpollWorkerInit(&pWorkers[i], pGlobal, i, tcpSocket, udpSocket, tlsSocket, 0);
+	}
+
+	if (pGlobal->config.cpus.count > 0)
+		echoAffinityMemPrefer(-1);
+
+	if (ECHO_OK != iRet)
+	{
+		log_echo_err("Could not prepare reactor %d - %s", i - 1, arrErrors[iRet]);
+		return iRet;
+	}
+
+	/*the unix sockets, --shm and --xdp are served by threads of their
+	  own; a failure returns before any worker runs*/
+	if (ECHO_OK != (iRet = echoAuxServersStart(pGlobal, workers)))
+		return iRet;
+
+	for (started = 0; started < workers; started++)
+	{
+		/*worker n runs on the n-th CPU of --cpus from its first instruction*/
+		if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pGlobal->config.cpus, started)))
+			break;
+		if (pthread_create(&pWorkers[started].threadId, &attr, echoEpollWorker, (void*)&pWorkers[started]) != 0)
+			iRet = ECHO_PTHREAD_ERR;
+		pthread_attr_destroy(&attr);
+		if (ECHO_OK != iRet)
+		{
+			perror("could not create thread - echoEpollWorker!");
+			break;
+		}
+	}
+
+	log_echo("%d echo reactor(s) started", started);
+
+	/*the reactors never return; the main thread reports their counters*/
+	if (ECHO_OK == iRet && pGlobal->config.statsInterval > 0)
+		echoStatsReportLoop(pGlobal->config.statsInterval);
+
+	for (i = 0; i < started; i++)
+		pthread_join(pWorkers[i].threadId, NULL);
+
+	return iRet;
+}
+
+/*********************************************************************
+* Function Name  : echoEpollAuxStart()
+* Description    : Serve the unix domain sockets, and the TLS listener
+				   of the uring and legacy backends, on a reactor of
+				   their own
+* Input          : pGlobal - config.unixStream/unixDgram paths, tlsPort
+				   slot - counter slot (and --cpus index) of the reactor
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The stream listener is served like the TCP one and
+				   the datagram socket like the UDP one, whatever the
+				   backend of the TCP/UDP servers is; there is no
+				   SO_REUSEPORT for unix sockets, so one reactor. The
+				   epoll workers have TLS listeners of their own;
+***********************************************************************/
+ECHO_STATUS echoEpollAuxStart(EchoGlobal_t *pGlobal, int slot)
+{
+	echoWorker *pWorker = NULL;
+	pthread_attr_t attr;
+	int streamSocket = -1;
+	int dgramSocket = -1;
+	int tlsSocket = -1;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (pGlobal->config.unixStream)
+		iRet = echoOpenUnixSocket(SOCK_STREAM, pGlobal->config.unixStream, &pGlobal->config, &streamSocket);
+	if (ECHO_OK == iRet && pGlobal->config.unixDgram)
+		iRet = echoOpenUnixSocket(SOCK_DGRAM, pGlobal->config.unixDgram, &pGlobal->config, &dgramSocket);
+	if (ECHO_OK == iRet && pGlobal->config.tlsPort && pGlobal->config.ioMode != ECHO_IO_EPOLL)
+		iRet = echoOpenServerSocket(ECHO_PROTO_TLS, &pGlobal->config, 0, &tlsSocket);
+	if (ECHO_OK != iRet)
+		return iRet;
+
+	if (NULL == (pWorker = calloc(1, sizeof(echoWorker))))
+		return ECHO_NO_MEM_ERR;
+	if (ECHO_OK != (iRet = echoEpollWorkerInit(pWorker, pGlobal, slot, streamSocket, dgramSocket, tlsSocket, 1)))
+	{
+		log_echo_err("Could not prepare the unix socket/TLS reactor - %s", arrErrors[iRet]);
+		return iRet;
+	}
+
+	if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pGlobal->config.cpus, slot)))
+		return iRet;
+	if (pthread_create(&pWorker->threadId, &attr, echoEpollWorker, (void*)pWorker) != 0)
+		iRet = ECHO_PTHREAD_ERR;
+	pthread_attr_destroy(&attr);
+	if (ECHO_OK != iRet)
+		perror("could not create thread - echoEpollWorker!");
+
+	return iRet;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include "echo_main.h"
+#include "echo_hist.h"
+
+/*Bucket of a value: exact below SUB_COUNT, otherwise the top SUB_BITS
+  bits of the value select the bucket within its power of 2*/
+static int echoHistIndex(unsigned long long value)
+{
+	int shift = 0;
+
+	if (value < ECHO_HIST_SUB_COUNT)
+		return (int)value;
+
+	if (value >> ECHO_HIST_MAX_BITS)
+		value = (1ULL << ECHO_HIST_MAX_BITS) - 1;
+
+	shift = 63 - __builtin_clzll(value) - (ECHO_HIST_SUB_BITS - 1);
+	return ECHO_HIST_SUB_COUNT + (shift - 1) * ECHO_HIST_HALF_COUNT +
+		   (int)(value >> shift) - ECHO_HIST_HALF_COUNT;
+}
+
+/*Highest value that falls into a bucket*/
+static unsigned long long echoHistValue(int index)
+{
+	int shift = 0;
+	unsigned long long sub = 0;
+
+	if (index < ECHO_HIST_SUB_COUNT)
+		return index;
+
+	shift = (index - ECHO_HIST_SUB_COUNT) / ECHO_HIST_HALF_COUNT + 1;
+	sub = (index - ECHO_HIST_SUB_COUNT) % ECHO_HIST_HALF_COUNT + ECHO_HIST_HALF_COUNT;
+	return ((sub + 1) << shift) - 1;
+}
+
+void echoHistInit(echoHist *pHist)
+{
+	bzero(pHist, sizeof(echoHist));
+	pHist->min = ~0ULL;
+}
+
+void echoHistRecord(echoHist *pHist, unsigned long long value)
+{
+	pHist->counts[echoHistIndex(value)]++;
+	pHist->count++;
+	pHist->sum += value;
+	if (value < pHist->min)
+		pHist->min = value;
+	if (value > pHist->max)
+		pHist->max = value;
+}
+
+void echoHistMerge(echoHist *pDst, echoHist *pSrc)
+{
+	int i = 0;
+
+	for (i = 0; i < ECHO_HIST_BUCKETS; i++)
+		pDst->counts[i] += pSrc->counts[i];
+
+	pDst->count += pSrc->count;
+	pDst->sum += pSrc->sum;
+	if (pSrc->min < pDst->min)
+		pDst->min = pSrc->min;
+	if (pSrc->max > pDst->max)
+		pDst->max = pSrc->max;
+}
+
+/*Smallest bucket value that covers percentile % of the recorded values*/
+unsigned long long echoHistPercentile(echoHist *pHist, double percentile)
+{
+	unsigned long long rank = 0;
+	unsigned long long seen = 0;
+	int i = 0;
+
+	if (pHist->count == 0)
+		return 0;
+
+	rank = (unsigned long long)(percentile / 100.0 * pHist->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	for (i = 0; i < ECHO_HIST_BUCKETS; i++)
+	{
+		seen += pHist->counts[i];
+		if (seen >= rank)
+			return echoHistValue(i) < pHist->max ? echoHistValue(i) : pHist->max;
+	}
+
+	return pHist->max;
+}
+
+/*Print the usual latency percentiles of a histogram of nanoseconds, in us*/
+void echoHistPrint(echoHist *pHist, char *szName)
+{
+	if (pHist->count == 0)
+	{
+		log_echo("%s: no samples", szName);
+		return;
+	}
+
+	log_echo("%s (us): min %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f, mean %.1f", szName,
+			 pHist->min / 1e3, echoHistPercentile(pHist, 50) / 1e3, echoHistPercentile(pHist, 90) / 1e3,
+			 echoHistPercentile(pHist, 99) / 1e3, echoHistPercentile(pHist, 99.9) / 1e3,
+			 pHist->max / 1e3, (double)pHist->sum / pHist->count / 1e3);
+}
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "echo_main.h"
+#include "echo_stats.h"
+#include "echo_idle.h"
+
+/*The "<key>: <n> kB" line of a /proc file, -1 when there is none*/
+static long echoIdleProcKb(const char *szPath, const char *szKey)
+{
+	char line[256];
+	size_t keyLen = strlen(szKey);
+	long kb = -1;
+	FILE *pFile = fopen(szPath, "r");
+
+	if (pFile == NULL)
+		return -1;
+
+	while (fgets(line, sizeof line, pFile))
+	{
+		if (strncmp(line, szKey, keyLen) == 0 && line[keyLen] == ':')
+		{
+			kb = strtol(line + keyLen + 1, NULL, 10);
+			break;
+		}
+	}
+
+	fclose(pFile);
+	return kb;
+}
+
+/*Give up connection i of the round; close() takes it out of the epoll set*/
+static void echoIdleFail(echoIdle *pIdle, int i)
+{
+	pIdle->lastErrno = errno;
+	if (pIdle->fds[i] >= 0)
+		close(pIdle->fds[i]);
+	pIdle->fds[i] = -1;
+	pIdle->states[i] = ECHO_IDLE_CLOSED;
+	pIdle->pending--;
+	pIdle->failed++;
+}
+
+/*Start connection i. On loopback every ECHO_IDLE_PER_SOURCE connections
+  take the next 127.0.0.x source address - one address runs out of
+  ephemeral ports at ~28k; IP_BIND_ADDRESS_NO_PORT leaves the port to
+  connect()*/
+static void echoIdleConnect(echoIdle *pIdle, int i)
+{
+	echoClientGlobal_t *pClient = pIdle->pClient;
+	struct sockaddr_in src;
+	struct epoll_event ev;
+	int fd = socket(pClient->servAddr.sa.sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	pIdle->pending++;
+	pIdle->fds[i] = fd;
+	pIdle->states[i] = ECHO_IDLE_CONNECTING;
+	if (fd < 0)
+	{
+		echoIdleFail(pIdle, i);
+		return;
+	}
+
+	if (pIdle->loopback)
+	{
+		bzero(&src, sizeof src);
+		src.sin_family = AF_INET;
+		src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + i / ECHO_IDLE_PER_SOURCE);
+		setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &(int){1}, sizeof(int));
+		if (bind(fd, (struct sockaddr *)&src, sizeof src) < 0)
+		{
+			echoIdleFail(pIdle, i);
+			return;
+		}
+	}
+	echoSocketBuffers(fd, pClient->config.sndBuf, pClient->config.rcvBuf);
+
+	ev.events = EPOLLOUT;
+	ev.data.u32 = i;
+	if ((connect(fd, &pClient->servAddr.sa, pClient->servAddrLen) < 0 && errno != EINPROGRESS) ||
+		epoll_ctl(pIdle->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		echoIdleFail(pIdle, i);
+}
+
+/*Send the probe on connection i and wait for its echo; add - an idle
+  connection of an earlier round, not in the epoll set*/
+static void echoIdleProbe(echoIdle *pIdle, int i, int add)
+{
+	struct epoll_event ev;
+
+	ev.events = EPOLLIN;
+	ev.data.u32 = i;
+	if (add)
+		pIdle->pending++;
+	pIdle->states[i] = ECHO_IDLE_ECHOING;
+	if (send(pIdle->fds[i], &(char){ECHO_IDLE_PROBE}, 1, MSG_NOSIGNAL) != 1 ||
+		epoll_ctl(pIdle->epfd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, pIdle->fds[i], &ev) < 0)
+		echoIdleFail(pIdle, i);
+}
+
+static void echoIdleEvent(echoIdle *pIdle, int i)
+{
+	socklen_t optLen = sizeof(int);
+	int err = 0;
+	char c = 0;
+	ssize_t n = 0;
+
+	if (pIdle->states[i] == ECHO_IDLE_CONNECTING)
+	{
+		if (getsockopt(pIdle->fds[i], SOL_SOCKET, SO_ERROR, &err, &optLen) < 0 || err != 0)
+		{
+			errno = err;
+			echoIdleFail(pIdle, i);
+			return;
+		}
+		echoIdleProbe(pIdle, i, 0);
+		return;
+	}
+
+	n = recv(pIdle->fds[i], &c, 1, 0);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n != 1 || c != ECHO_IDLE_PROBE)
+	{
+		if (n >= 0)
+			errno = 0;
+		echoIdleFail(pIdle, i);
+		return;
+	}
+
+	/*quiet from now on, nothing to wait for*/
+	epoll_ctl(pIdle->epfd, EPOLL_CTL_DEL, pIdle->fds[i], NULL);
+	pIdle->states[i] = ECHO_IDLE_IDLE;
+	pIdle->pending--;
+	pIdle->echoed++;
+}
+
+/***********************************************************************
+* Function Name  : echoIdleRound()
+* Description    : Open the connections (connect = 1) or probe the idle
+				   ones, ECHO_IDLE_WINDOW at a time
+* Input          : pIdle - the connections
+				   connect - open them, otherwise echo one byte on the
+				   open ones
+* Logic          : Every connection is done once its probe came back;
+				   when nothing moves for --timeout ms the connections
+				   in flight fail and the round ends - a server at its
+				   tcpMaxConnections leaves them in the backlog;
+************************************************************************/
+static void echoIdleRound(echoIdle *pIdle, int connect)
+{
+	struct epoll_event events[ECHO_IDLE_MAX_EVENTS];
+	int next = 0;
+	int n = 0;
+	int i = 0;
+
+	pIdle->pending = pIdle->echoed = pIdle->failed = 0;
+	while (next < pIdle->count || pIdle->pending > 0)
+	{
+		for (; next < pIdle->count && pIdle->pending < ECHO_IDLE_WINDOW; next++)
+		{
+			if (connect)
+				echoIdleConnect(pIdle, next);
+			else if (pIdle->states[next] == ECHO_IDLE_IDLE)
+				echoIdleProbe(pIdle, next, 1);
+		}
+		if (pIdle->pending == 0)
+			continue;
+
+		n = epoll_wait(pIdle->epfd, events, ECHO_IDLE_MAX_EVENTS, pIdle->pClient->config.timeoutMs);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			log_echo("Nothing moved for %d ms, %d connection(s) in flight given up, %d not started",
+					 pIdle->pClient->config.timeoutMs, pIdle->pending, pIdle->count - next);
+			errno = ETIMEDOUT;
+			for (i = 0; i < next; i++)
+			{
+				if (pIdle->states[i] == ECHO_IDLE_CONNECTING || pIdle->states[i] == ECHO_IDLE_ECHOING)
+					echoIdleFail(pIdle, i);
+			}
+			return;
+		}
+
+		for (i = 0; i < n; i++)
+			echoIdleEvent(pIdle, events[i].data.u32);
+	}
+}
+
+/***********************************************************************
+* Function Name  : echoIdleStart()
+* Description    : Idle connection mode of the echo client - hold many
+				   quiet connections and measure what they cost the
+				   server
+* Input          : arg_values - <ip> <protocol>, TCP or a unix stream
+				   socket
+				   pConfig - connections, duration (how long they stay
+				   quiet), timeout
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Every connection echoes one byte, so the server has
+				   accepted it and holds its state. The RSS of the
+				   server (its pid comes from its counters, the server
+				   has to run on this host) and the kernel slab memory
+				   are sampled before and after; the differences per
+				   connection are printed. After --duration seconds of
+				   silence every connection has to echo once more;
+************************************************************************/
+ECHO_STATUS echoIdleStart(char **arg_values, echoClientConfig *pConfig)
+{
+	echoClientGlobal_t *pClient = NULL;
+	echoIdle idle;
+	char szStatus[64];
+	unsigned long long start = 0;
+	double elapsed = 0;
+	long rssBefore = -1;
+	long rssAfter = -1;
+	long slabBefore = -1;
+	long slabAfter = -1;
+	int pid = 0;
+	int open = 0;
+	int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (ECHO_OK != (iRet = echoClientGlobalInit(&pClient)))
+		return iRet;
+
+	pClient->config = *pConfig;
+	if (ECHO_OK != (iRet = echoClientSetServer(pClient, arg_values[0], arg_values[1])) ||
+		pClient->protocol != IPPROTO_TCP || pConfig->tls || pConfig->connections < 1 || pConfig->duration < 0 ||
+		pConfig->timeoutMs < 1)
+	{
+		log_echo("%s", arrErrors[ECHO_BAD_PARAM]);
+		return ECHO_BAD_PARAM;
+	}
+
+	echoFdLimit(pConfig->connections + ECHO_FD_RESERVE);
+
+	bzero(&idle, sizeof idle);
+	idle.pClient = pClient;
+	idle.count = pConfig->connections;
+	idle.loopback = pClient->servAddr.sa.sa_family == AF_INET &&
+					(ntohl(pClient->servAddr.in.sin_addr.s_addr) >> 24) == (INADDR_LOOPBACK >> 24);
+	idle.fds = malloc(idle.count * sizeof(int));
+	idle.states = calloc(idle.count, sizeof(unsigned char));
+	if (!idle.fds || !idle.states)
+		return ECHO_NO_MEM_ERR;
+	if ((idle.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return ECHO_FAIL;
+
+	pid = echoStatsServerPid(pConfig->port);
+	snprintf(szStatus, sizeof szStatus, "/proc/%d/status", pid);
+	if (pid > 0)
+		rssBefore = echoIdleProcKb(szStatus, "VmRSS");
+	slabBefore = echoIdleProcKb("/proc/meminfo", "Slab");
+
+	log_echo("Idle: %s, %d connections, one byte echoed on each, then %d s quiet", echoClientProtoName(pClient),
+			 idle.count, pConfig->duration);
+
+	start = echoClientNowNs();
+	echoIdleRound(&idle, 1);
+	elapsed = (echoClientNowNs() - start) / 1e9;
+	open = idle.echoed;
+	log_echo("%d of %d connections open in %.2f s (%.0f connections/s), failed %d", open, idle.count, elapsed,
+			 open / elapsed, idle.failed);
+	if (idle.failed > 0)
+		log_echo("last error: errno %d", idle.lastErrno);
+
+	sleep(ECHO_IDLE_SETTLE_S);
+	if (pid > 0)
+		rssAfter = echoIdleProcKb(szStatus, "VmRSS");
+	slabAfter = echoIdleProcKb("/proc/meminfo", "Slab");
+	if (rssBefore >= 0 && rssAfter >= 0 && open > 0)
+		log_echo("server pid %d: RSS %ld KB -> %ld KB, %.0f bytes per idle connection", pid, rssBefore, rssAfter,
+				 (rssAfter - rssBefore) * 1024.0 / open);
+	else
+		log_echo("No server counters of port %d on this host, the server RSS is not sampled", pConfig->port);
+	if (slabBefore >= 0 && slabAfter >= 0 && open > 0)
+		log_echo("kernel slab %ld KB -> %ld KB, %.0f bytes per connection (client and server socket)", slabBefore,
+				 slabAfter, (slabAfter - slabBefore) * 1024.0 / open);
+
+	sleep(pConfig->duration);
+	echoIdleRound(&idle, 0);
+	log_echo("after %d s: %d of %d connections still echo, failed %d", pConfig->duration, idle.echoed, open, idle.failed);
+
+	for (i = 0; i < idle.count; i++)
+	{
+		if (idle.states[i] != ECHO_IDLE_CLOSED)
+			close(idle.fds[i]);
+	}
+	close(idle.epfd);
+	free(idle.fds);
+	free(idle.states);
+
+	return open == idle.count && idle.echoed == open ? ECHO_OK : ECHO_FAIL;
+}
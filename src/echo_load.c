@@ -0,0 +1,726 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "echo_main.h"
+#include "echo_load.h"
+#include "echo_shm.h"
+#include "echo_tls.h"
+
+/*The pattern holds as many whole requests as fit in the receive buffer,
+  so one send() may carry several requests and offsets wrap at patLen*/
+static unsigned int echoLoadPatternLen(echoLoadThread *pThread)
+{
+	unsigned int size = pThread->pClient->config.size;
+
+	return size * (size < ECHO_LOAD_RECV_BUFSIZE ? ECHO_LOAD_RECV_BUFSIZE / size : 1);
+}
+
+/*The connection is open: a socket or a shared-memory channel*/
+static int echoLoadConnUp(echoLoadConn *pConn)
+{
+	return pConn->fd >= 0 || pConn->pShm != NULL;
+}
+
+/*Open (or re-open) one connection with echoClientOpen() and register it*/
+static ECHO_STATUS echoLoadConnOpen(echoLoadThread *pThread, echoLoadConn *pConn)
+{
+	echoClientGlobal_t client = *pThread->pClient;
+	struct epoll_event ev;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	pConn->fd = -1;
+	pConn->pendingBytes = 0;
+	pConn->txOff = 0;
+	pConn->rxOff = 0;
+	pConn->wantOut = 0;
+	pConn->head = 0;
+	pConn->inflight = 0;
+
+	if (ECHO_OK != (iRet = echoClientOpen(&client)))
+		return iRet;
+
+	/*a channel is not a descriptor, the shm worker polls it*/
+	if (client.protocol == ECHO_PROTO_SHM)
+	{
+		pConn->pShm = client.pShm;
+		return ECHO_OK;
+	}
+
+	/*the TLS handshake is done, the session works on the non-blocking socket*/
+	pConn->pTls = client.pTls;
+	fcntl(client.sockfd, F_SETFL, O_NONBLOCK);
+	/*pipelined requests must not wait for the ACK of the previous one*/
+	if (client.protocol == IPPROTO_TCP && client.servAddr.sa.sa_family == AF_INET)
+		setsockopt(client.sockfd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+	bzero(&ev, sizeof ev);
+	ev.events = EPOLLIN;
+	ev.data.ptr = pConn;
+	if (epoll_ctl(pThread->epfd, EPOLL_CTL_ADD, client.sockfd, &ev) < 0)
+	{
+		log_echo("epoll_ctl(ADD) fd %d failed errno %d", client.sockfd, errno);
+		echoClientClose(&client);
+		pConn->pTls = NULL;
+		return ECHO_FAIL;
+	}
+
+	pConn->fd = client.sockfd;
+	return ECHO_OK;
+}
+
+static void echoLoadConnClose(echoLoadConn *pConn)
+{
+	echoTlsFree(pConn->pTls, 1);
+	if (pConn->fd >= 0)
+		close(pConn->fd);
+	if (pConn->pShm)
+		echoShmClose(pConn->pShm);
+	pConn->fd = -1;
+	pConn->pShm = NULL;
+	pConn->pTls = NULL;
+	pConn->inflight = 0;
+}
+
+/*Arm EPOLLOUT while a TCP socket is full, disarm it once it took everything*/
+static void echoLoadWantOut(echoLoadThread *pThread, echoLoadConn *pConn, int wantOut)
+{
+	struct epoll_event ev;
+
+	if (pConn->wantOut == wantOut)
+		return;
+
+	bzero(&ev, sizeof ev);
+	ev.events = EPOLLIN | (wantOut ? EPOLLOUT : 0);
+	ev.data.ptr = pConn;
+	epoll_ctl(pThread->epfd, EPOLL_CTL_MOD, pConn->fd, &ev);
+	pConn->wantOut = wantOut;
+}
+
+/*Write the issued TCP requests; returns ECHO_FAIL on a broken connection*/
+static ECHO_STATUS echoLoadFlush(echoLoadThread *pThread, echoLoadConn *pConn)
+{
+	unsigned int patLen = echoLoadPatternLen(pThread);
+	unsigned long len = 0;
+	ssize_t numBytesSent = 0;
+
+	while (pConn->pendingBytes > 0)
+	{
+		len = patLen - pConn->txOff;
+		if (len > pConn->pendingBytes)
+			len = pConn->pendingBytes;
+
+		/*a write the session has to retry gets the same bytes again, or more*/
+		numBytesSent = echoTlsSend(pConn->pTls, pConn->fd, pThread->pattern + pConn->txOff, len);
+		if (numBytesSent < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return ECHO_FAIL;
+
+			echoLoadWantOut(pThread, pConn, 1);
+			return ECHO_OK;
+		}
+
+		pConn->txOff = (pConn->txOff + numBytesSent) % patLen;
+		pConn->pendingBytes -= numBytesSent;
+	}
+
+	echoLoadWantOut(pThread, pConn, 0);
+	return ECHO_OK;
+}
+
+/*Put a request in flight; sent is the time its latency is measured from*/
+static ECHO_STATUS echoLoadIssue(echoLoadThread *pThread, echoLoadConn *pConn, unsigned long long sent)
+{
+	echoClientConfig *pConfig = &pThread->pClient->config;
+
+	if (pConn->inflight == pThread->slots)
+	{
+		pThread->stats.missed++;
+		return ECHO_FAIL;
+	}
+
+	pConn->issued[(pConn->head + pConn->inflight) % pThread->slots] = sent;
+	pConn->inflight++;
+	pThread->stats.sent++;
+
+	if (pThread->pClient->protocol == IPPROTO_TCP)
+	{
+		pConn->pendingBytes += pConfig->size;
+		return ECHO_OK;
+	}
+
+	/*nothing is lost in shared memory: a full ring is a missed send*/
+	if (pThread->pClient->protocol == ECHO_PROTO_SHM)
+	{
+		if (ECHO_OK == echoShmSend(pConn->pShm, pThread->pattern, pConfig->size))
+			return ECHO_OK;
+		pConn->inflight--;
+		pThread->stats.sent--;
+		pThread->stats.missed++;
+		return ECHO_FAIL;
+	}
+
+	/*a datagram that can not be sent now is lost, it will time out*/
+	if (send(pConn->fd, pThread->pattern, pConfig->size, 0) < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+	{
+		pConn->inflight--;
+		pThread->stats.sent--;
+		pThread->stats.errors++;
+		return ECHO_FAIL;
+	}
+
+	return ECHO_OK;
+}
+
+/*The oldest request got its echo; a closed loop issues the next one
+  right away until the test time is over*/
+static void echoLoadComplete(echoLoadThread *pThread, echoLoadConn *pConn, unsigned long long now)
+{
+	echoClientConfig *pConfig = &pThread->pClient->config;
+
+	pThread->stats.requests++;
+	pThread->stats.bytes += pConfig->size;
+	echoHistRecord(&pThread->latency, now - pConn->issued[pConn->head]);
+	pConn->head = (pConn->head + 1) % pThread->slots;
+	pConn->inflight--;
+
+	if (pConfig->rate == 0 && now < pThread->endNs)
+		echoLoadIssue(pThread, pConn, now);
+}
+
+/*Closed loop: fill the connection with depth requests*/
+static void echoLoadStartConn(echoLoadThread *pThread, echoLoadConn *pConn, unsigned long long now)
+{
+	int i = 0;
+
+	if (pThread->pClient->config.rate > 0)
+		return;
+
+	for (i = 0; i < pThread->pClient->config.depth; i++)
+		echoLoadIssue(pThread, pConn, now);
+
+	if (pThread->pClient->protocol == IPPROTO_TCP && ECHO_OK != echoLoadFlush(pThread, pConn))
+	{
+		pThread->stats.errors++;
+		echoLoadConnClose(pConn);
+	}
+}
+
+/*Receive and verify TCP echoes; the stream is the pattern over and over*/
+static ECHO_STATUS echoLoadTcpRecv(echoLoadThread *pThread, echoLoadConn *pConn)
+{
+	unsigned int size = pThread->pClient->config.size;
+	unsigned int patLen = echoLoadPatternLen(pThread);
+	unsigned long long now = 0;
+	unsigned int done = 0;
+	unsigned int chunk = 0;
+	int numBytesRecv = 0;
+	int completed = 0;
+
+	while (1)
+	{
+		numBytesRecv = echoTlsRecv(pConn->pTls, pConn->fd, pThread->recvBuffer, ECHO_LOAD_RECV_BUFSIZE);
+		if (numBytesRecv == 0)
+			return ECHO_FAIL;
+
+		if (numBytesRecv < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? ECHO_OK : ECHO_FAIL;
+		}
+
+		completed = (pConn->rxOff % size + numBytesRecv) / size;
+		if (completed > pConn->inflight)
+			return ECHO_FAIL;
+
+		for (done = 0; done < (unsigned int)numBytesRecv; done += chunk)
+		{
+			chunk = patLen - pConn->rxOff;
+			if (chunk > numBytesRecv - done)
+				chunk = numBytesRecv - done;
+
+			if (0 != memcmp(pThread->recvBuffer + done, pThread->pattern + pConn->rxOff, chunk))
+				return ECHO_FAIL;
+			pConn->rxOff = (pConn->rxOff + chunk) % patLen;
+		}
+
+		now = echoClientNowNs();
+		while (completed-- > 0)
+			echoLoadComplete(pThread, pConn, now);
+
+		if (ECHO_OK != echoLoadFlush(pThread, pConn))
+			return ECHO_FAIL;
+	}
+}
+
+/*Receive and verify UDP echoes; an echo arriving after its request timed
+  out finds nothing in flight and is ignored*/
+static void echoLoadUdpRecv(echoLoadThread *pThread, echoLoadConn *pConn)
+{
+	unsigned int size = pThread->pClient->config.size;
+	int numBytesRecv = 0;
+
+	while (1)
+	{
+		numBytesRecv = recv(pConn->fd, pThread->recvBuffer, ECHO_LOAD_RECV_BUFSIZE, 0);
+		if (numBytesRecv < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			/*ECONNREFUSED - nobody listens, the requests will time out*/
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				pThread->stats.errors++;
+			return;
+		}
+
+		if (numBytesRecv != size || 0 != memcmp(pThread->recvBuffer, pThread->pattern, size))
+		{
+			pThread->stats.errors++;
+			continue;
+		}
+
+		if (pConn->inflight > 0)
+			echoLoadComplete(pThread, pConn, echoClientNowNs());
+	}
+}
+
+/*Receive and verify the echoes waiting on a shared-memory channel*/
+static void echoLoadShmRecv(echoLoadThread *pThread, echoLoadConn *pConn)
+{
+	unsigned int size = pThread->pClient->config.size;
+	int numBytesRecv = 0;
+
+	while ((numBytesRecv = echoShmRecv(pConn->pShm, pThread->recvBuffer, ECHO_LOAD_RECV_BUFSIZE)) > 0)
+	{
+		if (numBytesRecv != size || 0 != memcmp(pThread->recvBuffer, pThread->pattern, size) || pConn->inflight == 0)
+		{
+			pThread->stats.errors++;
+			continue;
+		}
+
+		echoLoadComplete(pThread, pConn, echoClientNowNs());
+	}
+}
+
+/*A TCP (or shm) connection with a late echo is re-opened - the stream
+  can not skip a request; a lost UDP request is replaced by a new one*/
+static void echoLoadCheckTimeouts(echoLoadThread *pThread, unsigned long long now)
+{
+	echoClientConfig *pConfig = &pThread->pClient->config;
+	unsigned long long timeoutNs = (unsigned long long)pConfig->timeoutMs * 1000000ULL;
+	echoLoadConn *pConn = NULL;
+	int i = 0;
+
+	for (i = 0; i < pConfig->connections; i++)
+	{
+		pConn = &pThread->conns[i];
+
+		if (!echoLoadConnUp(pConn))
+		{
+			/*a connection that broke is replaced*/
+			if (now < pThread->endNs && ECHO_OK == echoLoadConnOpen(pThread, pConn))
+				echoLoadStartConn(pThread, pConn, now);
+			continue;
+		}
+
+		while (pConn->inflight > 0 && now - pConn->issued[pConn->head] > timeoutNs)
+		{
+			pThread->stats.timeouts++;
+
+			if (pThread->pClient->protocol != IPPROTO_UDP)
+			{
+				echoLoadConnClose(pConn);
+				break;
+			}
+
+			pConn->head = (pConn->head + 1) % pThread->slots;
+			pConn->inflight--;
+			if (pConfig->rate == 0 && now < pThread->endNs)
+				echoLoadIssue(pThread, pConn, now);
+		}
+	}
+}
+
+/*Open loop: send every request that is due. The schedule never waits for
+  echoes and a request's latency counts from when it was due, so a server
+  stall shows up as latency of every request it delayed instead of as
+  fewer requests sent (coordinated omission)*/
+static void echoLoadPace(echoLoadThread *pThread, unsigned long long now)
+{
+	echoLoadConn *pConn = NULL;
+
+	while (pThread->nextNs <= now && pThread->nextNs < pThread->endNs)
+	{
+		pConn = &pThread->conns[pThread->nextConn];
+		pThread->nextConn = (pThread->nextConn + 1) % pThread->pClient->config.connections;
+
+		if (!echoLoadConnUp(pConn))
+			pThread->stats.missed++;
+		else if (ECHO_OK == echoLoadIssue(pThread, pConn, pThread->nextNs) &&
+				 pThread->pClient->protocol == IPPROTO_TCP && ECHO_OK != echoLoadFlush(pThread, pConn))
+		{
+			pThread->stats.errors++;
+			echoLoadConnClose(pConn);
+		}
+
+		pThread->nextNs += pThread->intervalNs;
+	}
+}
+
+/*Requests still waiting for an echo*/
+static int echoLoadInflight(echoLoadThread *pThread)
+{
+	int inflight = 0;
+	int i = 0;
+
+	for (i = 0; i < pThread->pClient->config.connections; i++)
+		inflight += pThread->conns[i].inflight;
+
+	return inflight;
+}
+
+/*Event loop of a shm thread: its one channel has no descriptor to
+  wait in, so the thread waits on the echo ring (spinning for
+  --busy-poll us first) or sleeps until the next send is due*/
+static void echoLoadShmLoop(echoLoadThread *pThread, unsigned long long nextTick, unsigned long long drainNs)
+{
+	echoLoadConn *pConn = &pThread->conns[0];
+	struct timespec wake;
+	unsigned long long now = 0;
+	unsigned long long wakeNs = 0;
+
+	while ((now = echoClientNowNs()) < pThread->endNs || (now < drainNs && pConn->inflight > 0))
+	{
+		wakeNs = nextTick;
+		if (pThread->pClient->config.rate > 0)
+		{
+			echoLoadPace(pThread, now);
+			if (pThread->nextNs < wakeNs)
+				wakeNs = pThread->nextNs;
+		}
+
+		if (pConn->pShm && pConn->inflight > 0)
+		{
+			if (echoShmWait(pConn->pShm, wakeNs))
+				echoLoadShmRecv(pThread, pConn);
+		}
+		else
+		{
+			wake.tv_sec = wakeNs / 1000000000ULL;
+			wake.tv_nsec = wakeNs % 1000000000ULL;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);
+		}
+
+		now = echoClientNowNs();
+		if (now >= nextTick)
+		{
+			echoLoadCheckTimeouts(pThread, now);
+			nextTick = now + ECHO_LOAD_TICK_MS * 1000000ULL;
+		}
+	}
+}
+
+/************************************************************************
+* Function Name  : echoLoadWorker()
+* Description    : A function that will be executed by pthread; drives
+				   the connections of one load thread;
+* Input          : pThreadPar - the thread with its connections;
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Closed loop - every connection keeps depth requests
+				   in flight and sends the next one as soon as an echo
+				   arrives. Open loop (rate) - requests are sent when
+				   they are due, whatever the echoes do. Every echo is
+				   compared to what was sent; after the test time the
+				   requests in flight get up to timeout to complete;
+*************************************************************************/
+void *echoLoadWorker(void *pThreadPar)
+{
+	echoLoadThread *pThread = (echoLoadThread *)pThreadPar;
+	echoClientConfig *pConfig = &pThread->pClient->config;
+	struct epoll_event events[ECHO_LOAD_MAX_EVENTS];
+	struct timespec wait;
+	echoLoadConn *pConn = NULL;
+	unsigned long long now = echoClientNowNs();
+	unsigned long long nextTick = now + ECHO_LOAD_TICK_MS * 1000000ULL;
+	unsigned long long drainNs = pThread->endNs + (unsigned long long)pConfig->timeoutMs * 1000000ULL;
+	unsigned long long wakeNs = 0;
+	int nEvents = 0;
+	int i = 0;
+	static ECHO_STATUS ret;
+
+	for (i = 0; i < pConfig->connections; i++)
+	{
+		if (echoLoadConnUp(&pThread->conns[i]))
+			echoLoadStartConn(pThread, &pThread->conns[i], now);
+	}
+
+	if (pThread->pClient->protocol == ECHO_PROTO_SHM)
+		echoLoadShmLoop(pThread, nextTick, drainNs);
+
+	while (pThread->pClient->protocol != ECHO_PROTO_SHM &&
+		   ((now = echoClientNowNs()) < pThread->endNs || (now < drainNs && echoLoadInflight(pThread) > 0)))
+	{
+		wakeNs = nextTick;
+		if (pConfig->rate > 0)
+		{
+			echoLoadPace(pThread, now);
+			if (pThread->nextNs < wakeNs)
+				wakeNs = pThread->nextNs;
+		}
+
+		/*nanosecond timeout, the schedule can not live with 1 ms steps*/
+		now = echoClientNowNs();
+		wait.tv_sec = 0;
+		wait.tv_nsec = wakeNs > now ? wakeNs - now : 0;
+		nEvents = epoll_pwait2(pThread->epfd, events, ECHO_LOAD_MAX_EVENTS, &wait, NULL);
+		if (nEvents < 0 && errno != EINTR)
+		{
+			log_echo("epoll_wait failed errno %d", errno);
+			break;
+		}
+
+		for (i = 0; i < nEvents; i++)
+		{
+			pConn = (echoLoadConn *)events[i].data.ptr;
+			if (pConn->fd < 0)
+				continue;
+
+			if (pThread->pClient->protocol == IPPROTO_UDP)
+			{
+				echoLoadUdpRecv(pThread, pConn);
+				continue;
+			}
+
+			if ((events[i].events & EPOLLOUT) && ECHO_OK != echoLoadFlush(pThread, pConn))
+			{
+				pThread->stats.errors++;
+				echoLoadConnClose(pConn);
+				continue;
+			}
+
+			if ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && ECHO_OK != echoLoadTcpRecv(pThread, pConn))
+			{
+				pThread->stats.errors++;
+				echoLoadConnClose(pConn);
+			}
+		}
+
+		now = echoClientNowNs();
+		if (now >= nextTick)
+		{
+			echoLoadCheckTimeouts(pThread, now);
+			nextTick = now + ECHO_LOAD_TICK_MS * 1000000ULL;
+		}
+	}
+
+	for (i = 0; i < pConfig->connections; i++)
+		echoLoadConnClose(&pThread->conns[i]);
+
+	ret = ECHO_OK;
+	pthread_exit(&ret);
+}
+
+/*Allocate the buffers of one load thread and open its connections*/
+static ECHO_STATUS echoLoadThreadInit(echoLoadThread *pThread, echoClientGlobal_t *pClient, int id)
+{
+	echoClientConfig *pConfig = &pClient->config;
+	unsigned int patLen = 0;
+	unsigned int i = 0;
+	int c = 0;
+
+	bzero(pThread, sizeof(echoLoadThread));
+	pThread->id = id;
+	pThread->pClient = pClient;
+	pThread->slots = pConfig->rate > 0 ? ECHO_LOAD_OPEN_SLOTS : pConfig->depth;
+	echoHistInit(&pThread->latency);
+	patLen = echoLoadPatternLen(pThread);
+
+	if ((pThread->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return ECHO_FAIL;
+
+	pThread->conns = calloc(pConfig->connections, sizeof(echoLoadConn));
+	pThread->pattern = malloc(patLen);
+	pThread->recvBuffer = malloc(ECHO_LOAD_RECV_BUFSIZE);
+	if (!pThread->conns || !pThread->pattern || !pThread->recvBuffer)
+		return ECHO_NO_MEM_ERR;
+
+	/*printable and not repeating within a request, so a shifted or
+	  mixed up echo does not pass the check*/
+	for (i = 0; i < patLen; i++)
+		pThread->pattern[i] = 'a' + (i % pConfig->size) % 26;
+
+	for (c = 0; c < pConfig->connections; c++)
+	{
+		pThread->conns[c].fd = -1;
+		if (NULL == (pThread->conns[c].issued = calloc(pThread->slots, sizeof(unsigned long long))))
+			return ECHO_NO_MEM_ERR;
+	}
+
+	/*connections are opened before the test time starts, so thousands of
+	  handshakes do not eat into the measurement*/
+	for (c = 0; c < pConfig->connections; c++)
+	{
+		if (ECHO_OK != echoLoadConnOpen(pThread, &pThread->conns[c]))
+			pThread->stats.errors++;
+	}
+
+	return ECHO_OK;
+}
+
+/*Append the results as one CSV row, with a header when the file is new*/
+static void echoLoadCsv(echoClientGlobal_t *pClient, echoLoadStats *pTotal, echoHist *pLatency, double elapsed)
+{
+	echoClientConfig *pConfig = &pClient->config;
+	FILE *pFile = NULL;
+
+	if (NULL == (pFile = fopen(pConfig->output, "a")))
+	{
+		log_echo("Could not open %s errno %d", pConfig->output, errno);
+		return;
+	}
+
+	if (ftell(pFile) == 0)
+		fprintf(pFile, "proto,size,threads,connections,depth,rate,duration_s,requests,requests_per_s,mb_per_s,"
+					   "errors,timeouts,p50_us,p90_us,p99_us,p999_us,max_us\n");
+
+	fprintf(pFile, "%s,%d,%d,%d,%d,%d,%d,%lu,%.0f,%.2f,%lu,%lu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+			echoClientProtoName(pClient), pConfig->size, pConfig->threads, pConfig->connections,
+			pConfig->depth, pConfig->rate, pConfig->duration, pTotal->requests, pTotal->requests / elapsed,
+			pTotal->bytes / elapsed / 1e6, pTotal->errors, pTotal->timeouts, echoHistPercentile(pLatency, 50) / 1e3,
+			echoHistPercentile(pLatency, 90) / 1e3, echoHistPercentile(pLatency, 99) / 1e3,
+			echoHistPercentile(pLatency, 99.9) / 1e3, pLatency->max / 1e3);
+	fclose(pFile);
+}
+
+/***********************************************************************
+* Function Name  : echoLoadStart()
+* Description    : Load generator mode of the echo client
+* Input          : arg_values - <ip> <protocol>
+				   pConfig - threads, connections per thread, duration,
+				   payload size, requests in flight, timeout and the
+				   optional CSV output file
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Start the load threads, wait for them and report the
+				   aggregate requests/s, bytes/s, errors and timeouts;
+************************************************************************/
+ECHO_STATUS echoLoadStart(char **arg_values, echoClientConfig *pConfig)
+{
+	echoClientGlobal_t *pClient = NULL;
+	echoLoadThread *pThreads = NULL;
+	echoLoadStats total;
+	echoHist latency;
+	pthread_attr_t attr;
+	unsigned long long start = 0;
+	double elapsed = 0;
+	int started = 0;
+	int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (ECHO_OK != (iRet = echoClientGlobalInit(&pClient)))
+		return iRet;
+
+	pClient->config = *pConfig;
+	if (ECHO_OK != (iRet = echoClientSetServer(pClient, arg_values[0], arg_values[1])))
+	{
+		log_echo("%s", arrErrors[iRet]);
+		return iRet;
+	}
+
+	if (pConfig->threads < 1 || pConfig->threads > ECHO_LOAD_MAX_THREADS || pConfig->connections < 1 ||
+		pConfig->duration < 1 || pConfig->size < 1 || pConfig->size > ECHO_LOAD_MAX_SIZE(pClient->protocol) ||
+		pConfig->depth < 1 || pConfig->timeoutMs < 1 || pConfig->rate < 0 ||
+		(pClient->protocol == ECHO_PROTO_SHM && (pConfig->connections != 1 || pConfig->size > ECHO_SHM_MAX_MSG)))
+	{
+		log_echo("%s", arrErrors[ECHO_BAD_PARAM]);
+		return ECHO_BAD_PARAM;
+	}
+
+	if (NULL == (pThreads = calloc(pConfig->threads, sizeof(echoLoadThread))))
+		return ECHO_NO_MEM_ERR;
+
+	for (i = 0; i < pConfig->threads; i++)
+	{
+		/*the connections and buffers of a pinned thread go to the NUMA node of its CPU*/
+		if (pConfig->cpus.count > 0)
+			echoAffinityMemPrefer(echoAffinityCpuNode(echoAffinityCpu(&pConfig->cpus, i)));
+		if (ECHO_OK != (iRet = echoLoadThreadInit(&pThreads[i], pClient, i)))
+		{
+			log_echo("Could not prepare load thread %d - %s", i, arrErrors[iRet]);
+			return iRet;
+		}
+	}
+
+	if (pConfig->cpus.count > 0)
+		echoAffinityMemPrefer(-1);
+
+	if (pConfig->rate > 0)
+		log_echo("Load: %d thread(s) x %d connection(s), %s, %d byte requests, open loop at %d requests/s, %d s",
+				 pConfig->threads, pConfig->connections, echoClientProtoName(pClient),
+				 pConfig->size, pConfig->rate, pConfig->duration);
+	else
+		log_echo("Load: %d thread(s) x %d connection(s), %s, %d byte requests, %d in flight, %d s",
+				 pConfig->threads, pConfig->connections, echoClientProtoName(pClient),
+				 pConfig->size, pConfig->depth, pConfig->duration);
+
+	start = echoClientNowNs();
+	for (started = 0; started < pConfig->threads; started++)
+	{
+		pThreads[started].endNs = start + (unsigned long long)pConfig->duration * 1000000000ULL;
+		/*every thread sends rate / threads requests/s, the threads' schedules interleave*/
+		if (pConfig->rate > 0)
+		{
+			pThreads[started].intervalNs = 1000000000ULL * pConfig->threads / pConfig->rate;
+			pThreads[started].nextNs = start + pThreads[started].intervalNs * started / pConfig->threads;
+		}
+		if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pConfig->cpus, started)))
+			break;
+		if (pthread_create(&pThreads[started].threadId, &attr, echoLoadWorker, (void*)&pThreads[started]) != 0)
+			iRet = ECHO_PTHREAD_ERR;
+		pthread_attr_destroy(&attr);
+		if (ECHO_OK != iRet)
+		{
+			perror("could not create thread - echoLoadWorker!");
+			break;
+		}
+	}
+
+	bzero(&total, sizeof total);
+	echoHistInit(&latency);
+	for (i = 0; i < started; i++)
+	{
+		pthread_join(pThreads[i].threadId, NULL);
+		total.sent += pThreads[i].stats.sent;
+		total.missed += pThreads[i].stats.missed;
+		total.requests += pThreads[i].stats.requests;
+		total.bytes += pThreads[i].stats.bytes;
+		total.errors += pThreads[i].stats.errors;
+		total.timeouts += pThreads[i].stats.timeouts;
+		echoHistMerge(&latency, &pThreads[i].latency);
+	}
+	/*echoes of the drain after the test time belong to requests sent within it*/
+	elapsed = pConfig->duration;
+
+	log_echo("requests %lu, %.0f requests/s, %.2f MB/s echoed, errors %lu, timeouts %lu",
+			 total.requests, total.requests / elapsed, total.bytes / elapsed / 1e6, total.errors, total.timeouts);
+	if (pConfig->rate > 0)
+		log_echo("sent %.0f of %d requests/s, missed %lu", total.sent / elapsed, pConfig->rate, total.missed);
+	echoHistPrint(&latency, pConfig->rate > 0 ? "latency from the scheduled send" : "latency");
+	echoTlsClientReport();
+	if (pConfig->output)
+		echoLoadCsv(pClient, &total, &latency, elapsed);
+
+	return iRet;
+}
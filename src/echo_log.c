@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+
+/*One formatted message*/
+typedef struct echoLogRecord_t
+{
+	unsigned long long timeNs; /*CLOCK_REALTIME*/
+	int level;
+	int len;
+	char text[ECHO_LOG_RECORD_TEXT];
+}echoLogRecord;
+
+/*Single-producer single-consumer ring of one thread: the thread moves
+  head, the writer moves tail. A thread that exits hands its ring back
+  (inUse = 0) and the next new thread takes it over once it is drained*/
+typedef struct echoLogRing_t
+{
+	unsigned long head __attribute__((aligned(ECHO_CACHE_LINE)));
+	unsigned long dropped; /*messages lost because the ring was full*/
+	int tid;
+	unsigned long tail __attribute__((aligned(ECHO_CACHE_LINE)));
+	unsigned long droppedReported;
+	int inUse;
+	struct echoLogRing_t *next; /*list of every ring, never shrinks*/
+	echoLogRecord records[ECHO_LOG_RING_RECORDS];
+}echoLogRing;
+
+int echoLogLevel = ECHO_LOG_LEVEL_DEFAULT;
+
+static const char *arrLogLevels[] = {"ERR", "WARN", "INFO", "DEBUG"};
+static echoLogRing *pLogRings = NULL;
+static int logFd = -1; /*>= 0 while the writer runs*/
+static pthread_key_t logRingKey;
+static pthread_mutex_t logDrainLock = PTHREAD_MUTEX_INITIALIZER;
+static __thread echoLogRing *pThreadRing = NULL;
+
+/*Parse "err", "warn", "info" or "debug"; -1 if unknown*/
+int echoLogLevelParse(const char *szLevel)
+{
+	int i = 0;
+
+	for (i = ECHO_LOG_ERR; i <= ECHO_LOG_DEBUG; i++)
+	{
+		if (0 == strcasecmp(szLevel, arrLogLevels[i]))
+			return i;
+	}
+
+	return -1;
+}
+
+/*Thread exit - the ring is free again, whatever it holds is still written*/
+static void echoLogRingRelease(void *pRing)
+{
+	__atomic_store_n(&((echoLogRing *)pRing)->inUse, 0, __ATOMIC_RELEASE);
+}
+
+/*Ring of the calling thread; taken on its first message, so threads that
+  never log do not get one*/
+static echoLogRing *echoLogRingGet(void)
+{
+	echoLogRing *pRing = NULL;
+	int expected = 0;
+
+	if (pThreadRing)
+		return pThreadRing;
+
+	for (pRing = __atomic_load_n(&pLogRings, __ATOMIC_ACQUIRE); pRing; pRing = pRing->next)
+	{
+		expected = 0;
+		if (__atomic_load_n(&pRing->tail, __ATOMIC_ACQUIRE) == pRing->head &&
+			__atomic_compare_exchange_n(&pRing->inUse, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			break;
+	}
+
+	if (pRing == NULL)
+	{
+		if (NULL == (pRing = calloc(1, sizeof(echoLogRing))))
+			return NULL;
+		pRing->inUse = 1;
+
+		/*push - a concurrent push makes the exchange fail and retry*/
+		pRing->next = __atomic_load_n(&pLogRings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&pLogRings, &pRing->next, pRing, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	pRing->tid = syscall(SYS_gettid);
+	pthread_setspecific(logRingKey, pRing);
+	pThreadRing = pRing;
+	return pRing;
+}
+
+/***********************************************************************
+* Function Name  : echoLogWrite()
+* Description    : Queue one message of the calling thread
+* Input          : level - ECHO_LOG_*
+				   szFormat - printf() format and its arguments
+* Logic          : The message is formatted straight into the next free
+				   record of the thread's ring; the thread never waits
+				   for the writer and never takes a lock. When the ring
+				   is full the message is counted as dropped. Before the
+				   writer is started and after echoLogStop() messages go
+				   to stderr at once;
+************************************************************************/
+void echoLogWrite(int level, const char *szFormat, ...)
+{
+	echoLogRing *pRing = NULL;
+	echoLogRecord *pRecord = NULL;
+	struct timespec ts;
+	va_list args;
+	int len = 0;
+
+	va_start(args, szFormat);
+
+	if (__atomic_load_n(&logFd, __ATOMIC_ACQUIRE) < 0 || NULL == (pRing = echoLogRingGet()))
+	{
+		vfprintf(stderr, szFormat, args);
+		va_end(args);
+		return;
+	}
+
+	if (pRing->head - __atomic_load_n(&pRing->tail, __ATOMIC_ACQUIRE) >= ECHO_LOG_RING_RECORDS)
+	{
+		__atomic_store_n(&pRing->dropped, pRing->dropped + 1, __ATOMIC_RELAXED);
+		va_end(args);
+		return;
+	}
+
+	pRecord = &pRing->records[pRing->head & (ECHO_LOG_RING_RECORDS - 1)];
+	clock_gettime(CLOCK_REALTIME, &ts);
+	pRecord->timeNs = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	pRecord->level = level;
+	len = vsnprintf(pRecord->text, sizeof pRecord->text, szFormat, args);
+	pRecord->len = len < (int)sizeof pRecord->text ? len : (int)sizeof pRecord->text - 1;
+	va_end(args);
+
+	/*the record is complete before the writer can see it*/
+	__atomic_store_n(&pRing->head, pRing->head + 1, __ATOMIC_RELEASE);
+}
+
+/*Append "<time> <level> [tid] message\n" to the output buffer; the
+  line breaks and padding of the log_echo() formats are trimmed*/
+static int echoLogFormat(char *pOut, int room, echoLogRing *pRing, echoLogRecord *pRecord)
+{
+	struct tm tm;
+	time_t sec = pRecord->timeNs / 1000000000ULL;
+	char *pText = pRecord->text;
+	int len = pRecord->len;
+
+	while (len > 0 && (*pText == ' ' || *pText == '\n' || *pText == '\r'))
+	{
+		pText++;
+		len--;
+	}
+	while (len > 0 && (pText[len - 1] == ' ' || pText[len - 1] == '\n' || pText[len - 1] == '\r'))
+		len--;
+
+	gmtime_r(&sec, &tm);
+	len = snprintf(pOut, room, "%04d-%02d-%02dT%02d:%02d:%02d.%06lluZ %-5s [%d] %.*s\n", tm.tm_year + 1900,
+				   tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, pRecord->timeNs % 1000000000ULL / 1000,
+				   arrLogLevels[pRecord->level], pRing->tid, len, pText);
+
+	return len < room ? len : room - 1;
+}
+
+/*Write the whole buffer, the log file may take it in pieces*/
+static void echoLogFlush(int fd, char *pBuf, int len)
+{
+	int done = 0;
+	int n = 0;
+
+	for (done = 0; done < len; done += n)
+	{
+		n = write(fd, pBuf + done, len - done);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				n = 0;
+				continue;
+			}
+			return;
+		}
+	}
+}
+
+/*One pass over the rings of all threads: format what they queued and
+  write it to fd; 1 if there was anything. The writer and echoLogStop()
+  both drain, the lock keeps them from taking the same records*/
+static int echoLogDrain(int fd)
+{
+	static char buf[64 * 1024];
+	echoLogRing *pRing = NULL;
+	echoLogRecord note;
+	struct timespec ts;
+	unsigned long head = 0;
+	unsigned long tail = 0;
+	unsigned long dropped = 0;
+	int len = 0;
+	int busy = 0;
+
+	for (pRing = __atomic_load_n(&pLogRings, __ATOMIC_ACQUIRE); pRing; pRing = pRing->next)
+	{
+		head = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+		for (tail = pRing->tail; tail != head; tail++)
+		{
+			if (sizeof buf - len < ECHO_LOG_RECORD_TEXT + 64)
+			{
+				echoLogFlush(fd, buf, len);
+				len = 0;
+			}
+			len += echoLogFormat(buf + len, sizeof buf - len, pRing, &pRing->records[tail & (ECHO_LOG_RING_RECORDS - 1)]);
+
+			/*the thread may reuse the record from now on*/
+			__atomic_store_n(&pRing->tail, tail + 1, __ATOMIC_RELEASE);
+			busy = 1;
+		}
+
+		dropped = __atomic_load_n(&pRing->dropped, __ATOMIC_RELAXED);
+		if (dropped != pRing->droppedReported)
+		{
+			if (sizeof buf - len < ECHO_LOG_RECORD_TEXT + 64)
+			{
+				echoLogFlush(fd, buf, len);
+				len = 0;
+			}
+			clock_gettime(CLOCK_REALTIME, &ts);
+			note.timeNs = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+			note.level = ECHO_LOG_WARN;
+			note.len = snprintf(note.text, sizeof note.text, "%lu log message(s) dropped, the log ring was full",
+								dropped - pRing->droppedReported);
+			len += echoLogFormat(buf + len, sizeof buf - len, pRing, &note);
+			pRing->droppedReported = dropped;
+		}
+	}
+
+	if (len > 0)
+		echoLogFlush(fd, buf, len);
+
+	return busy;
+}
+
+/************************************************************************
+* Function Name  : echoLogWriter()
+* Description    : A function that will be executed by pthread; drains
+				   the rings of all threads into the log file
+* Logic          : Records are formatted into one buffer and written
+				   with as few write() calls as possible; drops are
+				   reported once per ring and pass. With nothing to do
+				   the writer sleeps ECHO_LOG_FLUSH_MS. It ends once
+				   echoLogStop() took over;
+*************************************************************************/
+static void *echoLogWriter(void *pArg)
+{
+	struct timespec idle = {0, ECHO_LOG_FLUSH_MS * 1000000L};
+	int busy = 0;
+	int fd = -1;
+
+	while (1)
+	{
+		pthread_mutex_lock(&logDrainLock);
+		if ((fd = __atomic_load_n(&logFd, __ATOMIC_ACQUIRE)) < 0)
+		{
+			pthread_mutex_unlock(&logDrainLock);
+			break;
+		}
+		busy = echoLogDrain(fd);
+		pthread_mutex_unlock(&logDrainLock);
+
+		if (!busy)
+			nanosleep(&idle, NULL);
+	}
+
+	return NULL;
+}
+
+/***********************************************************************
+* Function Name  : echoLogStop()
+* Description    : Write everything still queued and stop queueing
+* Logic          : Runs at exit (atexit) and before the server returns
+				   an error, so the last messages - usually why it
+				   failed - are not lost with the writer thread. Queueing
+				   stops first, so that messages logged meanwhile go to
+				   stderr at once, then the calling thread drains the
+				   rings. Safe to call more than once;
+************************************************************************/
+void echoLogStop(void)
+{
+	int fd = -1;
+
+	pthread_mutex_lock(&logDrainLock);
+	if ((fd = __atomic_exchange_n(&logFd, -1, __ATOMIC_ACQ_REL)) >= 0)
+		echoLogDrain(fd);
+	pthread_mutex_unlock(&logDrainLock);
+}
+
+/***********************************************************************
+* Function Name  : echoLogStart()
+* Description    : Start the asynchronous writer
+* Input          : szPath - log file, appended to; NULL - stderr
+* Return         : ECHO_STATUS to indicate error/success
+************************************************************************/
+ECHO_STATUS echoLogStart(const char *szPath)
+{
+	pthread_t threadId;
+	int fd = STDERR_FILENO;
+
+	if (szPath && (fd = open(szPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0)
+	{
+		log_echo_err("Could not open log file %s errno %d", szPath, errno);
+		return ECHO_FAIL;
+	}
+
+	if (pthread_key_create(&logRingKey, echoLogRingRelease) != 0)
+		return ECHO_PTHREAD_ERR;
+
+	/*from now on messages are queued*/
+	__atomic_store_n(&logFd, fd, __ATOMIC_RELEASE);
+	if (pthread_create(&threadId, NULL, echoLogWriter, NULL) != 0)
+	{
+		__atomic_store_n(&logFd, -1, __ATOMIC_RELEASE);
+		return ECHO_PTHREAD_ERR;
+	}
+	pthread_detach(threadId);
+	atexit(echoLogStop);
+
+	return ECHO_OK;
+}
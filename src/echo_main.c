@@ -13,12 +13,36 @@
 #include <sys/reboot.h>
 #include <dlfcn.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <getopt.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include "echo_main.h"
+#include "echo_epoll.h"
+#include "echo_uring.h"
+#include "echo_pool.h"
+#include "echo_load.h"
+#include "echo_ping.h"
+#include "echo_stats.h"
+#include "echo_reflect.h"
+#include "echo_churn.h"
+#include "echo_stream.h"
+#include "echo_zerocopy.h"
+#include "echo_idle.h"
+#include "echo_busypoll.h"
+#include "echo_xdp.h"
+#include "echo_shm.h"
+#include "echo_tls.h"
 
 /* pointer to global struct */
 EchoGlobal_t *pGlobal = NULL;
-pthread_mutex_t lock;
+/*buffers of the legacy model; the TCP pool is used by the listener and the
+  client thread it joins, the UDP pool by the UDP thread, so neither needs
+  a lock*/
+echoBufPool legacyTcpPool;
+echoBufPool legacyUdpPool;
 
 const char *arrErrors[] =
 {
@@ -44,67 +68,157 @@ const char *arrErrors[] =
 /*************************************************************************
 * Function Name  : echoServersStart()
 * Description    : Initilaize the global struct and start TCP/UDP servers
-* Input          : tcp_max_connection - max tcp clients count that could  
-				   be handled simultaneously
+* Input          : pConfig - server settings: max tcp clients count that
+				   could be handled simultaneously and the I/O model
 * Return         : ECHO_STATUS to indicate error/success
 **************************************************************************/
-ECHO_STATUS echoServersStart(int tcp_max_connection) 
+ECHO_STATUS echoServersStart(echoServerConfig *pConfig) 
 {
 	ECHO_STATUS iRet = 0;
+	int tcpBuffers = 0;
 	
-	/*Needed to synchronize the changes on iClientsCount
-    	between the different threads(clients)*/
-	if (pthread_mutex_init(&lock, NULL) != 0)
-    {
-        log_echo("Mutex init failed\n");
-        return ECHO_FAIL;
-    }
-    
-	iRet = echoGlobalInit (&pGlobal, tcp_max_connection);
+	iRet = echoGlobalInit (&pGlobal, pConfig);
 	if (ECHO_OK != iRet)
 	{
-		log_echo("Could not initialize globalInit - %s!", arrErrors[iRet]);
+		log_echo_err("Could not initialize globalInit - %s!", arrErrors[iRet]);
 		return iRet;
 	}
 	
+	echoFdLimit(pGlobal->echoServersData.tcpMaxConnections + ECHO_FD_RESERVE);
+	
+	/*the certificate is ready before any backend accepts a TLS client*/
+	if (pGlobal->config.tlsPort && ECHO_OK != (iRet = echoTlsServerInit(&pGlobal->config)))
+		return iRet;
+	
+	/*One reactor serves both protocols; the legacy model below starts
+	  a listener thread plus a thread per TCP client*/
+	if(pGlobal->config.ioMode == ECHO_IO_EPOLL || pGlobal->config.ioMode == ECHO_IO_URING)
+	{
+		/*the ring would need IORING_OP_SEND_ZC and its own notifications*/
+		if (pGlobal->config.ioMode == ECHO_IO_URING && pGlobal->config.zeroCopy)
+			log_echo_warn("--zerocopy is not supported by the io_uring backend, TCP echoes are copied");
+		
+		if(pGlobal->config.ioMode == ECHO_IO_URING)
+			iRet = echoUringServersStart(pGlobal);
+		else
+			iRet = echoEpollServersStart(pGlobal);
+		
+		if (ECHO_OK != iRet)
+			log_echo_err("Could not start echo servers - %s!", arrErrors[iRet]);
+		return iRet;
+	}
+	
+	/*two counter slots - the TCP listener with its client and the UDP thread,
+	  then the unix, shared-memory and AF_XDP threads. The listener joins
+	  every client thread before the next accept(), so one buffer serves
+	  all clients; with --zerocopy the client keeps buffers pinned while
+	  the kernel sends from them*/
+	tcpBuffers = pGlobal->config.zeroCopy ? ECHO_ZC_LEGACY_BUFFERS : 1;
+	iRet = echoStatsInit(&pGlobal->config, 2 + echoAuxSlots(&pGlobal->config));
+	if (ECHO_OK == iRet)
+		iRet = echoBufPoolInit(&legacyTcpPool, tcpBuffers, ECHO_CONFIG_BUFSIZE(&pGlobal->config, ECHO_BUFSIZE),
+							   pGlobal->config.hugePages);
+	if (ECHO_OK == iRet)
+		iRet = echoBufPoolInit(&legacyUdpPool, 1, ECHO_CONFIG_BUFSIZE(&pGlobal->config, ECHO_UDP_BUFSIZE), pGlobal->config.hugePages);
+	if (ECHO_OK != iRet)
+		return iRet;
+	
 	/* start echo servers */
 	if(pGlobal->echoServersData.tcpStatus)
 	{
 		iRet = echoServerStart(pGlobal, IPPROTO_TCP);
 		if (ECHO_OK != iRet)
 			{
-				log_echo("Could not start echo tcp server - %s! \n", arrErrors[iRet]);
+				log_echo_err("Could not start echo tcp server - %s! \n", arrErrors[iRet]);
 				return iRet;
 			}
 	}
 	else
 		log_echo("TCP server stopped ... ");
 	
+	/*before the UDP server - its thread is joined*/
+	if (ECHO_OK != (iRet = echoAuxServersStart(pGlobal, ECHO_STATS_SLOT_LEGACY_UDP + 1)))
+		return iRet;
+	
 	if(pGlobal->echoServersData.udpStatus)
 	{
 		iRet = echoServerStart(pGlobal, IPPROTO_UDP);
 		if (ECHO_OK != iRet)
 			{
-				log_echo("Could not start echo udp server - %s!", arrErrors[iRet]);
+				log_echo_err("Could not start echo udp server - %s!", arrErrors[iRet]);
 				return iRet;
 			}
 	}
 	else
 		log_echo("UDP server stopped ... ");
 	
-	
+	return ECHO_OK;
+}
+
+/*The epoll workers accept TLS clients themselves, the other backends
+  leave the TLS listener to the reactor of the unix sockets*/
+static int echoAuxReactor(echoServerConfig *pConfig)
+{
+	return pConfig->unixStream || pConfig->unixDgram || (pConfig->tlsPort && pConfig->ioMode != ECHO_IO_EPOLL);
+}
+
+/*Threads every backend runs next to its own: the unix socket (and TLS)
+  reactor, the shared-memory echo and the AF_XDP queues*/
+int echoAuxSlots(echoServerConfig *pConfig)
+{
+	return (echoAuxReactor(pConfig) ? 1 : 0) + echoShmSlots(pConfig) + echoXdpSlots(pConfig);
+}
+
+/*********************************************************************
+* Function Name  : echoAuxServersStart()
+* Description    : Start the servers that are not TCP/UDP sockets
+* Input          : pGlobal - reference to global echo servers DB
+				   firstSlot - counter slot after the backend's own
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The threads take the slots (and --cpus entries) in
+				   the order unix/TLS reactor, shared memory, AF_XDP
+				   queues;
+***********************************************************************/
+ECHO_STATUS echoAuxServersStart(EchoGlobal_t *pGlobal, int firstSlot)
+{
+	echoServerConfig *pConfig = &pGlobal->config;
+	int slot = firstSlot;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (echoAuxReactor(pConfig))
+	{
+		if (ECHO_OK != (iRet = echoEpollAuxStart(pGlobal, slot++)))
+		{
+			log_echo_err("Could not start the unix socket/TLS servers - %s!", arrErrors[iRet]);
+			return iRet;
+		}
+	}
+
+	if (ECHO_OK != (iRet = echoShmServerStart(pGlobal, slot)))
+	{
+		log_echo_err("Could not start the shared-memory echo - %s!", arrErrors[iRet]);
+		return iRet;
+	}
+	slot += echoShmSlots(pConfig);
+
+	if (ECHO_OK != (iRet = echoXdpStart(pGlobal, slot)))
+	{
+		log_echo_err("Could not start the AF_XDP fast path - %s!", arrErrors[iRet]);
+		return iRet;
+	}
+
 	return ECHO_OK;
 }
 
 /*Allocate memory and initialize the global echo servers structure*/
-ECHO_STATUS echoGlobalInit(EchoGlobal_t **ppGlobal, int tcp_max_connection) 
+ECHO_STATUS echoGlobalInit(EchoGlobal_t **ppGlobal, echoServerConfig *pConfig) 
 {
 	EchoGlobal_t *pGlobal = NULL;
 	
 	log_echo ("Initializing echo global structure ... ");
 	if (NULL == (pGlobal = malloc(sizeof(EchoGlobal_t) )) )
 	{
-		log_echo ("Could not allocate memory for global struct");
+		log_echo_err("Could not allocate memory for global struct");
 		return ECHO_NO_MEM_ERR;
 	}
 	
@@ -114,7 +228,16 @@ ECHO_STATUS echoGlobalInit(EchoGlobal_t **ppGlobal, int tcp_max_connection)
 	pGlobal->echoServersData.udpSocket = -1;
 	pGlobal->echoServersData.tcpStatus = 1;
 	pGlobal->echoServersData.udpStatus = 1;
-	pGlobal->echoServersData.tcpMaxConnections = tcp_max_connection;
+	pGlobal->echoServersData.tcpMaxConnections = pConfig->tcpMaxConnections;
+	pGlobal->config = *pConfig;
+	
+	/*SO_INCOMING_CPU steers flows between the SO_REUSEPORT sockets of
+	  pinned workers; legacy threads share one socket*/
+	if (pConfig->incomingCpu && (pConfig->cpus.count == 0 || pConfig->ioMode == ECHO_IO_LEGACY))
+	{
+		log_echo_warn("--incoming-cpu needs epoll/uring workers pinned with --cpus, ignored");
+		pGlobal->config.incomingCpu = 0;
+	}
 	
 	*ppGlobal = pGlobal;
   
@@ -133,24 +256,114 @@ ECHO_STATUS echoGlobalInit(EchoGlobal_t **ppGlobal, int tcp_max_connection)
 ECHO_STATUS echoSetSocket(EchoGlobal_t *pGlobal, int iEchoProto)
 {
 	int sock = -1;
-	int res = -1;
-	int iEchoPort = ECHO_PORT_DEFAULT;
-	struct sockaddr_in  stServerAddr;
+	ECHO_STATUS iRet = ECHO_OK;
 	
 	switch(iEchoProto)
 	{
 		case IPPROTO_TCP:
 			if(pGlobal->echoServersData.tcpSocket != -1)
 				return ECHO_FAIL;
-			
-			/*Open TCP socket*/
-			sock = socket(PF_INET, SOCK_STREAM, 0);
 			break;
 			
 		case IPPROTO_UDP:
 			if(pGlobal->echoServersData.udpSocket != -1)
 				return ECHO_FAIL;
+			break;
+	}
+	
+	if (ECHO_OK != (iRet = echoOpenServerSocket(iEchoProto, &pGlobal->config, 0, &sock)))
+		return iRet;
+	
+	/*the legacy threads wait in accept()/recvmsg() - on a non-blocking
+	  socket they would spin on EAGAIN instead*/
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) & ~O_NONBLOCK);
+
+	switch(iEchoProto)
+	{
+		case IPPROTO_TCP:
+			pGlobal->echoServersData.tcpSocket = sock;
+			break;
 			
+		case IPPROTO_UDP:
+			pGlobal->echoServersData.udpSocket = sock;
+			break;
+	}
+	
+	return ECHO_OK;
+}
+
+/*Let the process hold fds descriptors. Root raises the hard limit as
+  well (up to fs.nr_open), anyone else gets as far as the hard limit;
+  otherwise accept() and socket() fail with EMFILE long before 100k
+  connections*/
+void echoFdLimit(int fds)
+{
+	struct rlimit rl;
+	int err = 0;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur >= (rlim_t)fds)
+		return;
+
+	rl.rlim_cur = fds;
+	if (rl.rlim_max < (rlim_t)fds)
+		rl.rlim_max = fds;
+	if (setrlimit(RLIMIT_NOFILE, &rl) == 0)
+		return;
+
+	err = errno;
+	getrlimit(RLIMIT_NOFILE, &rl);
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	log_echo_warn("Can not open %d descriptors errno %d, the limit is %lu", fds, err, (unsigned long)rl.rlim_cur);
+}
+
+/*SO_SNDBUF/SO_RCVBUF of a socket, 0 leaves the kernel default (and its
+  autotuning). The FORCE variants (CAP_NET_ADMIN) pass over the
+  net.core.wmem_max/rmem_max caps; the kernel doubles the value for its
+  bookkeeping either way. Listeners pass them on to accepted sockets, so
+  they are set before listen() or connect() - the window scale is fixed
+  by the SYN*/
+void echoSocketBuffers(int sock, int sndBuf, int rcvBuf)
+{
+	if (sndBuf > 0 && setsockopt(sock, SOL_SOCKET, SO_SNDBUFFORCE, &sndBuf, sizeof(int)) < 0 &&
+		setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof(int)) < 0)
+		log_echo_warn("setsockopt(SO_SNDBUF) failed errno %d", errno);
+	if (rcvBuf > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &rcvBuf, sizeof(int)) < 0 &&
+		setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(int)) < 0)
+		log_echo_warn("setsockopt(SO_RCVBUF) failed errno %d", errno);
+}
+
+/***********************************************************************
+* Function Name  : echoOpenServerSocket()
+* Description    : Open one TCP/UDP server socket
+* Input          : iEchoProto - type of the protocol (TCP/UDP), or
+				   ECHO_PROTO_TLS for the TCP listener of tlsPort
+				   pConfig - port to bind (below 1024 needs a privileged
+				   user) and the TCP listener settings
+				   reusePort - set SO_REUSEPORT, so that several sockets
+				   (one per worker) can be bound to the same port
+				   pSock - the new socket
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Open the socket, bind it to adress/port and in case
+				   of TCP listen for incomming connections with the
+				   configured backlog, TCP_DEFER_ACCEPT and TCP_FASTOPEN; 
+************************************************************************/
+ECHO_STATUS echoOpenServerSocket(int iEchoProto, echoServerConfig *pConfig, int reusePort, int *pSock)
+{
+	int sock = -1;
+	int res = -1;
+	int iEchoPort = iEchoProto == ECHO_PROTO_TLS ? pConfig->tlsPort : pConfig->port;
+	struct sockaddr_in  stServerAddr;
+	
+	switch(iEchoProto)
+	{
+		case IPPROTO_TCP:
+		case ECHO_PROTO_TLS:
+			/*Open TCP socket*/
+			sock = socket(PF_INET, SOCK_STREAM, 0);
+			break;
+			
+		case IPPROTO_UDP:
 			/*Open UDP socket*/
 			sock = socket(PF_INET, SOCK_DGRAM, 0);
 			break;
@@ -158,7 +371,7 @@ ECHO_STATUS echoSetSocket(EchoGlobal_t *pGlobal, int iEchoProto)
 	 
 	if (sock == -1) 
 	{
-		log_echo("Cannot allocate new socket %d", errno);
+		log_echo_err("Cannot allocate new socket %d", errno);
 		return ECHO_OPEN_SOCK_ERR;
 	}
 	
@@ -172,18 +385,29 @@ ECHO_STATUS echoSetSocket(EchoGlobal_t *pGlobal, int iEchoProto)
 																				  bind to a port in use by another socket (because we have both 
 																				  TCP and UDP sockets using same port). */
 	{
-		log_echo("setsockopt(SO_REUSEADDR) failed errno %d", errno);
+		log_echo_err("setsockopt(SO_REUSEADDR) failed errno %d", errno);
+		close(sock);
+		return ECHO_SET_SOCK_FLG_ERR;
+	}
+	
+	/*With SO_REUSEPORT the kernel load balances new connections and
+	  datagrams between all sockets bound to the same address/port*/
+	if (reusePort && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) < 0)
+	{
+		log_echo_err("setsockopt(SO_REUSEPORT) failed errno %d", errno);
+		close(sock);
 		return ECHO_SET_SOCK_FLG_ERR;
 	}
 	
 	bzero(&stServerAddr, sizeof(struct sockaddr_in));
 	stServerAddr.sin_family = AF_INET; /*Adress family of IPv4 addresses*/
 	stServerAddr.sin_port = htons(iEchoPort);
-	log_echo("\n server port %d \n", stServerAddr.sin_port);
+	log_echo_debug("\n server port %d \n", iEchoPort);
 	
 	switch(iEchoProto)
 	{
 		case IPPROTO_TCP:
+		case ECHO_PROTO_TLS:
 			/*INADDR_ANY is 0, When INADDR_ANY is specified in the bind call,
 			  the socket will be bound to all local interfaces.*/
 			stServerAddr.sin_addr.s_addr = htonl(0); 
@@ -197,35 +421,43 @@ ECHO_STATUS echoSetSocket(EchoGlobal_t *pGlobal, int iEchoProto)
 	/*assign the address specified by stServerAddr to the socket referred to by the file descriptor sock.*/
 	if((res = bind(sock, (struct sockaddr *)&stServerAddr, sizeof(struct sockaddr_in))) != 0)
 	{
-		log_echo("Can not bind server to socket %d!",errno);
+		log_echo_err("Can not bind server to socket %d!",errno);
 		close(sock);
 		return ECHO_BIND_ERR;
 	}
-
-	switch(iEchoProto)
-	{
-		case IPPROTO_TCP:
-			pGlobal->echoServersData.tcpSocket = sock;
-			break;
-			
-		case IPPROTO_UDP:
-			pGlobal->echoServersData.udpSocket = sock;
-			break;
-	}
 	
-	if(iEchoProto == IPPROTO_TCP)
+	/*--busy-poll: receives poll the device queue before they sleep*/
+	echoBusyPollSocket(sock, pConfig->busyPoll);
+	echoSocketBuffers(sock, pConfig->sndBuf, pConfig->rcvBuf);
+	/*the TLS listener is left out, OpenSSL and kTLS write the records themselves*/
+	if (iEchoProto == IPPROTO_TCP)
+		echoZcSocket(sock, pConfig);
+
+	if(iEchoProto == IPPROTO_TCP || iEchoProto == ECHO_PROTO_TLS)
 	{
+		/*TCP_DEFER_ACCEPT - a connection is only handed to accept() once the
+		  client's first data arrived, an echo client always sends first;
+		  TCP_FASTOPEN - that data may even come with the SYN, saving a
+		  round trip per connection (needs net.ipv4.tcp_fastopen & 2)*/
+		if (pConfig->deferAccept > 0 &&
+			setsockopt(sock, IPPROTO_TCP, TCP_DEFER_ACCEPT, &pConfig->deferAccept, sizeof(int)) < 0)
+			log_echo_warn("setsockopt(TCP_DEFER_ACCEPT) failed errno %d", errno);
+		if (pConfig->fastOpen > 0 &&
+			setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN, &pConfig->fastOpen, sizeof(int)) < 0)
+			log_echo_warn("setsockopt(TCP_FASTOPEN) failed errno %d", errno);
+		
 		/*  listen() marks the socket referred to by sock as a passive socket,
 			that is, as a socket that will be used to accept incoming connection
-			requests using accept*/
-		if( listen(sock, ECHO_TCP_BACKLOG) < 0)
+			requests using accept; the kernel caps the backlog at net.core.somaxconn*/
+		if( listen(sock, pConfig->tcpBacklog) < 0)
 		{
-			log_echo("Can not set server to listen %d!",errno);
+			log_echo_err("Can not set server to listen %d!",errno);
 			close(sock);
 			return ECHO_LISTEN_SOCK_ERR;
 		}
 	}
 	
+	*pSock = sock;
 	return ECHO_OK;
 }
 
@@ -254,33 +486,49 @@ ECHO_STATUS echoServerStart(EchoGlobal_t *pGlobal, int iEchoProto)
 ECHO_STATUS incomingConnections(EchoGlobal_t *pGlobal, int iEchoProto)
 {
 	pthread_t thread_id;
+	pthread_attr_t attr;
+	pthread_params udpParams;
+	int err = 0;
 	
 	switch(iEchoProto)
 	{
 		case IPPROTO_TCP:
-			log_echo("incomingConnections TCP SOCK  [%d] \n", pGlobal->echoServersData.tcpSocket);
+			log_echo_debug("incomingConnections TCP SOCK  [%d] \n", pGlobal->echoServersData.tcpSocket);
 			
 			//The pthread_create() function starts a new thread in the calling process.
 			//The new thread starts execution by invoking echoTcpListener(); pGlobal is passed as argument of echoTcpListener().
-			if( pthread_create( &thread_id , NULL,  echoTcpListener, (void*)pGlobal) < 0)
+			if (ECHO_OK != echoAffinityAttrInit(&attr, &pGlobal->config.listenerCpus, -1))
+				return ECHO_PTHREAD_ERR;
+			err = pthread_create( &thread_id , &attr,  echoTcpListener, (void*)pGlobal);
+			pthread_attr_destroy(&attr);
+			if (err != 0)
 			{
 				perror("could not create thread - echoTcpListener!");
 				return ECHO_PTHREAD_ERR;
 			}
 			
-			log_echo("Socket client accepted  [%d] \n", pGlobal->echoServersData.tcpSocket);
+			log_echo_debug("Socket client accepted  [%d] \n", pGlobal->echoServersData.tcpSocket);
 			break;
 			
 		case IPPROTO_UDP:		
-			log_echo("incomingConnections  UDP SOCK  [%d] \n", pGlobal->echoServersData.udpSocket);	
+			log_echo_debug("incomingConnections  UDP SOCK  [%d] \n", pGlobal->echoServersData.udpSocket);	
 			
-			if( pthread_create( &thread_id , NULL ,  echoUdpCallback, (void*) &pGlobal->echoServersData.udpSocket) < 0)
+			udpParams.pData = &pGlobal->echoServersData;
+			udpParams.sock = pGlobal->echoServersData.udpSocket;
+			udpParams.pBuf = echoBufGet(&legacyUdpPool);
+			udpParams.reflect = pGlobal->config.udpReflect;
+			
+			if (ECHO_OK != echoAffinityAttrInit(&attr, &pGlobal->config.cpus, -1))
+				return ECHO_PTHREAD_ERR;
+			err = pthread_create( &thread_id , &attr ,  echoUdpCallback, (void*) &udpParams);
+			pthread_attr_destroy(&attr);
+			if (err != 0)
 			{
 				perror("could not create thread - echoUdpHandler!");
 				return ECHO_PTHREAD_ERR;
 			}
 			
-			log_echo("Socket client accepted  [%d] \n", pGlobal->echoServersData.udpSocket);
+			log_echo_debug("Socket client accepted  [%d] \n", pGlobal->echoServersData.udpSocket);
 			pthread_join(thread_id, NULL);
 			break;
 	}
@@ -288,6 +536,80 @@ ECHO_STATUS incomingConnections(EchoGlobal_t *pGlobal, int iEchoProto)
 	return ECHO_OK;
 }
 
+/*Unix domain address of szPath; a leading '@' names a socket of the
+  abstract namespace (no file, gone with its last descriptor). Returns
+  the address length, 0 if the path does not fit*/
+socklen_t echoUnixAddr(const char *szPath, struct sockaddr_un *pAddr)
+{
+	size_t len = strlen(szPath);
+
+	bzero(pAddr, sizeof(struct sockaddr_un));
+	pAddr->sun_family = AF_UNIX;
+	if (len == 0 || len >= sizeof pAddr->sun_path)
+		return 0;
+
+	memcpy(pAddr->sun_path, szPath, len);
+	if (szPath[0] != '@')
+		return offsetof(struct sockaddr_un, sun_path) + len + 1;
+
+	pAddr->sun_path[0] = '\0';
+	return offsetof(struct sockaddr_un, sun_path) + len;
+}
+
+/***********************************************************************
+* Function Name  : echoOpenUnixSocket()
+* Description    : Open one unix domain server socket
+* Input          : type - SOCK_STREAM or SOCK_DGRAM
+				   szPath - file system path or @abstract name
+				   pConfig - listen() backlog of a stream socket
+				   pSock - the new non-blocking socket
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : A socket file left behind by a previous server would
+				   fail the bind, so it is removed first - anything
+				   else at the path is left alone;
+************************************************************************/
+ECHO_STATUS echoOpenUnixSocket(int type, const char *szPath, echoServerConfig *pConfig, int *pSock)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	socklen_t addrLen = echoUnixAddr(szPath, &addr);
+	int sock = -1;
+
+	if (addrLen == 0)
+	{
+		log_echo_err("Bad unix socket path %s", szPath);
+		return ECHO_BAD_PARAM;
+	}
+
+	if ((sock = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+	{
+		log_echo_err("Cannot allocate new unix socket %d", errno);
+		return ECHO_OPEN_SOCK_ERR;
+	}
+
+	if (szPath[0] != '@' && lstat(szPath, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(szPath);
+	echoSocketBuffers(sock, pConfig->sndBuf, pConfig->rcvBuf);
+
+	if (bind(sock, (struct sockaddr *)&addr, addrLen) != 0)
+	{
+		log_echo_err("Can not bind server to %s errno %d!", szPath, errno);
+		close(sock);
+		return ECHO_BIND_ERR;
+	}
+
+	if (type == SOCK_STREAM && listen(sock, pConfig->tcpBacklog) < 0)
+	{
+		log_echo_err("Can not set server to listen on %s %d!", szPath, errno);
+		close(sock);
+		return ECHO_LISTEN_SOCK_ERR;
+	}
+
+	log_echo("Unix %s echo on %s", type == SOCK_STREAM ? "stream" : "datagram", szPath);
+	*pSock = sock;
+	return ECHO_OK;
+}
+
 /************************************************************************
 * Function Name  : echoTcpListener()
 * Description    : A function that will be executed by pthread; Accepts
@@ -303,6 +625,9 @@ void *echoTcpListener(void *psGlobal)
 	int listenSock = pGlobal->echoServersData.tcpSocket;
 	int clientSock = 0;
 	pthread_t thread_id;
+	pthread_attr_t attr; /*client threads run on the --cpus of the echo threads*/
+	pthread_params params; /*reused - a client thread is joined before the next accept()*/
+	echoStatsSlot *pStats = echoStatsSlotGet(ECHO_STATS_SLOT_LEGACY_TCP);
 	ECHO_STATUS ret = 0;
 	
 	if(listenSock < 0)
@@ -311,35 +636,46 @@ void *echoTcpListener(void *psGlobal)
 		pthread_exit(&ret);
 	}
 	
+	/*a client thread needs little stack - the buffer is pooled*/
+	if (ECHO_OK != echoAffinityAttrInit(&attr, &pGlobal->config.cpus, -1) ||
+		0 != pthread_attr_setstacksize(&attr, ECHO_LEGACY_STACK_SIZE))
+	{
+		ret = ECHO_PTHREAD_ERR;
+		pthread_exit(&ret);
+	}
+	
 	log_echo("TCP server is listening to sock=[%d] \n", listenSock);	
 	while(1)
 	{		
-		if(pGlobal->echoServersData.iClientsCount < pGlobal->echoServersData.tcpMaxConnections)
+		if(__atomic_load_n(&pGlobal->echoServersData.iClientsCount, __ATOMIC_RELAXED) < pGlobal->echoServersData.tcpMaxConnections)
 		{	
 			//It extracts the first connection request on the queue of pending connections for the listening socket,
 			//listenSock, creates a new connected socket, and returns a new file descriptor referring to that socket - clientSock;
-			clientSock = accept(listenSock, (struct sockaddr*)NULL, NULL);
+			clientSock = accept4(listenSock, (struct sockaddr*)NULL, NULL, SOCK_CLOEXEC);
 			
 			if(clientSock != -1)
 			{
-				log_echo("New client accept %d... ", clientSock);
+				log_echo_debug("New client accept %d... ", clientSock);
+				
+				/*an echo bigger than the buffer is sent in pieces - Nagle would
+				  hold the last one until the client's delayed ACK*/
+				setsockopt(clientSock, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
 									
 				//new pthread for clients
-				pthread_mutex_lock(&lock);
-				pGlobal->echoServersData.iClientsCount++;
-				pthread_mutex_unlock(&lock);
+				__atomic_add_fetch(&pGlobal->echoServersData.iClientsCount, 1, __ATOMIC_RELAXED);
+				ECHO_STAT_ADD(pStats->accepted, 1);
+				params.pBuf = echoBufGet(&legacyTcpPool);
 				
-				pthread_params *params = malloc(sizeof(pthread_params));
+				params.pData = &pGlobal->echoServersData;
+				params.sock = clientSock;
 				
-				params->pData = &pGlobal->echoServersData;
-				params->sock = clientSock;
-				
-				if( pthread_create( &thread_id , NULL ,  echoTcpCallback , (void*)params ) < 0)
+				if( pthread_create( &thread_id , &attr ,  echoTcpCallback , (void*)&params ) != 0)
 				{
-					log_echo("could not create thread");
-					pthread_mutex_lock(&lock);
-					pGlobal->echoServersData.iClientsCount--;
-					pthread_mutex_unlock(&lock);
+					log_echo_err("could not create thread");
+					__atomic_sub_fetch(&pGlobal->echoServersData.iClientsCount, 1, __ATOMIC_RELAXED);
+					ECHO_STAT_ADD(pStats->closed, 1);
+					if (params.pBuf)
+						echoBufPut(&legacyTcpPool, params.pBuf);
 					ret = ECHO_CLIENT_THREAD_ERR;
 					pthread_exit(&ret);
 				}	
@@ -347,7 +683,12 @@ void *echoTcpListener(void *psGlobal)
 				//Suspend execution of the calling thread until the target thread terminates;
 				pthread_join(thread_id, NULL);	
 			}		
-		}				
+		}
+		else
+		{
+			/*at the limit (-s 0) wait for a client to leave instead of spinning*/
+			usleep(ECHO_EPOLL_PAUSE_MS * 1000);
+		}
 	}
 		
 	log_echo("echoTcpListener end\n");
@@ -362,45 +703,102 @@ void *echoTcpListener(void *psGlobal)
 				   socket, created by accept() and a reference to global 
 				   server DB;
 * Return         : ECHO_STATUS to indicate error/success
+* Logic          : With --zerocopy an echo of zeroCopy bytes or more is
+				   sent with MSG_ZEROCOPY; the buffer stays pinned until
+				   the kernel reports the send complete and the next
+				   message is received into another buffer of the pool.
+				   When all of them are pinned the client waits for a
+				   completion. Buffers still pinned when the client
+				   leaves are drained before the socket is closed; if
+				   the kernel does not release them the client is reset
+				   (SO_LINGER 0) and they return to the pool;
 ***********************************************************************/
 void *echoTcpCallback(void* pthread_par)
 {
 	pthread_params *p = (pthread_params *)pthread_par;
 	int newsockfd = p->sock;
-	char recvBuffer[ECHO_BUFSIZE];
+	echoBuf *pBuf = p->pBuf;
+	echoStatsSlot *pStats = echoStatsSlotGet(ECHO_STATS_SLOT_LEGACY_TCP);
+	unsigned int zcThreshold = pGlobal->config.zeroCopy;
+	echoZcInflight zc;
+	int numBytesSent = 0;
 	int numBytesRecv = 0 ;
 	ECHO_STATUS ret = 0;
 	
-	log_echo("echoTcpCallback  [%d] \n", newsockfd);
+	bzero(&zc, sizeof zc);
 	
-	bzero(recvBuffer, ECHO_BUFSIZE);
+	log_echo_debug("echoTcpCallback  [%d] \n", newsockfd);
 	
 	//The recv() call is used to receive messages from a socket. It is used to receive data on connection-oriented sockets (TCP)
-	while((numBytesRecv = recv(newsockfd, recvBuffer, ECHO_BUFSIZE, MSG_DONTWAIT)) != -1)
+	while(pBuf && (numBytesRecv = recv(newsockfd, pBuf->data, pBuf->cap, 0)) != -1)
 	{		
 		if(numBytesRecv == 0)
 		{
-			log_echo("recv from socket %d, numBytesRecv =%d errno %d\n", newsockfd, numBytesRecv, errno);
-			close(newsockfd);
+			log_echo_debug("recv from socket %d, numBytesRecv =%d errno %d\n", newsockfd, numBytesRecv, errno);
 			break;
 		}
+		pBuf->len = numBytesRecv;
+		ECHO_STAT_ADD(pStats->bytesIn, numBytesRecv);
 		
 		//The system calls send() is used to transmit a message to another socket. It is used only when the socket is in a connected
-        //state (so that the intended recipient is known - TCP).
-		numBytesRecv = send(newsockfd, recvBuffer, sizeof(recvBuffer), MSG_DONTWAIT);
+        //state (so that the intended recipient is known - TCP). Only the received bytes go back, a short send is completed.
+		if (zcThreshold && pBuf->len < zcThreshold)
+			ECHO_STAT_ADD(pStats->zcFallbacks, 1);
+		for (numBytesRecv = 0; numBytesRecv < pBuf->len; numBytesRecv += numBytesSent)
+		{
+			if (zcThreshold && pBuf->len >= zcThreshold)
+				numBytesSent = echoZcSend(newsockfd, &zc, pBuf, numBytesRecv, pBuf->len - numBytesRecv, pStats);
+			else
+				numBytesSent = send(newsockfd, pBuf->data + numBytesRecv, pBuf->len - numBytesRecv, MSG_NOSIGNAL);
+			if (numBytesSent < 0) 
+				break;
+			ECHO_STAT_ADD(pStats->bytesOut, numBytesSent);
+			if (numBytesSent < (int)pBuf->len - numBytesRecv)
+				ECHO_STAT_ADD(pStats->shortWrites, 1);
+		}
 
-		if (numBytesRecv < 0) 
-			log_echo("ERROR writing to socket %d, errno %d\n", newsockfd, errno);
-		
-		bzero(recvBuffer, ECHO_BUFSIZE);
+		/*the kernel sends from a pinned buffer, receive into another one*/
+		if (echoZcPin(&zc, pBuf))
+		{
+			while (NULL == (pBuf = echoBufGet(&legacyTcpPool)) && echoZcWait(newsockfd, &zc, &legacyTcpPool, pStats) > 0)
+				;
+			if (pBuf == NULL)
+			{
+				log_echo_warn("No buffer of client %d was released by the kernel, closing it", newsockfd);
+				break;
+			}
+		}
+
+		if (numBytesSent < 0) 
+		{
+			ECHO_STAT_ADD(pStats->sendErrors, 1);
+			log_echo_warn("ERROR writing to socket %d, errno %d\n", newsockfd, errno);
+			break;
+		}
 	}
 	
-	pthread_mutex_lock(&lock);
-	pGlobal->echoServersData.iClientsCount--;
-	pthread_mutex_unlock(&lock);
+	while (zc.count > 0 && echoZcWait(newsockfd, &zc, &legacyTcpPool, pStats) > 0)
+		;
+	if (zc.count > 0)
+	{
+		/*reset the client so that the kernel drops the unsent data and
+		  releases the pages, the buffers go back to the pool*/
+		struct linger linger = {1, 0};
+
+		log_echo_warn("%d zerocopy send(s) of client %d not complete, resetting it", zc.count, newsockfd);
+		setsockopt(newsockfd, SOL_SOCKET, SO_LINGER, &linger, sizeof linger);
+		close(newsockfd);
+		echoZcDrop(&zc, &legacyTcpPool);
+	}
+	else
+		close(newsockfd);
+	if (pBuf)
+		echoBufPut(&legacyTcpPool, pBuf);
+	ECHO_STAT_ADD(pStats->closed, 1);
+	__atomic_sub_fetch(&pGlobal->echoServersData.iClientsCount, 1, __ATOMIC_RELAXED);
 
 	p->pData = NULL;
-	free(p);
+	p->pBuf = NULL;
 	ret = ECHO_OK;
 	pthread_exit(&ret);
 }
@@ -409,40 +807,77 @@ void *echoTcpCallback(void* pthread_par)
 * Function Name  : echoUdpCallback()
 * Description    : A function that will be executed by pthread; Handles
 				   UDP clients - receive the message and send it back;
-* Input          : client_socket - the UDP socket;
+* Input          : pthread_par - the UDP socket and the pooled buffer
+				   datagrams are received into;
 * Return         : ECHO_STATUS to indicate error/success
 ************************************************************************/
-void *echoUdpCallback(void *client_socket)
+void *echoUdpCallback(void *pthread_par)
 {
-	int newsockfd = *(int*)client_socket;
+	pthread_params *p = (pthread_params *)pthread_par;
+	int newsockfd = p->sock;
+	echoBuf *pBuf = p->pBuf;
+	echoStatsSlot *pStats = echoStatsSlotGet(ECHO_STATS_SLOT_LEGACY_UDP);
 	struct sockaddr_in clientAddr;
 	socklen_t addrLen = sizeof clientAddr;
-	char recvBuffer[ECHO_BUFSIZE];
+	echoReflectControl control;
+	struct iovec iov;
+	struct msghdr msg;
+	unsigned int reflectSeq = 0;
 	int numBytesRecv = 0 ;
 	int numBytesSent = 0;
 	ECHO_STATUS ret;
 	
-	if(newsockfd < 0)
+	if(newsockfd < 0 || pBuf == NULL)
 	{
 		ret = ECHO_CLIENT_SOCK_ERR;
 		pthread_exit(&ret);
 	}
 	
 	log_echo("UDP server is listening to sock=[%d] \n", newsockfd);
-	bzero(recvBuffer, sizeof recvBuffer);
+	
+	if (p->reflect)
+		echoReflectEnable(newsockfd);
 	
 	while (1) 
 	{
-		//The recvfrom() call is used to receive messages from a socket. It is used to receive data on connectionless sockets (UDP)
-		numBytesRecv = recvfrom(newsockfd, recvBuffer, ECHO_BUFSIZE, 0, (struct sockaddr *) &clientAddr, &addrLen);
+		//The recvmsg() call is used to receive messages from a socket; unlike recvfrom() it also
+		//returns the ancillary data - the receive time of the datagram in reflector mode
+		bzero(&msg, sizeof msg);
+		iov.iov_base = pBuf->data;
+		iov.iov_len = pBuf->cap;
+		msg.msg_name = &clientAddr;
+		msg.msg_namelen = sizeof clientAddr;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control;
+		numBytesRecv = recvmsg(newsockfd, &msg, 0);
+		addrLen = msg.msg_namelen;
+		
+		/*bigger than the buffer - dropped rather than echoed cut*/
+		if (numBytesRecv >= 0 && (msg.msg_flags & MSG_TRUNC))
+		{
+			ECHO_STAT_ADD(pStats->datagrams, 1);
+			ECHO_STAT_ADD(pStats->udpDropped, 1);
+			continue;
+		}
 		
-		if(numBytesRecv > 0)
+		/*zero-length datagrams are valid and echoed as well*/
+		if(numBytesRecv >= 0)
 		{
-			log_echo("UDP recvfrom %d\n", numBytesRecv);
+			pBuf->len = numBytesRecv;
+			if (p->reflect)
+				echoReflectStamp(pBuf->data, pBuf->len, echoReflectRxNs(&msg), &reflectSeq);
+			ECHO_STAT_ADD(pStats->datagrams, 1);
+			ECHO_STAT_ADD(pStats->bytesIn, numBytesRecv);
+			log_echo_debug("UDP recvfrom %d\n", numBytesRecv);
 			//The system call sendto() is used to transmit a message to another socket (UDP).
-			numBytesSent = sendto(newsockfd, recvBuffer, strlen(recvBuffer), 0, (struct sockaddr *) &clientAddr, addrLen);
-			log_echo("UDP sendto %d %s\n", numBytesSent, recvBuffer);	
-			bzero(recvBuffer, sizeof recvBuffer);
+			numBytesSent = sendto(newsockfd, pBuf->data, pBuf->len, 0, (struct sockaddr *) &clientAddr, addrLen);
+			log_echo_debug("UDP sendto %d\n", numBytesSent);	
+			if (numBytesSent < 0)
+				ECHO_STAT_ADD(pStats->sendErrors, 1);
+			else
+				ECHO_STAT_ADD(pStats->bytesOut, numBytesSent);
 		}
 		 
 	}
@@ -472,32 +907,413 @@ ECHO_STATUS echoServerCloseConnections(EchoGlobal_t *pGlobal, int iEchoProto)
 	return ECHO_OK;
 }
 
+/*Byte count of an option: a number, optionally with a K, M or G suffix
+  (powers of 1024), at most max*/
+static ECHO_STATUS echoSizeParse(const char *szSize, unsigned long long max, unsigned long long *pSize)
+{
+	unsigned long long size = 0;
+	char *pEnd = NULL;
+	int shift = 0;
+
+	errno = 0;
+	size = strtoull(szSize, &pEnd, 10);
+	switch (*pEnd)
+	{
+		case 'k': case 'K': shift = 10; pEnd++; break;
+		case 'm': case 'M': shift = 20; pEnd++; break;
+		case 'g': case 'G': shift = 30; pEnd++; break;
+	}
+
+	if (errno || pEnd == szSize || *pEnd != '\0' || szSize[0] == '-' || size > (max >> shift))
+		return ECHO_BAD_PARAM;
+
+	*pSize = size << shift;
+	return ECHO_OK;
+}
+
 int main( int argc, char** argv)
 {
 	int iOpt = 0;
-	int tcp_max_connection = 0;
-	struct option stLongOptions[] = { {"server", 0, 0, 1},
+	int iMode = 0;
+	int statsCount = 0; /*--stats: samples to print, 0 - until the server exits*/
+	unsigned long long size = 0;
+	char *szLogFile = NULL; /*server log, NULL - stderr*/
+	echoServerConfig stConfig;
+	echoClientConfig stClientConfig;
+	struct option stLongOptions[] = { {"server", 1, 0, 1},
 									  {"client", 0, 0, 2},
+									  {"mode", 1, 0, 3},
+									  {"workers", 1, 0, 4},
+									  {"udp-batch", 1, 0, 5},
+									  {"stats-interval", 1, 0, 6},
+									  {"udp-gro", 0, 0, 7},
+									  {"gso", 1, 0, 8},
+									  {"splice", 0, 0, 9},
+									  {"pool-buffers", 1, 0, 10},
+									  {"huge-pages", 0, 0, 11},
+									  {"load", 0, 0, 12},
+									  {"threads", 1, 0, 13},
+									  {"connections", 1, 0, 14},
+									  {"duration", 1, 0, 15},
+									  {"size", 1, 0, 16},
+									  {"depth", 1, 0, 17},
+									  {"timeout", 1, 0, 18},
+									  {"rate", 1, 0, 19},
+									  {"ping", 0, 0, 20},
+									  {"count", 1, 0, 21},
+									  {"interval", 1, 0, 22},
+									  {"stats", 0, 0, 23},
+									  {"log-level", 1, 0, 24},
+									  {"log-file", 1, 0, 25},
+									  {"port", 1, 0, 26},
+									  {"output", 1, 0, 27},
+									  {"timestamp", 0, 0, 28},
+									  {"reflect", 0, 0, 29},
+									  {"backlog", 1, 0, 30},
+									  {"defer-accept", 1, 0, 31},
+									  {"fastopen", 1, 0, 32},
+									  {"churn", 0, 0, 33},
+									  {"cpus", 1, 0, 34},
+									  {"listener-cpus", 1, 0, 35},
+									  {"incoming-cpu", 0, 0, 36},
+									  {"busy-poll", 1, 0, 37},
+									  {"xdp", 1, 0, 38},
+									  {"xdp-queues", 1, 0, 39},
+									  {"xdp-native", 0, 0, 40},
+									  {"unix-stream", 1, 0, 41},
+									  {"unix-dgram", 1, 0, 42},
+									  {"shm", 1, 0, 43},
+									  {"tls", 0, 0, 44},
+									  {"tls-port", 1, 0, 45},
+									  {"tls-cert", 1, 0, 46},
+									  {"tls-key", 1, 0, 47},
+									  {"tls-version", 1, 0, 48},
+									  {"no-ktls", 0, 0, 49},
+									  {"stream", 1, 0, 50},
+									  {"stream-file", 1, 0, 51},
+									  {"buffer-size", 1, 0, 52},
+									  {"sndbuf", 1, 0, 53},
+									  {"rcvbuf", 1, 0, 54},
+									  {"zerocopy", 0, 0, 55},
+									  {"zerocopy-threshold", 1, 0, 56},
+									  {"idle", 1, 0, 57},
 									  {0, 0, 0, 0} };
+	
+	bzero(&stConfig, sizeof stConfig);
+	bzero(&stClientConfig, sizeof stClientConfig);
+	stConfig.ioMode = ECHO_IO_EPOLL;
+	stConfig.workers = 1;
+	stConfig.udpBatch = ECHO_UDP_BATCH_DEFAULT;
+	stConfig.poolBuffers = ECHO_POOL_BUFFERS_DEFAULT;
+	stConfig.port = ECHO_PORT_DEFAULT;
+	stConfig.tcpBacklog = ECHO_TCP_BACKLOG;
+	stConfig.xdpQueues = 1;
+	stClientConfig.port = ECHO_PORT_DEFAULT;
+	stClientConfig.threads = ECHO_LOAD_THREADS_DEFAULT;
+	stClientConfig.connections = ECHO_LOAD_CONNECTIONS_DEFAULT;
+	stClientConfig.duration = ECHO_LOAD_DURATION_DEFAULT;
+	stClientConfig.size = ECHO_LOAD_SIZE_DEFAULT;
+	stClientConfig.depth = ECHO_LOAD_DEPTH_DEFAULT;
+	stClientConfig.timeoutMs = ECHO_LOAD_TIMEOUT_DEFAULT;
+	stClientConfig.count = ECHO_PING_COUNT_DEFAULT;
+	stClientConfig.interval = ECHO_PING_INTERVAL_DEFAULT;
 				
-	while ( (iOpt = getopt_long( argc, argv, "sc", stLongOptions, NULL )) != -1 )
+	while ( (iOpt = getopt_long( argc, argv, "s:cm:w:b:i:", stLongOptions, NULL )) != -1 )
 	{
 		switch(iOpt)
 		{
 			case 1:
 			case 's':
-				if(argc == 3)
-				{
-					sscanf (argv[2], "%d", &tcp_max_connection);
-					echoServersStart(tcp_max_connection);
-					pthread_mutex_destroy(&lock);
-				}
+				iMode = 's';
+				sscanf (optarg, "%d", &stConfig.tcpMaxConnections);
 				break;
 			
 			case 2:
 			case 'c':
-				if(argc == 6)
-					echoClientStart(argv);
+				iMode = 'c';
+				break;
+				
+			case 3:
+			case 'm':
+				if (0 == strcmp(optarg, "legacy"))
+					stConfig.ioMode = ECHO_IO_LEGACY;
+				else if (0 == strcmp(optarg, "epoll"))
+					stConfig.ioMode = ECHO_IO_EPOLL;
+				else if (0 == strcmp(optarg, "uring"))
+					stConfig.ioMode = ECHO_IO_URING;
+				else
+					exit(1);
+				break;
+				
+			case 4:
+			case 'w':
+				sscanf (optarg, "%d", &stConfig.workers);
+				if (stConfig.workers < 1 || stConfig.workers > ECHO_MAX_WORKERS)
+					exit(1);
+				break;
+				
+			case 5:
+			case 'b':
+				sscanf (optarg, "%d", &stConfig.udpBatch);
+				if (stConfig.udpBatch < 1 || stConfig.udpBatch > ECHO_UDP_BATCH_MAX)
+					exit(1);
+				break;
+				
+			case 6:
+			case 'i':
+				sscanf (optarg, "%d", &stConfig.statsInterval);
+				break;
+				
+			case 7:
+				stConfig.udpGro = 1;
+				break;
+				
+			case 8:
+				sscanf (optarg, "%d", &stClientConfig.udpGso);
+				break;
+				
+			case 9:
+				stConfig.tcpSplice = 1;
+				break;
+				
+			case 10:
+				sscanf (optarg, "%d", &stConfig.poolBuffers);
+				if (stConfig.poolBuffers < 1)
+					exit(1);
+				break;
+				
+			case 11:
+				stConfig.hugePages = 1;
+				break;
+				
+			case 12:
+				iMode = 'l';
+				break;
+				
+			case 13:
+				sscanf (optarg, "%d", &stClientConfig.threads);
+				break;
+				
+			case 14:
+				sscanf (optarg, "%d", &stClientConfig.connections);
+				break;
+				
+			case 15:
+				sscanf (optarg, "%d", &stClientConfig.duration);
+				break;
+				
+			case 16:
+				sscanf (optarg, "%d", &stClientConfig.size);
+				break;
+				
+			case 17:
+				sscanf (optarg, "%d", &stClientConfig.depth);
+				break;
+				
+			case 18:
+				sscanf (optarg, "%d", &stClientConfig.timeoutMs);
+				break;
+				
+			case 19:
+				sscanf (optarg, "%d", &stClientConfig.rate);
+				break;
+				
+			case 20:
+				iMode = 'p';
+				break;
+				
+			case 21:
+				sscanf (optarg, "%d", &stClientConfig.count);
+				statsCount = stClientConfig.count;
+				break;
+				
+			case 22:
+				sscanf (optarg, "%d", &stClientConfig.interval);
+				break;
+				
+			case 23:
+				iMode = 'S';
+				break;
+				
+			case 24:
+				if ((echoLogLevel = echoLogLevelParse(optarg)) < 0)
+					exit(1);
+				break;
+				
+			case 25:
+				szLogFile = optarg;
+				break;
+				
+			case 26:
+				sscanf (optarg, "%d", &stConfig.port);
+				if (stConfig.port < 1 || stConfig.port > 65535)
+					exit(1);
+				stClientConfig.port = stConfig.port;
+				break;
+				
+			case 27:
+				stClientConfig.output = optarg;
+				break;
+				
+			case 28:
+				stClientConfig.timestamping = 1;
+				break;
+				
+			/*server: stamp reflector test datagrams; ping: send them*/
+			case 29:
+				stConfig.udpReflect = 1;
+				stClientConfig.reflect = 1;
+				break;
+				
+			case 30:
+				sscanf (optarg, "%d", &stConfig.tcpBacklog);
+				if (stConfig.tcpBacklog < 1)
+					exit(1);
+				break;
+				
+			case 31:
+				sscanf (optarg, "%d", &stConfig.deferAccept);
+				break;
+				
+			/*server: TFO queue length; churn: open the connections with TFO*/
+			case 32:
+				sscanf (optarg, "%d", &stConfig.fastOpen);
+				stClientConfig.fastOpen = stConfig.fastOpen;
+				break;
+				
+			case 33:
+				iMode = 'C';
+				break;
+				
+			/*server: workers/echo threads; clients: load, churn and ping threads*/
+			case 34:
+				if (ECHO_OK != echoCpuListParse(optarg, &stConfig.cpus))
+					exit(1);
+				stClientConfig.cpus = stConfig.cpus;
+				break;
+				
+			case 35:
+				if (ECHO_OK != echoCpuListParse(optarg, &stConfig.listenerCpus))
+					exit(1);
+				break;
+				
+			case 36:
+				stConfig.incomingCpu = 1;
+				break;
+				
+			/*server: workers spin before they block; shm clients: poll for the echo*/
+			case 37:
+				sscanf (optarg, "%d", &stConfig.busyPoll);
+				if (stConfig.busyPoll < 0)
+					exit(1);
+				stClientConfig.busyPoll = stConfig.busyPoll;
+				break;
+				
+			case 38:
+				stConfig.xdpIfname = optarg;
+				break;
+				
+			case 39:
+				sscanf (optarg, "%d", &stConfig.xdpQueues);
+				if (stConfig.xdpQueues < 1 || stConfig.xdpQueues > ECHO_XDP_MAX_QUEUES)
+					exit(1);
+				break;
+				
+			case 40:
+				stConfig.xdpNative = 1;
+				break;
+				
+			case 41:
+				stConfig.unixStream = optarg;
+				break;
+				
+			case 42:
+				stConfig.unixDgram = optarg;
+				break;
+				
+			case 43:
+				stConfig.shmName = optarg;
+				break;
+				
+			case 44:
+				stClientConfig.tls = 1;
+				break;
+				
+			case 45:
+				sscanf (optarg, "%d", &stConfig.tlsPort);
+				if (stConfig.tlsPort < 1 || stConfig.tlsPort > 65535)
+					exit(1);
+				break;
+				
+			case 46:
+				stConfig.tlsCert = optarg;
+				break;
+				
+			case 47:
+				stConfig.tlsKey = optarg;
+				break;
+				
+			/*server and clients: offer this version only*/
+			case 48:
+				if (0 == strcmp(optarg, "1.2"))
+					stConfig.tlsVersion = ECHO_TLS_VERSION_12;
+				else if (0 == strcmp(optarg, "1.3"))
+					stConfig.tlsVersion = ECHO_TLS_VERSION_13;
+				else
+					exit(1);
+				stClientConfig.tlsVersion = stConfig.tlsVersion;
+				break;
+				
+			case 49:
+				stConfig.ktlsOff = 1;
+				stClientConfig.ktlsOff = 1;
+				break;
+				
+			case 50:
+				if (ECHO_OK != echoSizeParse(optarg, ~0ULL, &stClientConfig.streamBytes) || stClientConfig.streamBytes == 0)
+					exit(1);
+				iMode = 'T';
+				break;
+				
+			case 51:
+				stClientConfig.streamFile = optarg;
+				iMode = 'T';
+				break;
+				
+			case 52:
+				if (ECHO_OK != echoSizeParse(optarg, ECHO_BUFSIZE_MAX, &size) || size < ECHO_CACHE_LINE)
+					exit(1);
+				stConfig.bufSize = size;
+				break;
+				
+			/*server: its listening and UDP sockets; clients: every socket they open*/
+			case 53:
+				if (ECHO_OK != echoSizeParse(optarg, ECHO_SOCKBUF_MAX, &size))
+					exit(1);
+				stConfig.sndBuf = stClientConfig.sndBuf = size;
+				break;
+				
+			case 54:
+				if (ECHO_OK != echoSizeParse(optarg, ECHO_SOCKBUF_MAX, &size))
+					exit(1);
+				stConfig.rcvBuf = stClientConfig.rcvBuf = size;
+				break;
+				
+			case 55:
+				if (stConfig.zeroCopy == 0)
+					stConfig.zeroCopy = ECHO_ZC_THRESHOLD_DEFAULT;
+				break;
+				
+			/*implies --zerocopy*/
+			case 56:
+				if (ECHO_OK != echoSizeParse(optarg, ECHO_BUFSIZE_MAX, &size) || size == 0)
+					exit(1);
+				stConfig.zeroCopy = size;
+				break;
+				
+			case 57:
+				sscanf (optarg, "%d", &stClientConfig.connections);
+				iMode = 'I';
 				break;
 				
 			default:
@@ -505,5 +1321,66 @@ int main( int argc, char** argv)
 		}
 	}
 	
+	switch(iMode)
+	{
+		/*the server logs through the asynchronous writer, the client
+		  modes print their results directly*/
+		case 's':
+			/*plain TCP and TLS can not share a port*/
+			if (stConfig.tlsPort == stConfig.port)
+				return 1;
+			if (ECHO_OK != echoLogStart(szLogFile))
+				return 1;
+			/*the reason is still queued in the log rings*/
+			if (ECHO_OK != echoServersStart(&stConfig))
+			{
+				echoLogStop();
+				return 1;
+			}
+			break;
+		
+		/*client arguments: <ip> <protocol> <message> <timeout>*/
+		case 'c':
+			if(argc - optind == 4)
+				echoClientStart(&argv[optind], &stClientConfig);
+			break;
+		
+		/*load generator arguments: <ip> <protocol>*/
+		case 'l':
+			if(argc - optind == 2)
+				return echoLoadStart(&argv[optind], &stClientConfig) == ECHO_OK ? 0 : 1;
+			break;
+		
+		/*ping arguments: <ip> <protocol>*/
+		case 'p':
+			if(argc - optind == 2)
+				return echoPingStart(&argv[optind], &stClientConfig) == ECHO_OK ? 0 : 1;
+			break;
+		
+		/*churn arguments: <ip> <protocol>*/
+		case 'C':
+			if(argc - optind == 2)
+				return echoChurnStart(&argv[optind], &stClientConfig) == ECHO_OK ? 0 : 1;
+			break;
+		
+		/*stream arguments: <ip> <protocol>*/
+		case 'T':
+			if(argc - optind == 2)
+				return echoStreamStart(&argv[optind], &stClientConfig) == ECHO_OK ? 0 : 1;
+			break;
+		
+		/*idle connections arguments: <ip> <protocol>*/
+		case 'I':
+			if(argc - optind == 2)
+				return echoIdleStart(&argv[optind], &stClientConfig) == ECHO_OK ? 0 : 1;
+			break;
+		
+		/*counters of the running server, sampled every --stats-interval
+		  seconds, --count times (default until the server exits)*/
+		case 'S':
+			return echoStatsWatch(stConfig.statsInterval > 0 ? stConfig.statsInterval : ECHO_STATS_INTERVAL_DEFAULT,
+								  statsCount, stConfig.port) == ECHO_OK ? 0 : 1;
+	}
+	
 	return 1;
 }
@@ -0,0 +1,461 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <math.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "echo_main.h"
+#include "echo_ping.h"
+#include "echo_reflect.h"
+#include "echo_shm.h"
+#include "echo_tls.h"
+
+static volatile sig_atomic_t pingStop = 0;
+
+static void echoPingSigint(int sig)
+{
+	pingStop = 1;
+}
+
+/*Match the TX timestamps on the error queue to their probes; returns how
+  many were read*/
+static int echoPingTxDrain(int sockfd, echoPingTimestamps *pTs, int sent)
+{
+	unsigned long long ns = 0;
+	unsigned int key = 0;
+	int seq = 0;
+	int n = 0;
+
+	while (ECHO_OK == echoClientTxTimestamp(sockfd, &key, &ns))
+	{
+		n++;
+		/*a key that matches no probe (e.g. of a retransmission) is ignored*/
+		for (seq = pTs->txSeq; seq < sent && pTs->pTxKey[seq] != key; seq++);
+		if (seq == sent)
+			continue;
+		pTs->pTxNs[seq] = ns;
+		pTs->txSeq = seq + 1;
+	}
+
+	return n;
+}
+
+/*Split the RTT of a reflected probe into forward path, server dwell and
+  return path. Dwell uses the server clock only; forward and return
+  compare the two hosts' clocks, so they are as good as their sync*/
+static void echoPingReflectLegs(echoPingStats *pStats, echoReflectHeader *pHdr, unsigned long long clientTxNs,
+								unsigned long long clientRxNs, char *szLegs, int size)
+{
+	long long fwd = (long long)(be64toh(pHdr->serverRxNs) - clientTxNs);
+	long long dwell = (long long)(be64toh(pHdr->serverTxNs) - be64toh(pHdr->serverRxNs));
+	long long ret = (long long)(clientRxNs - be64toh(pHdr->serverTxNs));
+
+	if (pStats->reflected == 0 || fwd < pStats->fwdMin)
+		pStats->fwdMin = fwd;
+	if (pStats->reflected == 0 || ret < pStats->retMin)
+		pStats->retMin = ret;
+	if (pStats->reflected == 0 || dwell > pStats->dwellMax)
+		pStats->dwellMax = dwell;
+	pStats->reflected++;
+	pStats->fwdSum += fwd;
+	pStats->dwellSum += dwell;
+	pStats->retSum += ret;
+
+	snprintf(szLegs, size, " fwd=%.3f dwell=%.3f ret=%.3f ms", fwd / 1e6, dwell / 1e6, ret / 1e6);
+}
+
+/*Account one echoed probe; the RTT is taken from the local send time of
+  the sequence number, the copy in the payload is only checked. With
+  timestamps (pTs) the wire RTT is the kernel RX time of the echo minus
+  the kernel TX time of the probe*/
+static void echoPingReply(echoClientGlobal_t *clData, echoPingStats *pStats, unsigned long long *pSentNs,
+						  char *pState, char *pProbe, int len, int *pMaxSeq, unsigned long long *pLastRtt,
+						  echoPingTimestamps *pTs, unsigned long long rxNs)
+{
+	echoPingProbe probe;
+	echoReflectHeader hdr;
+	char szWire[48] = "";
+	char szLegs[64] = "";
+	unsigned long long rtt = 0;
+	unsigned long long wire = 0;
+	unsigned long long now = echoClientNowNs();
+	unsigned long long wallNs = echoReflectNowNs();
+
+	/*a reflected probe: the server rewrote its part of the header, only
+	  the client part is checked*/
+	bzero(&hdr, sizeof hdr);
+	if (clData->config.reflect)
+	{
+		memcpy(&hdr, pProbe, len < (int)sizeof hdr ? 0 : sizeof hdr);
+		probe.magic = be32toh(hdr.magic) == ECHO_REFLECT_MAGIC ? ECHO_PING_MAGIC : 0;
+		probe.seq = be32toh(hdr.seq);
+		probe.sentNs = probe.seq < (unsigned int)pStats->sent ? pSentNs[probe.seq] : 0;
+	}
+	else
+		memcpy(&probe, pProbe, sizeof probe);
+
+	if (len != clData->config.size || probe.magic != ECHO_PING_MAGIC || probe.seq >= (unsigned int)pStats->sent ||
+		probe.sentNs != pSentNs[probe.seq])
+	{
+		pStats->corrupted++;
+		log_echo("corrupted echo, %d bytes", len);
+		return;
+	}
+
+	if (clData->config.reflect && hdr.serverTxNs == 0)
+	{
+		pStats->corrupted++;
+		log_echo("seq=%u was not stamped, is the server started with --reflect?", probe.seq);
+		return;
+	}
+
+	switch (pState[probe.seq])
+	{
+		case ECHO_PING_RECEIVED:
+			pStats->duplicates++;
+			log_echo("seq=%u duplicate", probe.seq);
+			return;
+
+		case ECHO_PING_LOST:
+			pStats->late++;
+			log_echo("seq=%u late, %.3f ms", probe.seq, (now - pSentNs[probe.seq]) / 1e6);
+			return;
+	}
+
+	pState[probe.seq] = ECHO_PING_RECEIVED;
+	rtt = now - pSentNs[probe.seq];
+
+	if ((int)probe.seq < *pMaxSeq)
+		pStats->reordered++;
+	else
+		*pMaxSeq = probe.seq;
+
+	if (pStats->received > 0)
+	{
+		pStats->jitterSum += rtt > *pLastRtt ? rtt - *pLastRtt : *pLastRtt - rtt;
+		pStats->jitterCount++;
+	}
+	*pLastRtt = rtt;
+
+	pStats->received++;
+	pStats->rttSum += rtt;
+	pStats->rttSumSq += (double)rtt * rtt;
+	if (rtt < pStats->rttMin)
+		pStats->rttMin = rtt;
+	if (rtt > pStats->rttMax)
+		pStats->rttMax = rtt;
+
+	if (pTs && rxNs && pTs->pTxNs[probe.seq] && rxNs > pTs->pTxNs[probe.seq])
+	{
+		wire = rxNs - pTs->pTxNs[probe.seq];
+		pStats->wireReceived++;
+		pStats->wireSum += wire;
+		pStats->wireSumSq += (double)wire * wire;
+		pStats->overheadSum += rtt > wire ? rtt - wire : 0;
+		if (wire < pStats->wireMin)
+			pStats->wireMin = wire;
+		if (wire > pStats->wireMax)
+			pStats->wireMax = wire;
+		snprintf(szWire, sizeof szWire, " wire=%.3f ms", wire / 1e6);
+	}
+
+	/*kernel times are closer to the wire than the client's own clock reads*/
+	if (clData->config.reflect)
+		echoPingReflectLegs(pStats, &hdr, pTs && pTs->pTxNs[probe.seq] ? pTs->pTxNs[probe.seq] : be64toh(hdr.clientTxNs),
+							rxNs ? rxNs : wallNs, szLegs, sizeof szLegs);
+
+	log_echo("%d bytes from %s: seq=%u time=%.3f ms%s%s%s", len, clData->szServer, probe.seq,
+			 rtt / 1e6, szWire, szLegs, (int)probe.seq < *pMaxSeq ? " (reordered)" : "");
+}
+
+static void echoPingReport(echoClientGlobal_t *clData, echoPingStats *pStats)
+{
+	double avg = 0;
+	double mdev = 0;
+
+	log_echo("--- %s echo ping statistics ---", clData->szServer);
+	log_echo("%d probes sent, %d received, %.1f%% loss, %d late, %d reordered, %d duplicates, %d corrupted",
+			 pStats->sent, pStats->received,
+			 pStats->sent ? 100.0 * (pStats->sent - pStats->received) / pStats->sent : 0.0,
+			 pStats->late, pStats->reordered, pStats->duplicates, pStats->corrupted);
+
+	if (pStats->received == 0)
+		return;
+
+	avg = pStats->rttSum / pStats->received;
+	mdev = sqrt(fmax(pStats->rttSumSq / pStats->received - avg * avg, 0));
+	log_echo("rtt min/avg/max/mdev = %.3f/%.3f/%.3f/%.3f ms, jitter %.3f ms",
+			 pStats->rttMin / 1e6, avg / 1e6, pStats->rttMax / 1e6, mdev / 1e6,
+			 pStats->jitterCount ? pStats->jitterSum / pStats->jitterCount / 1e6 : 0.0);
+
+	if (pStats->reflected > 0)
+		log_echo("forward avg/min %.3f/%.3f ms, server dwell avg/max %.3f/%.3f ms, return avg/min %.3f/%.3f ms",
+				 pStats->fwdSum / pStats->reflected / 1e6, pStats->fwdMin / 1e6, pStats->dwellSum / pStats->reflected / 1e6,
+				 pStats->dwellMax / 1e6, pStats->retSum / pStats->reflected / 1e6, pStats->retMin / 1e6);
+
+	if (!clData->config.timestamping)
+		return;
+	if (pStats->wireReceived == 0)
+	{
+		log_echo("wire rtt: no kernel timestamps received");
+		return;
+	}
+
+	/*the host overhead is what the application adds to the wire RTT:
+	  syscalls, wakeups and scheduling on this side*/
+	avg = pStats->wireSum / pStats->wireReceived;
+	mdev = sqrt(fmax(pStats->wireSumSq / pStats->wireReceived - avg * avg, 0));
+	log_echo("wire rtt min/avg/max/mdev = %.3f/%.3f/%.3f/%.3f ms (%d echoes), host overhead avg %.3f ms",
+			 pStats->wireMin / 1e6, avg / 1e6, pStats->wireMax / 1e6, mdev / 1e6, pStats->wireReceived,
+			 pStats->overheadSum / pStats->wireReceived / 1e6);
+}
+
+/***********************************************************************
+* Function Name  : echoPingStart()
+* Description    : Ping mode of the echo client
+* Input          : arg_values - <ip> <protocol>
+				   pConfig - count, interval, per-probe timeout and
+				   payload size
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : One socket is opened (and for TCP connected) before
+				   the first probe, so the handshake (with --tls the TLS
+				   one as well) is not part of any RTT. Probes carry a sequence number and are sent every
+				   interval ms whether or not the previous one returned;
+				   a probe without echo after timeout ms is lost. The
+				   jitter is the mean difference between the RTTs of
+				   consecutive echoes. With timestamping the kernel's
+				   software TX/RX times give the wire RTT next to the
+				   application RTT. Reflector probes (UDP) come back
+				   with the server's receive and send times, which
+				   split the RTT into forward, dwell and return. Over
+				   shared memory (shm) the wait is on the echo ring
+				   instead of the socket, with --busy-poll spinning;
+************************************************************************/
+ECHO_STATUS echoPingStart(char **arg_values, echoClientConfig *pConfig)
+{
+	echoClientGlobal_t *clData = NULL;
+	echoPingStats stats;
+	echoPingProbe probe;
+	echoReflectHeader hdr;
+	echoPingTimestamps timestamps;
+	echoPingTimestamps *pTs = NULL;
+	struct pollfd pfd;
+	struct timespec wait;
+	struct iovec iov;
+	struct msghdr msg;
+	char control[ECHO_CMSG_TIMESTAMP_SPACE];
+	unsigned long long *pSentNs = NULL;
+	unsigned long long intervalNs = (unsigned long long)pConfig->interval * 1000000ULL;
+	unsigned long long timeoutNs = (unsigned long long)pConfig->timeoutMs * 1000000ULL;
+	unsigned long long nextNs = 0;
+	unsigned long long wakeNs = 0;
+	unsigned long long lastRtt = 0;
+	unsigned long long now = 0;
+	unsigned long long rxNs = 0;
+	char *pState = NULL;
+	char *pTxBuf = NULL;
+	char *pRxBuf = NULL;
+	int rxLen = 0;
+	int oldest = 0; /*first probe that may still be pending*/
+	int maxSeq = -1;
+	int n = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (ECHO_OK != (iRet = echoClientGlobalInit(&clData)))
+		return iRet;
+
+	clData->config = *pConfig;
+	if (ECHO_OK != (iRet = echoClientSetServer(clData, arg_values[0], arg_values[1])) ||
+		pConfig->count < 1 || pConfig->interval < 0 || pConfig->timeoutMs < 1 ||
+		pConfig->size < (int)(pConfig->reflect ? sizeof(echoReflectHeader) : sizeof(echoPingProbe)) ||
+		pConfig->size > ECHO_BUFSIZE || (pConfig->reflect && clData->protocol != IPPROTO_UDP) ||
+		(pConfig->timestamping && clData->protocol == ECHO_PROTO_SHM))
+	{
+		log_echo("%s", arrErrors[ECHO_BAD_PARAM]);
+		return ECHO_BAD_PARAM;
+	}
+
+	/*the probes are sent and timed by this thread; pinned before the
+	  buffers are touched, they land on its NUMA node*/
+	if (ECHO_OK != (iRet = echoAffinityPinSelf(&pConfig->cpus)))
+		return iRet;
+
+	pSentNs = calloc(pConfig->count, sizeof(unsigned long long));
+	pState = calloc(pConfig->count, 1);
+	pTxBuf = calloc(1, pConfig->size);
+	pRxBuf = malloc(ECHO_BUFSIZE);
+	if (!pSentNs || !pState || !pTxBuf || !pRxBuf)
+		return ECHO_NO_MEM_ERR;
+
+	if (ECHO_OK != (iRet = echoClientOpen(clData)))
+		return iRet;
+	if (clData->protocol == IPPROTO_TCP && clData->servAddr.sa.sa_family == AF_INET)
+		setsockopt(clData->sockfd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+	if (pConfig->timestamping)
+	{
+		if (ECHO_OK != (iRet = echoClientTimestampEnable(clData->sockfd)))
+			return iRet;
+		bzero(&timestamps, sizeof timestamps);
+		timestamps.pTxNs = calloc(pConfig->count, sizeof(unsigned long long));
+		timestamps.pTxKey = calloc(pConfig->count, sizeof(unsigned int));
+		if (!timestamps.pTxNs || !timestamps.pTxKey)
+			return ECHO_NO_MEM_ERR;
+		pTs = &timestamps;
+	}
+
+	bzero(&stats, sizeof stats);
+	stats.rttMin = ~0ULL;
+	stats.wireMin = ~0ULL;
+	memset(pTxBuf + sizeof probe, 'p', pConfig->size - sizeof probe);
+	signal(SIGINT, echoPingSigint);
+
+	log_echo("ECHO PING %s %s: %d bytes, %d probes every %d ms, timeout %d ms", clData->szServer,
+			 echoClientProtoName(clData), pConfig->size, pConfig->count, pConfig->interval, pConfig->timeoutMs);
+
+	pfd.fd = clData->sockfd;
+	pfd.events = POLLIN;
+	nextNs = echoClientNowNs();
+
+	while (!pingStop && (stats.sent < pConfig->count || oldest < stats.sent))
+	{
+		now = echoClientNowNs();
+
+		if (stats.sent < pConfig->count && now >= nextNs)
+		{
+			probe.magic = ECHO_PING_MAGIC;
+			probe.seq = stats.sent;
+			probe.sentNs = now;
+			if (pConfig->reflect)
+			{
+				bzero(&hdr, sizeof hdr);
+				hdr.magic = htobe32(ECHO_REFLECT_MAGIC);
+				hdr.seq = htobe32(probe.seq);
+				hdr.clientTxNs = htobe64(echoReflectNowNs());
+				memcpy(pTxBuf, &hdr, sizeof hdr);
+			}
+			else
+				memcpy(pTxBuf, &probe, sizeof probe);
+
+			pSentNs[stats.sent] = now;
+			pState[stats.sent] = ECHO_PING_PENDING;
+			stats.sent++;
+			nextNs += intervalNs;
+
+			if (clData->protocol == ECHO_PROTO_SHM)
+				n = ECHO_OK == echoShmSend(clData->pShm, pTxBuf, pConfig->size) ? pConfig->size : -1;
+			else
+				n = echoTlsSend(clData->pTls, clData->sockfd, pTxBuf, pConfig->size);
+			if (n != pConfig->size)
+				log_echo("seq=%u send failed errno %d", probe.seq, errno);
+
+			/*the key the kernel will tag the TX time with: the number of the
+			  datagram, or the offset of the last byte in the stream*/
+			if (pTs)
+			{
+				pTs->pTxKey[probe.seq] = n == pConfig->size ? pTs->nextKey + (clData->protocol == IPPROTO_TCP ? n - 1 : 0) : ~0U;
+				if (n > 0)
+					pTs->nextKey += clData->protocol == IPPROTO_TCP ? n : 1;
+			}
+			continue;
+		}
+
+		/*probes are sent in order, so they time out in order*/
+		for (; oldest < stats.sent && pState[oldest] != ECHO_PING_PENDING; oldest++);
+		while (oldest < stats.sent && pState[oldest] == ECHO_PING_PENDING && now - pSentNs[oldest] >= timeoutNs)
+		{
+			pState[oldest] = ECHO_PING_LOST;
+			stats.lost++;
+			log_echo("seq=%d timed out", oldest);
+			for (oldest++; oldest < stats.sent && pState[oldest] != ECHO_PING_PENDING; oldest++);
+		}
+
+		wakeNs = ~0ULL;
+		if (stats.sent < pConfig->count)
+			wakeNs = nextNs;
+		if (oldest < stats.sent && pSentNs[oldest] + timeoutNs < wakeNs)
+			wakeNs = pSentNs[oldest] + timeoutNs;
+		if (wakeNs == ~0ULL)
+			break;
+
+		/*a shared-memory echo is complete as soon as it is on the ring*/
+		if (clData->protocol == ECHO_PROTO_SHM)
+		{
+			if (echoShmWait(clData->pShm, wakeNs))
+			{
+				n = echoShmRecv(clData->pShm, pRxBuf, ECHO_BUFSIZE);
+				echoPingReply(clData, &stats, pSentNs, pState, pRxBuf, n, &maxSeq, &lastRtt, NULL, 0);
+			}
+			continue;
+		}
+
+		wait.tv_sec = wakeNs > now ? (wakeNs - now) / 1000000000ULL : 0;
+		wait.tv_nsec = wakeNs > now ? (wakeNs - now) % 1000000000ULL : 0;
+		if (ppoll(&pfd, 1, &wait, NULL) <= 0)
+			continue;
+
+		/*TX timestamps wake the poll with POLLERR*/
+		if (pTs && (pfd.revents & POLLERR) && echoPingTxDrain(clData->sockfd, pTs, stats.sent) > 0 &&
+			!(pfd.revents & POLLIN))
+			continue;
+
+		iov.iov_base = pRxBuf + rxLen;
+		iov.iov_len = clData->protocol == IPPROTO_TCP ? pConfig->size - rxLen : ECHO_BUFSIZE;
+		bzero(&msg, sizeof msg);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof control;
+		/*a TLS record is read whole, the socket said one arrived*/
+		if (clData->pTls)
+			n = echoTlsRecv(clData->pTls, clData->sockfd, iov.iov_base, iov.iov_len);
+		else
+			n = recvmsg(clData->sockfd, &msg, MSG_DONTWAIT);
+		if (n == 0 && clData->protocol == IPPROTO_TCP)
+		{
+			log_echo("Connection closed by the server");
+			break;
+		}
+		if (n < 0)
+		{
+			/*ECONNREFUSED - nothing listens on the UDP port, the probe will time out*/
+			if (errno != EINTR && errno != EAGAIN && errno != ECONNREFUSED)
+				log_echo("recv failed errno %d", errno);
+			continue;
+		}
+
+		/*TCP: a probe is complete once size bytes of the stream arrived*/
+		if (clData->protocol == IPPROTO_TCP)
+		{
+			rxLen += n;
+			if (rxLen < pConfig->size)
+				continue;
+			n = rxLen;
+			rxLen = 0;
+		}
+
+		/*the probe's TX time was queued before its echo could come back*/
+		rxNs = 0;
+		if (pTs)
+		{
+			rxNs = echoClientCmsgTimestamp(&msg);
+			echoPingTxDrain(clData->sockfd, pTs, stats.sent);
+		}
+
+		echoPingReply(clData, &stats, pSentNs, pState, pRxBuf, n, &maxSeq, &lastRtt, pTs, rxNs);
+	}
+
+	echoClientClose(clData);
+	echoPingReport(clData, &stats);
+	echoTlsClientReport();
+
+	return stats.received == stats.sent ? ECHO_OK : ECHO_RCV_ERR;
+}
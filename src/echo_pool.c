@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+
+/***********************************************************************
+* Function Name  : echoPoolRegionAlloc()
+* Description    : Map memory for buffers that live as long as the server
+* Input          : size - bytes needed
+				   hugePages - back the region with 2 MB pages
+				   pMapped - bytes actually mapped, for echoPoolRegionFree()
+* Return         : the region, NULL on failure
+* Logic          : The pages are populated up front, so the echo path does
+				   not take page faults. MAP_HUGETLB needs pages reserved in
+				   /proc/sys/vm/nr_hugepages; without them the region falls
+				   back to normal pages and asks for transparent huge pages;
+************************************************************************/
+void *echoPoolRegionAlloc(size_t size, int hugePages, size_t *pMapped)
+{
+	void *pRegion = MAP_FAILED;
+	size_t mapped = ECHO_ALIGN_UP(size, sysconf(_SC_PAGESIZE));
+
+	if (hugePages)
+	{
+		pRegion = mmap(NULL, ECHO_ALIGN_UP(size, ECHO_HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+		if (pRegion != MAP_FAILED)
+			mapped = ECHO_ALIGN_UP(size, ECHO_HUGE_PAGE_SIZE);
+		else
+			log_echo_warn("MAP_HUGETLB of %zu bytes failed errno %d, using normal pages", size, errno);
+	}
+
+	if (pRegion == MAP_FAILED)
+	{
+		pRegion = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (pRegion == MAP_FAILED)
+			return NULL;
+
+		/*THP has to be requested before the pages are touched*/
+		if (hugePages)
+			madvise(pRegion, mapped, MADV_HUGEPAGE);
+		madvise(pRegion, mapped, MADV_WILLNEED);
+		memset(pRegion, 0, mapped);
+	}
+
+	*pMapped = mapped;
+	return pRegion;
+}
+
+void echoPoolRegionFree(void *pRegion, size_t mapped)
+{
+	if (pRegion)
+		munmap(pRegion, mapped);
+}
+
+/***********************************************************************
+* Function Name  : echoBufPoolInit()
+* Description    : Preallocate a pool of buffers
+* Input          : pPool - the pool
+				   count - number of buffers
+				   bufSize - usable bytes of one buffer
+				   hugePages - see echoPoolRegionAlloc()
+* Return         : ECHO_STATUS to indicate error/success
+************************************************************************/
+ECHO_STATUS echoBufPoolInit(echoBufPool *pPool, int count, unsigned int bufSize, int hugePages)
+{
+	int i = 0;
+
+	bzero(pPool, sizeof(echoBufPool));
+	pPool->count = count;
+	pPool->hugePages = hugePages;
+	pPool->bufSize = bufSize;
+	pPool->stride = ECHO_ALIGN_UP(bufSize, ECHO_CACHE_LINE);
+
+	if (NULL == (pPool->bufs = calloc(count, sizeof(echoBuf))))
+		return ECHO_NO_MEM_ERR;
+
+	if (NULL == (pPool->region = echoPoolRegionAlloc(pPool->stride * count, hugePages, &pPool->regionSize)))
+	{
+		log_echo_err("Could not map %d buffers of %u bytes", count, bufSize);
+		free(pPool->bufs);
+		pPool->bufs = NULL;
+		return ECHO_NO_MEM_ERR;
+	}
+
+	/*Push in reverse, so buffers are handed out in address order*/
+	for (i = count - 1; i >= 0; i--)
+	{
+		pPool->bufs[i].data = pPool->region + (size_t)i * pPool->stride;
+		pPool->bufs[i].cap = bufSize;
+		echoBufPut(pPool, &pPool->bufs[i]);
+	}
+
+	return ECHO_OK;
+}
+
+/***********************************************************************
+* Function Name  : echoBufPoolGrow()
+* Description    : Add buffers to a pool whose buffers are all in use
+* Input          : pPool - the pool
+				   count - number of buffers to add
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The new buffers get a mapping of their own, so the
+				   buffers handed out stay where they are; the chunk
+				   is kept until the pool is released;
+************************************************************************/
+ECHO_STATUS echoBufPoolGrow(echoBufPool *pPool, int count)
+{
+	echoBufChunk *pChunk = NULL;
+	int i = 0;
+
+	if (NULL == (pChunk = calloc(1, sizeof(echoBufChunk) + count * sizeof(echoBuf))))
+		return ECHO_NO_MEM_ERR;
+
+	if (NULL == (pChunk->region = echoPoolRegionAlloc(pPool->stride * count, pPool->hugePages, &pChunk->regionSize)))
+	{
+		log_echo_err("Could not map %d more buffers of %u bytes", count, pPool->bufSize);
+		free(pChunk);
+		return ECHO_NO_MEM_ERR;
+	}
+
+	for (i = count - 1; i >= 0; i--)
+	{
+		pChunk->bufs[i].data = pChunk->region + (size_t)i * pPool->stride;
+		pChunk->bufs[i].cap = pPool->bufSize;
+		echoBufPut(pPool, &pChunk->bufs[i]);
+	}
+
+	pChunk->next = pPool->pChunks;
+	pPool->pChunks = pChunk;
+	pPool->count += count;
+	return ECHO_OK;
+}
+
+void echoBufPoolRelease(echoBufPool *pPool)
+{
+	echoBufChunk *pChunk = NULL;
+
+	while ((pChunk = pPool->pChunks))
+	{
+		pPool->pChunks = pChunk->next;
+		echoPoolRegionFree(pChunk->region, pChunk->regionSize);
+		free(pChunk);
+	}
+	echoPoolRegionFree(pPool->region, pPool->regionSize);
+	free(pPool->bufs);
+	bzero(pPool, sizeof(echoBufPool));
+}
+
+/*Take an idle buffer, NULL when all of them are in use. The free list is
+  LIFO, so the buffer returned last - still warm in the cache - is reused first*/
+echoBuf *echoBufGet(echoBufPool *pPool)
+{
+	echoBuf *pBuf = pPool->freeList;
+
+	if (pBuf == NULL)
+		return NULL;
+
+	pPool->freeList = pBuf->next;
+	pPool->freeCount--;
+	pBuf->next = NULL;
+	pBuf->len = 0;
+	return pBuf;
+}
+
+void echoBufPut(echoBufPool *pPool, echoBuf *pBuf)
+{
+	pBuf->next = pPool->freeList;
+	pPool->freeList = pBuf;
+	pPool->freeCount++;
+}
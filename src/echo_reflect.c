@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include "echo_main.h"
+#include "echo_reflect.h"
+
+/*Wall clock in ns - the reflector and the client compare their times,
+  so both use CLOCK_REALTIME (kept in sync by NTP/PTP between hosts)*/
+unsigned long long echoReflectNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*Have the kernel stamp every datagram the UDP socket receives*/
+ECHO_STATUS echoReflectEnable(int udpSocket)
+{
+	if (setsockopt(udpSocket, SOL_SOCKET, SO_TIMESTAMPNS, &(int){1}, sizeof(int)) < 0)
+	{
+		log_echo_warn("setsockopt(SO_TIMESTAMPNS) failed errno %d, the reflector takes its own receive times", errno);
+		return ECHO_SET_SOCK_FLG_ERR;
+	}
+
+	return ECHO_OK;
+}
+
+/*Kernel receive time of a datagram read with recvmsg(); 0 if it has none*/
+unsigned long long echoReflectRxNs(struct msghdr *pMsg)
+{
+	struct cmsghdr *pCmsg = NULL;
+	struct timespec ts;
+
+	for (pCmsg = CMSG_FIRSTHDR(pMsg); pCmsg != NULL; pCmsg = CMSG_NXTHDR(pMsg, pCmsg))
+	{
+		if (pCmsg->cmsg_level == SOL_SOCKET && pCmsg->cmsg_type == SCM_TIMESTAMPNS)
+		{
+			memcpy(&ts, CMSG_DATA(pCmsg), sizeof ts);
+			return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		}
+	}
+
+	return 0;
+}
+
+/***********************************************************************
+* Function Name  : echoReflectStamp()
+* Description    : Stamp a reflector test datagram before it is echoed
+* Input          : pData, len - the received datagram
+				   rxNs - its receive time, 0 - unknown (taken now)
+				   pSeq - reflector counter of the calling thread
+* Return         : 1 if the datagram was stamped, 0 if it is not a test
+				   datagram and goes back unchanged
+* Logic          : The header may sit at any alignment in the buffer,
+				   so it is copied out and back;
+************************************************************************/
+int echoReflectStamp(char *pData, unsigned int len, unsigned long long rxNs, unsigned int *pSeq)
+{
+	echoReflectHeader hdr;
+
+	if (len < sizeof hdr)
+		return 0;
+
+	memcpy(&hdr, pData, sizeof hdr);
+	if (be32toh(hdr.magic) != ECHO_REFLECT_MAGIC)
+		return 0;
+
+	hdr.serverSeq = htobe32((*pSeq)++);
+	hdr.reserved = 0;
+	hdr.serverRxNs = htobe64(rxNs ? rxNs : echoReflectNowNs());
+	hdr.serverTxNs = htobe64(echoReflectNowNs());
+	memcpy(pData, &hdr, sizeof hdr);
+
+	return 1;
+}
@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "echo_main.h"
+#include "echo_shm.h"
+
+/*Pause between two polls of a spinning thread*/
+#if defined(__x86_64__) || defined(__i386__)
+#define ECHO_SHM_RELAX() __builtin_ia32_pause()
+#else
+#define ECHO_SHM_RELAX() __asm__ __volatile__("" ::: "memory")
+#endif
+
+#define ECHO_SHM_WORD(pRing, off) (*(unsigned int *)((pRing)->data + (off)))
+#define ECHO_SHM_RECORD(len) ECHO_ALIGN_UP((len) + sizeof(unsigned int), ECHO_SHM_ALIGN)
+
+/*The rings live in a MAP_SHARED mapping of several processes, so the
+  futexes are not FUTEX_PRIVATE*/
+static int echoShmFutex(unsigned int *pWord, int op, unsigned int val, const struct timespec *pTimeout)
+{
+	return (int)syscall(SYS_futex, pWord, op, val, pTimeout, NULL, 0);
+}
+
+static void echoShmName(char *szName, size_t size, const char *szShm)
+{
+	snprintf(szName, size, "/%s", szShm);
+}
+
+/*Room for a message of len bytes, NULL if the ring is full; *pHead is
+  the head that publishes it. A message that does not fit before the end
+  of the ring is preceded by a filler and starts at offset 0*/
+static char *echoShmRingReserve(echoShmRing *pRing, unsigned int len, unsigned int *pHead)
+{
+	unsigned int need = ECHO_SHM_RECORD(len);
+	unsigned int head = pRing->head;
+	unsigned int tail = __atomic_load_n(&pRing->tail, __ATOMIC_ACQUIRE);
+	unsigned int off = head & (ECHO_SHM_RING_SIZE - 1);
+	unsigned int skip = ECHO_SHM_RING_SIZE - off < need ? ECHO_SHM_RING_SIZE - off : 0;
+
+	if (ECHO_SHM_RING_SIZE - (head - tail) < skip + need)
+		return NULL;
+
+	if (skip)
+	{
+		ECHO_SHM_WORD(pRing, off) = ECHO_SHM_WRAP;
+		head += skip;
+		off = 0;
+	}
+
+	ECHO_SHM_WORD(pRing, off) = len;
+	*pHead = head + need;
+	return pRing->data + off + sizeof(unsigned int);
+}
+
+/*Oldest message of the ring, NULL if the ring is empty*/
+static char *echoShmRingPeek(echoShmRing *pRing, unsigned int *pLen)
+{
+	unsigned int tail = pRing->tail;
+	unsigned int head = __atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE);
+	unsigned int off = tail & (ECHO_SHM_RING_SIZE - 1);
+
+	if (tail == head)
+		return NULL;
+
+	/*a filler is always published together with the message after it*/
+	if (ECHO_SHM_WORD(pRing, off) == ECHO_SHM_WRAP)
+	{
+		__atomic_store_n(&pRing->tail, tail + ECHO_SHM_RING_SIZE - off, __ATOMIC_RELEASE);
+		off = 0;
+	}
+
+	*pLen = ECHO_SHM_WORD(pRing, off);
+	return pRing->data + off + sizeof(unsigned int);
+}
+
+/*Free the message returned by echoShmRingPeek()*/
+static void echoShmRingConsume(echoShmRing *pRing, unsigned int len)
+{
+	__atomic_store_n(&pRing->tail, pRing->tail + ECHO_SHM_RECORD(len), __ATOMIC_RELEASE);
+}
+
+/*Publish up to head; the consumer is only woken when it went to sleep.
+  The store of head and the load of waiting are ordered against the
+  consumer's store of waiting and load of head, so one of the two sides
+  always sees the other*/
+static void echoShmRingPublish(echoShmRing *pRing, unsigned int head)
+{
+	__atomic_store_n(&pRing->head, head, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pRing->waiting, __ATOMIC_SEQ_CST))
+		echoShmFutex(&pRing->head, FUTEX_WAKE, 1, NULL);
+}
+
+/*Echo every request of one channel into its echo ring; returns the
+  messages echoed, *pFull is set when the client's ring had no room*/
+static int echoShmEchoChannel(echoShmServer *pServer, echoShmChannel *pChan, int *pFull)
+{
+	unsigned int len = 0;
+	unsigned int head = 0;
+	char *pIn = NULL;
+	char *pOut = NULL;
+	int moved = 0;
+
+	while (NULL != (pIn = echoShmRingPeek(&pChan->toServer, &len)))
+	{
+		if (NULL == (pOut = echoShmRingReserve(&pChan->toClient, len, &head)))
+		{
+			*pFull = 1;
+			break;
+		}
+
+		/*the only copy of the echo: request ring -> echo ring. The echo
+		  is out before the request is consumed, so a client that finds
+		  the requests of a channel gone also finds all their echoes*/
+		memcpy(pOut, pIn, len);
+		__atomic_store_n(&pChan->toClient.head, head, __ATOMIC_RELEASE);
+		echoShmRingConsume(&pChan->toServer, len);
+		ECHO_STAT_ADD(pServer->pStats->bytesIn, len);
+		ECHO_STAT_ADD(pServer->pStats->bytesOut, len);
+		moved++;
+	}
+
+	if (moved)
+	{
+		echoShmRingPublish(&pChan->toClient, pChan->toClient.head);
+		ECHO_STAT_ADD(pServer->pStats->ipcMessages, moved);
+	}
+
+	return moved;
+}
+
+/*Any channel with a request the server did not take yet*/
+static int echoShmPending(echoShmSegment *pSeg)
+{
+	int i = 0;
+
+	for (i = 0; i < ECHO_SHM_CHANNELS; i++)
+	{
+		if (__atomic_load_n(&pSeg->channel[i].toServer.head, __ATOMIC_SEQ_CST) != pSeg->channel[i].toServer.tail)
+			return 1;
+	}
+
+	return 0;
+}
+
+/************************************************************************
+* Function Name  : echoShmWorker()
+* Description    : A function that will be executed by pthread; echoes
+				   the messages of every shared-memory channel
+* Input          : pServerPar - the server thread with the segment
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The channels are polled in turn while any of them
+				   has requests; with --busy-poll the thread keeps
+				   polling that long after the last one. Then it sets
+				   serverWaiting and sleeps on the doorbell, which the
+				   next client that sends rings. A client whose echo
+				   ring is full is retried every ECHO_SHM_FULL_WAIT_MS;
+*************************************************************************/
+void *echoShmWorker(void *pServerPar)
+{
+	echoShmServer *pServer = (echoShmServer *)pServerPar;
+	echoShmSegment *pSeg = pServer->pSeg;
+	struct timespec fullWait = {0, ECHO_SHM_FULL_WAIT_MS * 1000000L};
+	unsigned int bell = 0;
+	int moved = 0;
+	int full = 0;
+	int i = 0;
+	static ECHO_STATUS ret;
+
+	log_echo("Shared-memory echo is serving %d channels on cpu %d", ECHO_SHM_CHANNELS, sched_getcpu());
+
+	while (1)
+	{
+		moved = 0;
+		full = 0;
+		for (i = 0; i < ECHO_SHM_CHANNELS; i++)
+			moved += echoShmEchoChannel(pServer, &pSeg->channel[i], &full);
+
+		if (pServer->busyPoll.spinNs)
+		{
+			echoBusyPollWoke(&pServer->busyPoll, moved);
+			echoBusyPollWorked(&pServer->busyPoll);
+		}
+		if (moved)
+			continue;
+
+		if (pServer->busyPoll.spinNs && 0 == echoBusyPollTimeout(&pServer->busyPoll, -1))
+		{
+			ECHO_SHM_RELAX();
+			continue;
+		}
+
+		/*a request published before serverWaiting was set is found by
+		  echoShmPending(), one published after it rings the doorbell*/
+		bell = __atomic_load_n(&pSeg->doorbell, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&pSeg->serverWaiting, 1, __ATOMIC_SEQ_CST);
+		if (!echoShmPending(pSeg))
+			echoShmFutex(&pSeg->doorbell, FUTEX_WAIT, bell, full ? &fullWait : NULL);
+		__atomic_store_n(&pSeg->serverWaiting, 0, __ATOMIC_RELAXED);
+	}
+
+	ret = ECHO_OK;
+	pthread_exit(&ret);
+}
+
+/*Counter slot of the shared-memory server thread*/
+int echoShmSlots(echoServerConfig *pConfig)
+{
+	return pConfig->shmName ? 1 : 0;
+}
+
+/*********************************************************************
+* Function Name  : echoShmServerStart()
+* Description    : Serve echo messages over shared-memory rings
+* Input          : pGlobal - the server, config.shmName
+				   slot - counter slot of the thread
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The object /<shmName> is recreated with every
+				   channel free and one thread serves all of them. Same
+				   host only, no socket and no syscall per message while
+				   both sides are busy - the floor of IPC latency;
+***********************************************************************/
+ECHO_STATUS echoShmServerStart(EchoGlobal_t *pGlobal, int slot)
+{
+	echoServerConfig *pConfig = &pGlobal->config;
+	echoShmServer *pServer = NULL;
+	pthread_attr_t attr;
+	char szName[256];
+	void *pMap = MAP_FAILED;
+	int fd = -1;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (!pConfig->shmName)
+		return ECHO_OK;
+
+	/*clients of other users of the group may connect*/
+	echoShmName(szName, sizeof szName, pConfig->shmName);
+	shm_unlink(szName);
+	fd = shm_open(szName, O_CREAT | O_EXCL | O_RDWR, 0660);
+	if (fd >= 0 && ftruncate(fd, sizeof(echoShmSegment)) == 0)
+		pMap = mmap(NULL, sizeof(echoShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (fd >= 0)
+		close(fd);
+	if (pMap == MAP_FAILED)
+	{
+		log_echo_err("Could not create the shared-memory echo %s errno %d", szName, errno);
+		shm_unlink(szName);
+		return ECHO_OPEN_SOCK_ERR;
+	}
+
+	if (NULL == (pServer = calloc(1, sizeof(echoShmServer))))
+		return ECHO_NO_MEM_ERR;
+
+	pServer->pSeg = (echoShmSegment *)pMap;
+	pServer->pStats = echoStatsSlotGet(slot);
+	echoBusyPollInit(&pServer->busyPoll, pConfig->busyPoll, pServer->pStats);
+	pServer->pSeg->version = ECHO_SHM_VERSION;
+	pServer->pSeg->pid = getpid();
+
+	/*a client trusts the layout only after the magic is visible*/
+	__atomic_store_n(&pServer->pSeg->magic, ECHO_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pConfig->cpus, slot)))
+		return iRet;
+	if (pthread_create(&pServer->threadId, &attr, echoShmWorker, (void*)pServer) != 0)
+		iRet = ECHO_PTHREAD_ERR;
+	pthread_attr_destroy(&attr);
+	if (ECHO_OK != iRet)
+	{
+		perror("could not create thread - echoShmWorker!");
+		return iRet;
+	}
+
+	log_echo("Shared-memory echo on /dev/shm%s, %d channels of %d KB rings", szName, ECHO_SHM_CHANNELS,
+			 ECHO_SHM_RING_SIZE / 1024);
+	return ECHO_OK;
+}
+
+/*The owner of a channel died without releasing it; a zombie nobody
+  waited for yet is as dead as a reaped process*/
+static int echoShmOwnerGone(int owner)
+{
+	char szStat[256];
+	char *pState = NULL;
+	FILE *pFile = NULL;
+	int zombie = 0;
+
+	if (owner == 0)
+		return 0;
+	if (kill(owner, 0) < 0)
+		return errno == ESRCH;
+
+	snprintf(szStat, sizeof szStat, "/proc/%d/stat", owner);
+	if (NULL == (pFile = fopen(szStat, "r")))
+		return 0;
+	if (fgets(szStat, sizeof szStat, pFile) && (pState = strrchr(szStat, ')')) != NULL)
+		zombie = pState[1] == ' ' && pState[2] == 'Z';
+	fclose(pFile);
+
+	return zombie;
+}
+
+/***********************************************************************
+* Function Name  : echoShmOpen()
+* Description    : Connect to a shared-memory echo server
+* Input          : szName - --shm name of the server
+				   spinUs - poll this long for an echo before sleeping
+				   ppConn - the new connection
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Take a free channel (or one of a client that died)
+				   by its owner word. Requests a previous owner left
+				   behind are echoed by the server and dropped here, so
+				   the first echo this client reads is its own;
+************************************************************************/
+ECHO_STATUS echoShmOpen(const char *szName, int spinUs, echoShmConn **ppConn)
+{
+	echoShmConn *pConn = NULL;
+	echoShmSegment *pSeg = NULL;
+	echoShmChannel *pChan = NULL;
+	struct stat st;
+	char szShm[256];
+	void *pMap = MAP_FAILED;
+	unsigned long long deadline = 0;
+	int tid = (int)syscall(SYS_gettid);
+	int owner = 0;
+	int fd = -1;
+	int i = 0;
+
+	echoShmName(szShm, sizeof szShm, szName);
+	if ((fd = shm_open(szShm, O_RDWR, 0)) < 0)
+	{
+		log_echo("No shared-memory echo server %s errno %d", szShm, errno);
+		return ECHO_CONNECT_ERR;
+	}
+	if (fstat(fd, &st) == 0 && st.st_size == sizeof(echoShmSegment))
+		pMap = mmap(NULL, sizeof(echoShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pMap == MAP_FAILED)
+	{
+		log_echo("%s is not a shared-memory echo of this version", szShm);
+		return ECHO_CONNECT_ERR;
+	}
+
+	pSeg = (echoShmSegment *)pMap;
+	if (__atomic_load_n(&pSeg->magic, __ATOMIC_ACQUIRE) != ECHO_SHM_MAGIC || pSeg->version != ECHO_SHM_VERSION ||
+		echoShmOwnerGone(pSeg->pid))
+	{
+		log_echo("The shared-memory echo server %s is not running", szShm);
+		munmap(pMap, sizeof(echoShmSegment));
+		return ECHO_CONNECT_ERR;
+	}
+
+	for (i = 0; i < ECHO_SHM_CHANNELS && !pChan; i++)
+	{
+		owner = __atomic_load_n(&pSeg->channel[i].owner, __ATOMIC_ACQUIRE);
+		if ((owner == 0 || echoShmOwnerGone(owner)) &&
+			__atomic_compare_exchange_n(&pSeg->channel[i].owner, &owner, tid, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+			pChan = &pSeg->channel[i];
+	}
+	if (!pChan)
+	{
+		log_echo("All %d channels of %s are taken", ECHO_SHM_CHANNELS, szShm);
+		munmap(pMap, sizeof(echoShmSegment));
+		return ECHO_CONNECT_ERR;
+	}
+
+	deadline = echoClientNowNs() + 1000000000ULL;
+	do
+	{
+		__atomic_store_n(&pChan->toClient.tail, __atomic_load_n(&pChan->toClient.head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+		if (__atomic_load_n(&pChan->toServer.tail, __ATOMIC_ACQUIRE) == pChan->toServer.head)
+			break;
+		sched_yield();
+	} while (echoClientNowNs() < deadline);
+	__atomic_store_n(&pChan->toClient.waiting, 0, __ATOMIC_RELAXED);
+
+	if (NULL == (pConn = calloc(1, sizeof(echoShmConn))))
+		return ECHO_NO_MEM_ERR;
+	pConn->pSeg = pSeg;
+	pConn->pChan = pChan;
+	pConn->spinNs = spinUs > 0 ? (unsigned long long)spinUs * 1000ULL : 0;
+	*ppConn = pConn;
+	return ECHO_OK;
+}
+
+/*Give the channel back*/
+void echoShmClose(echoShmConn *pConn)
+{
+	if (!pConn)
+		return;
+
+	__atomic_store_n(&pConn->pChan->owner, 0, __ATOMIC_RELEASE);
+	munmap(pConn->pSeg, sizeof(echoShmSegment));
+	free(pConn);
+}
+
+/*Queue one request; ECHO_SEND_ERR if it is too big or the ring is full.
+  The server sleeps on the doorbell of the segment, not on the ring, so
+  it is rung only when the server said it went to sleep*/
+ECHO_STATUS echoShmSend(echoShmConn *pConn, const char *pData, unsigned int len)
+{
+	echoShmRing *pRing = &pConn->pChan->toServer;
+	unsigned int head = 0;
+	char *pMsg = NULL;
+
+	if (len > ECHO_SHM_MAX_MSG || NULL == (pMsg = echoShmRingReserve(pRing, len, &head)))
+		return ECHO_SEND_ERR;
+
+	memcpy(pMsg, pData, len);
+	__atomic_store_n(&pRing->head, head, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pConn->pSeg->serverWaiting, __ATOMIC_SEQ_CST))
+	{
+		__atomic_add_fetch(&pConn->pSeg->doorbell, 1, __ATOMIC_SEQ_CST);
+		echoShmFutex(&pConn->pSeg->doorbell, FUTEX_WAKE, 1, NULL);
+	}
+
+	return ECHO_OK;
+}
+
+/*Take the next echo, up to size bytes of it; 0 if there is none*/
+int echoShmRecv(echoShmConn *pConn, char *pBuf, unsigned int size)
+{
+	echoShmRing *pRing = &pConn->pChan->toClient;
+	unsigned int len = 0;
+	char *pMsg = NULL;
+
+	if (NULL == (pMsg = echoShmRingPeek(pRing, &len)))
+		return 0;
+
+	memcpy(pBuf, pMsg, len < size ? len : size);
+	echoShmRingConsume(pRing, len);
+	return len < size ? len : size;
+}
+
+/***********************************************************************
+* Function Name  : echoShmWait()
+* Description    : Wait for the next echo of a channel
+* Input          : pConn - the channel
+				   untilNs - CLOCK_MONOTONIC time to give up
+* Return         : 1 - an echo is there, 0 - timed out
+* Logic          : Spin for spinNs first, then set waiting and sleep on
+				   the head of the echo ring, which the server wakes once
+				   it published an echo;
+************************************************************************/
+int echoShmWait(echoShmConn *pConn, unsigned long long untilNs)
+{
+	echoShmRing *pRing = &pConn->pChan->toClient;
+	unsigned int tail = pRing->tail;
+	unsigned long long now = echoClientNowNs();
+	unsigned long long spinUntil = now + pConn->spinNs;
+	struct timespec wait;
+
+	while (__atomic_load_n(&pRing->head, __ATOMIC_ACQUIRE) == tail)
+	{
+		now = echoClientNowNs();
+		if (now >= untilNs)
+			return 0;
+
+		if (now < spinUntil)
+		{
+			ECHO_SHM_RELAX();
+			continue;
+		}
+
+		wait.tv_sec = (untilNs - now) / 1000000000ULL;
+		wait.tv_nsec = (untilNs - now) % 1000000000ULL;
+		__atomic_store_n(&pRing->waiting, 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&pRing->head, __ATOMIC_SEQ_CST) == tail)
+			echoShmFutex(&pRing->head, FUTEX_WAIT, tail, &wait);
+		__atomic_store_n(&pRing->waiting, 0, __ATOMIC_RELAXED);
+	}
+
+	return 1;
+}
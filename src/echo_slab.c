@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+#include "echo_slab.h"
+
+void echoSlabInit(echoSlab *pSlab, size_t objSize)
+{
+	bzero(pSlab, sizeof(echoSlab));
+	pSlab->objSize = ECHO_ALIGN_UP(objSize, sizeof(void *));
+}
+
+/***********************************************************************
+* Function Name  : echoSlabAlloc()
+* Description    : Take an object of the slab's size
+* Input          : pSlab - the allocator
+* Return         : the object, uninitialized; NULL when no memory is left
+* Logic          : A freed object comes first; otherwise the next never
+				   used object of the newest slab, and when that one is
+				   used up a new slab is mapped. The rest of the last
+				   slab is not touched until it is needed;
+************************************************************************/
+void *echoSlabAlloc(echoSlab *pSlab)
+{
+	void *pObj = pSlab->freeList;
+
+	if (pObj)
+	{
+		pSlab->freeList = *(void **)pObj;
+		pSlab->inUse++;
+		return pObj;
+	}
+
+	if (pSlab->pCarve == NULL || pSlab->pCarve + pSlab->objSize > pSlab->pCarveEnd)
+	{
+		pSlab->pCarve = mmap(NULL, ECHO_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (pSlab->pCarve == MAP_FAILED)
+		{
+			log_echo_err("Could not map a slab of %d bytes errno %d", ECHO_SLAB_SIZE, errno);
+			pSlab->pCarve = pSlab->pCarveEnd = NULL;
+			return NULL;
+		}
+		pSlab->pCarveEnd = pSlab->pCarve + ECHO_SLAB_SIZE;
+		pSlab->slabs++;
+	}
+
+	pObj = pSlab->pCarve;
+	pSlab->pCarve += pSlab->objSize;
+	pSlab->inUse++;
+	return pObj;
+}
+
+/*Give an object back; it is the first one handed out again*/
+void echoSlabFree(echoSlab *pSlab, void *pObj)
+{
+	*(void **)pObj = pSlab->freeList;
+	pSlab->freeList = pObj;
+	pSlab->inUse--;
+}
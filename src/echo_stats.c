@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "echo_main.h"
+#include "echo_stats.h"
+
+/*Segment of the running server; a private mapping when shared memory is
+  unavailable, so the counters can always be written*/
+static echoStatsShm *pEchoStats = NULL;
+
+/*The server on the default port publishes /echo_stats, any other one
+  /echo_stats.<port>, so servers on different ports do not mix*/
+static void echoStatsShmName(char *szName, size_t size, int port)
+{
+	if (port == ECHO_PORT_DEFAULT)
+		snprintf(szName, size, "%s", ECHO_STATS_SHM_NAME);
+	else
+		snprintf(szName, size, "%s.%d", ECHO_STATS_SHM_NAME, port);
+}
+
+static unsigned long long echoStatsNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/***********************************************************************
+* Function Name  : echoStatsInit()
+* Description    : Create the shared-memory segment with the counters
+* Input          : pConfig - server settings, published for the readers
+				   slots - server threads that write counters
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : A segment left by a previous server is replaced, so
+				   the counters start from zero. Readers only map the
+				   segment; the server threads never make a syscall or
+				   take a lock to publish a counter;
+************************************************************************/
+ECHO_STATUS echoStatsInit(echoServerConfig *pConfig, int slots)
+{
+	char szName[64];
+	void *pMap = MAP_FAILED;
+	int fd = -1;
+
+	if (slots < 1 || slots > ECHO_STATS_SLOTS)
+		return ECHO_BAD_PARAM;
+
+	echoStatsShmName(szName, sizeof szName, pConfig->port);
+	shm_unlink(szName);
+	fd = shm_open(szName, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd >= 0 && ftruncate(fd, sizeof(echoStatsShm)) == 0)
+		pMap = mmap(NULL, sizeof(echoStatsShm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (fd >= 0)
+		close(fd);
+
+	if (pMap == MAP_FAILED)
+	{
+		log_echo_warn("Could not share the server counters errno %d, 'echo --stats' will not see them", errno);
+		shm_unlink(szName);
+		pMap = mmap(NULL, sizeof(echoStatsShm), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (pMap == MAP_FAILED)
+			return ECHO_NO_MEM_ERR;
+	}
+
+	pEchoStats = (echoStatsShm *)pMap;
+	bzero(pEchoStats, sizeof(echoStatsShm));
+	pEchoStats->version = ECHO_STATS_VERSION;
+	pEchoStats->pid = getpid();
+	pEchoStats->slots = slots;
+	pEchoStats->ioMode = pConfig->ioMode;
+	pEchoStats->udpBatch = pConfig->udpBatch;
+	pEchoStats->busyPoll = pConfig->ioMode == ECHO_IO_LEGACY ? 0 : pConfig->busyPoll;
+	pEchoStats->xdpQueues = pConfig->xdpIfname ? pConfig->xdpQueues : 0;
+	pEchoStats->shm = pConfig->shmName != NULL;
+	pEchoStats->tlsPort = pConfig->tlsPort;
+	pEchoStats->zeroCopy = pConfig->ioMode == ECHO_IO_URING ? 0 : pConfig->zeroCopy;
+	pEchoStats->startNs = echoStatsNowNs();
+
+	/*a reader trusts the layout only after the magic is visible*/
+	__atomic_store_n(&pEchoStats->magic, ECHO_STATS_MAGIC, __ATOMIC_RELEASE);
+
+	return ECHO_OK;
+}
+
+/*Counters of server thread id; written by that thread only*/
+echoStatsSlot *echoStatsSlotGet(int id)
+{
+	return &pEchoStats->slot[id];
+}
+
+/*Add up the slots in use*/
+void echoStatsSum(echoStatsShm *pShm, echoStatsSlot *pSum)
+{
+	echoStatsSlot *pSlot = NULL;
+	int i = 0;
+
+	bzero(pSum, sizeof(echoStatsSlot));
+	for (i = 0; i < pShm->slots; i++)
+	{
+		pSlot = &pShm->slot[i];
+		pSum->accepted += ECHO_STAT_GET(pSlot->accepted);
+		pSum->closed += ECHO_STAT_GET(pSlot->closed);
+		pSum->bytesIn += ECHO_STAT_GET(pSlot->bytesIn);
+		pSum->bytesOut += ECHO_STAT_GET(pSlot->bytesOut);
+		pSum->datagrams += ECHO_STAT_GET(pSlot->datagrams);
+		pSum->sendErrors += ECHO_STAT_GET(pSlot->sendErrors);
+		pSum->shortWrites += ECHO_STAT_GET(pSlot->shortWrites);
+		pSum->udpBatches += ECHO_STAT_GET(pSlot->udpBatches);
+		pSum->udpDropped += ECHO_STAT_GET(pSlot->udpDropped);
+		pSum->udpGroSegments += ECHO_STAT_GET(pSlot->udpGroSegments);
+		pSum->tcpQueuedBytes += ECHO_STAT_GET(pSlot->tcpQueuedBytes);
+		pSum->tcpReadPauses += ECHO_STAT_GET(pSlot->tcpReadPauses);
+		pSum->tcpRingsExhausted += ECHO_STAT_GET(pSlot->tcpRingsExhausted);
+		pSum->busySpinNs += ECHO_STAT_GET(pSlot->busySpinNs);
+		pSum->busyWorkNs += ECHO_STAT_GET(pSlot->busyWorkNs);
+		pSum->busySleeps += ECHO_STAT_GET(pSlot->busySleeps);
+		pSum->xdpPackets += ECHO_STAT_GET(pSlot->xdpPackets);
+		pSum->ipcMessages += ECHO_STAT_GET(pSlot->ipcMessages);
+		pSum->tlsHandshakes += ECHO_STAT_GET(pSlot->tlsHandshakes);
+		pSum->tlsFailed += ECHO_STAT_GET(pSlot->tlsFailed);
+		pSum->tlsKtlsTx += ECHO_STAT_GET(pSlot->tlsKtlsTx);
+		pSum->tlsKtlsRx += ECHO_STAT_GET(pSlot->tlsKtlsRx);
+		pSum->zcSends += ECHO_STAT_GET(pSlot->zcSends);
+		pSum->zcCompletions += ECHO_STAT_GET(pSlot->zcCompletions);
+		pSum->zcCopied += ECHO_STAT_GET(pSlot->zcCopied);
+		pSum->zcFallbacks += ECHO_STAT_GET(pSlot->zcFallbacks);
+	}
+}
+
+/*Process id of the server on port, read from its counters; 0 - no
+  server of this version publishes them*/
+int echoStatsServerPid(int port)
+{
+	char szName[64];
+	echoStatsShm *pShm = NULL;
+	int pid = 0;
+	int fd = -1;
+
+	echoStatsShmName(szName, sizeof szName, port);
+	if ((fd = shm_open(szName, O_RDONLY, 0)) < 0)
+		return 0;
+
+	pShm = mmap(NULL, sizeof(echoStatsShm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pShm == MAP_FAILED)
+		return 0;
+
+	if (__atomic_load_n(&pShm->magic, __ATOMIC_ACQUIRE) == ECHO_STATS_MAGIC && pShm->version == ECHO_STATS_VERSION &&
+		(kill(pShm->pid, 0) == 0 || errno != ESRCH))
+		pid = pShm->pid;
+
+	munmap(pShm, sizeof(echoStatsShm));
+	return pid;
+}
+
+/*********************************************************************
+* Function Name  : echoStatsPrint()
+* Description    : Print the rates between two samples of the counters
+* Input          : pShm - the segment, for the server settings
+				   pNow, pLast - sums of the two samples
+				   seconds - time between the samples
+***********************************************************************/
+void echoStatsPrint(echoStatsShm *pShm, echoStatsSlot *pNow, echoStatsSlot *pLast, double seconds)
+{
+	unsigned long batches = pNow->udpBatches - pLast->udpBatches;
+	unsigned long datagrams = pNow->datagrams - pLast->datagrams;
+
+	log_echo("clients %lu active, %lu accepted/s, %lu closed/s, in %.2f MB/s, out %.2f MB/s",
+			 pNow->accepted - pNow->closed, (unsigned long)((pNow->accepted - pLast->accepted) / seconds),
+			 (unsigned long)((pNow->closed - pLast->closed) / seconds),
+			 (pNow->bytesIn - pLast->bytesIn) / seconds / 1e6, (pNow->bytesOut - pLast->bytesOut) / seconds / 1e6);
+	/*only the epoll reactors receive datagrams in batches*/
+	if (pShm->xdpQueues > 0)
+		log_echo("udp %lu datagrams/s (xdp %lu/s on %d queue(s)), dropped %lu", (unsigned long)(datagrams / seconds),
+				 (unsigned long)((pNow->xdpPackets - pLast->xdpPackets) / seconds), pShm->xdpQueues,
+				 pNow->udpDropped - pLast->udpDropped);
+	else if (pShm->ioMode == ECHO_IO_EPOLL)
+		log_echo("udp %lu datagrams/s, avg batch fill %.1f/%d, dropped %lu, gro segments %lu/s",
+				 (unsigned long)(datagrams / seconds), batches ? (double)datagrams / batches : 0.0, pShm->udpBatch,
+				 pNow->udpDropped - pLast->udpDropped, (unsigned long)((pNow->udpGroSegments - pLast->udpGroSegments) / seconds));
+	else
+		log_echo("udp %lu datagrams/s, dropped %lu", (unsigned long)(datagrams / seconds), pNow->udpDropped - pLast->udpDropped);
+	if (pShm->shm)
+		log_echo("ipc %lu messages/s over shared memory", (unsigned long)((pNow->ipcMessages - pLast->ipcMessages) / seconds));
+	/*sessions without kTLS are encrypted by OpenSSL in the workers*/
+	if (pShm->tlsPort)
+		log_echo("tls %lu handshakes/s on port %d, failed %lu, record layer in the kernel for tx %lu, rx %lu",
+				 (unsigned long)((pNow->tlsHandshakes - pLast->tlsHandshakes) / seconds), pShm->tlsPort,
+				 pNow->tlsFailed - pLast->tlsFailed, pNow->tlsKtlsTx - pLast->tlsKtlsTx, pNow->tlsKtlsRx - pLast->tlsKtlsRx);
+	/*sends minus completions are the sends still pinning buffers*/
+	if (pShm->zeroCopy)
+		log_echo("zerocopy %lu sends/s of %d+ bytes, %lu completions/s (%lu/s copied by the kernel), %lu copied echoes/s, in flight %lu",
+				 (unsigned long)((pNow->zcSends - pLast->zcSends) / seconds), pShm->zeroCopy,
+				 (unsigned long)((pNow->zcCompletions - pLast->zcCompletions) / seconds),
+				 (unsigned long)((pNow->zcCopied - pLast->zcCopied) / seconds),
+				 (unsigned long)((pNow->zcFallbacks - pLast->zcFallbacks) / seconds), pNow->zcSends - pNow->zcCompletions);
+	log_echo("send errors %lu, short writes %lu, tcp queued %lu bytes/s, read pauses %lu, closed without a ring %lu",
+			 pNow->sendErrors - pLast->sendErrors, pNow->shortWrites - pLast->shortWrites,
+			 (unsigned long)((pNow->tcpQueuedBytes - pLast->tcpQueuedBytes) / seconds),
+			 pNow->tcpReadPauses - pLast->tcpReadPauses, pNow->tcpRingsExhausted - pLast->tcpRingsExhausted);
+	/*share of the workers' time; the rest went to blocking waits*/
+	if (pShm->busyPoll > 0)
+		log_echo("busy poll %d us: spinning %.1f%%, working %.1f%% of the workers' time, %lu blocking waits/s",
+				 pShm->busyPoll, (pNow->busySpinNs - pLast->busySpinNs) / (seconds * 1e7 * pShm->slots),
+				 (pNow->busyWorkNs - pLast->busyWorkNs) / (seconds * 1e7 * pShm->slots),
+				 (unsigned long)((pNow->busySleeps - pLast->busySleeps) / seconds));
+}
+
+/*Report the counters of this server every interval seconds; never returns*/
+void echoStatsReportLoop(int interval)
+{
+	echoStatsSlot now;
+	echoStatsSlot last;
+
+	bzero(&last, sizeof last);
+	while (1)
+	{
+		sleep(interval);
+		echoStatsSum(pEchoStats, &now);
+		echoStatsPrint(pEchoStats, &now, &last, interval);
+		last = now;
+	}
+}
+
+/***********************************************************************
+* Function Name  : echoStatsWatch()
+* Description    : Reader of a running server's counters (echo --stats)
+* Input          : interval - seconds between two samples
+				   count - samples to print, 0 - until the server exits
+				   port - port of the server
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The segment is mapped read-only and sampled; the
+				   first report covers the time since the server
+				   started, every further one the last interval. The
+				   server is not involved in any way;
+************************************************************************/
+ECHO_STATUS echoStatsWatch(int interval, int count, int port)
+{
+	char szName[64];
+	echoStatsShm *pShm = NULL;
+	echoStatsSlot now;
+	echoStatsSlot last;
+	unsigned long long lastNs = 0;
+	unsigned long long nowNs = 0;
+	int fd = -1;
+	int i = 0;
+
+	if (interval < 1 || count < 0)
+	{
+		log_echo("%s", arrErrors[ECHO_BAD_PARAM]);
+		return ECHO_BAD_PARAM;
+	}
+
+	echoStatsShmName(szName, sizeof szName, port);
+	if ((fd = shm_open(szName, O_RDONLY, 0)) < 0)
+	{
+		log_echo("No echo server counters found (/dev/shm%s) errno %d", szName, errno);
+		return ECHO_NOT_FOUND;
+	}
+
+	pShm = mmap(NULL, sizeof(echoStatsShm), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (pShm == MAP_FAILED)
+	{
+		log_echo("Could not map the echo server counters errno %d", errno);
+		return ECHO_FAIL;
+	}
+
+	if (__atomic_load_n(&pShm->magic, __ATOMIC_ACQUIRE) != ECHO_STATS_MAGIC || pShm->version != ECHO_STATS_VERSION ||
+		pShm->slots < 1 || pShm->slots > ECHO_STATS_SLOTS)
+	{
+		log_echo("Unknown echo server counters layout");
+		munmap(pShm, sizeof(echoStatsShm));
+		return ECHO_FAIL;
+	}
+
+	log_echo("echo server pid %d, %s, %d thread(s), up %.0f s", pShm->pid,
+			 pShm->ioMode == ECHO_IO_LEGACY ? "legacy" : pShm->ioMode == ECHO_IO_URING ? "uring" : "epoll",
+			 pShm->slots, (echoStatsNowNs() - pShm->startNs) / 1e9);
+
+	bzero(&last, sizeof last);
+	lastNs = pShm->startNs;
+
+	for (i = 0; count == 0 || i < count; i++)
+	{
+		if (i > 0)
+			sleep(interval);
+
+		if (kill(pShm->pid, 0) < 0 && errno == ESRCH)
+		{
+			log_echo("echo server %d is not running", pShm->pid);
+			break;
+		}
+
+		nowNs = echoStatsNowNs();
+		echoStatsSum(pShm, &now);
+		echoStatsPrint(pShm, &now, &last, nowNs > lastNs ? (nowNs - lastNs) / 1e9 : 1);
+		last = now;
+		lastNs = nowNs;
+	}
+
+	munmap(pShm, sizeof(echoStatsShm));
+	return ECHO_OK;
+}
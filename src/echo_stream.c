@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include "echo_main.h"
+#include "echo_stream.h"
+#include "echo_tls.h"
+
+/*Map --stream-file as the payload, or generate one period of it; the
+  generated period is followed by its first chunk again, so every chunk
+  of the stream is contiguous in pSource*/
+static ECHO_STATUS echoStreamSource(echoStream *pStream, echoClientConfig *pConfig)
+{
+	struct stat st;
+	unsigned int x = 2463534242U; /*xorshift32 state*/
+	size_t i = 0;
+	int fd = -1;
+
+	if (pConfig->streamFile == NULL)
+	{
+		pStream->period = ECHO_STREAM_PERIOD;
+		pStream->sourceSize = ECHO_STREAM_PERIOD + ECHO_STREAM_CHUNK;
+		if (NULL == (pStream->pSource = malloc(pStream->sourceSize)))
+			return ECHO_NO_MEM_ERR;
+
+		for (i = 0; i < ECHO_STREAM_PERIOD; i++)
+		{
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			pStream->pSource[i] = (char)x;
+		}
+		for (; i < pStream->sourceSize; i++)
+			pStream->pSource[i] = pStream->pSource[i - ECHO_STREAM_PERIOD];
+
+		pStream->total = pConfig->streamBytes;
+		return ECHO_OK;
+	}
+
+	if ((fd = open(pConfig->streamFile, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0 || st.st_size == 0 ||
+		pConfig->streamBytes > (unsigned long long)st.st_size)
+	{
+		log_echo("Can not stream %s (empty, shorter than --stream or errno %d)", pConfig->streamFile, errno);
+		if (fd >= 0)
+			close(fd);
+		return ECHO_BAD_PARAM;
+	}
+
+	/*pages are read in ahead of the sends and may be dropped behind the
+	  echo, the file is never all in memory*/
+	pStream->pSource = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (pStream->pSource == MAP_FAILED)
+	{
+		pStream->pSource = NULL;
+		log_echo("Can not map %s errno %d", pConfig->streamFile, errno);
+		return ECHO_NO_MEM_ERR;
+	}
+	madvise(pStream->pSource, st.st_size, MADV_SEQUENTIAL);
+
+	pStream->sourceSize = st.st_size;
+	pStream->period = st.st_size;
+	pStream->total = pConfig->streamBytes ? pConfig->streamBytes : (unsigned long long)st.st_size;
+	return ECHO_OK;
+}
+
+/*Send one chunk, or what the socket takes of it; the echo is read
+  between two chunks, not only once the socket buffer is full*/
+static ECHO_STATUS echoStreamSend(echoStream *pStream)
+{
+	echoClientGlobal_t *pClient = pStream->pClient;
+	unsigned long long left = pStream->total - pStream->txOff;
+	ssize_t n = 0;
+
+	if (left == 0)
+		return ECHO_OK;
+
+	n = echoTlsSend(pClient->pTls, pClient->sockfd, pStream->pSource + pStream->txOff % pStream->period,
+					left < ECHO_STREAM_CHUNK ? left : ECHO_STREAM_CHUNK);
+	if (n < 0)
+	{
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+			return ECHO_OK;
+		log_echo("send failed after %llu bytes, errno %d", pStream->txOff, errno);
+		return ECHO_SEND_ERR;
+	}
+
+	pStream->txOff += n;
+	return ECHO_OK;
+}
+
+/*Throughput of the report interval that ended by now; the intervals
+  follow the echo, a stalled stream prints nothing*/
+static void echoStreamReport(echoStream *pStream, unsigned long long now)
+{
+	unsigned long long begin = pStream->reportNs - ECHO_STREAM_REPORT_NS;
+	double gbps = 0;
+
+	if (now < pStream->reportNs)
+		return;
+
+	gbps = (pStream->rxOff - pStream->reportOff) * 8.0 / (now - begin);
+	log_echo("%8.2f-%.2f s %9.3f Gbit/s", (begin - pStream->startNs) / 1e9, (now - pStream->startNs) / 1e9, gbps);
+	if (pStream->minGbps == 0 || gbps < pStream->minGbps)
+		pStream->minGbps = gbps;
+	if (gbps > pStream->maxGbps)
+		pStream->maxGbps = gbps;
+
+	pStream->reportOff = pStream->rxOff;
+	pStream->reportNs = now + ECHO_STREAM_REPORT_NS;
+}
+
+/*Read what the socket holds and compare it with the payload; an echo
+  that differs, or is longer than what was sent, ends the stream*/
+static ECHO_STATUS echoStreamRecv(echoStream *pStream)
+{
+	echoClientGlobal_t *pClient = pStream->pClient;
+	const char *pExpect = NULL;
+	unsigned long long now = 0;
+	ssize_t n = 0;
+	ssize_t i = 0;
+
+	while (pStream->rxOff < pStream->txOff)
+	{
+		n = echoTlsRecv(pClient->pTls, pClient->sockfd, pStream->pRecvBuf, ECHO_STREAM_CHUNK);
+		if (n == 0)
+		{
+			log_echo("The server closed the stream after %llu bytes", pStream->rxOff);
+			return ECHO_RCV_ERR;
+		}
+		if (n < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return ECHO_OK;
+			log_echo("recv failed after %llu bytes, errno %d", pStream->rxOff, errno);
+			return ECHO_RCV_ERR;
+		}
+
+		now = echoClientNowNs();
+		if (pStream->firstByteNs == 0)
+			pStream->firstByteNs = now;
+
+		if (pStream->rxOff + n > pStream->txOff)
+		{
+			log_echo("Echoed %llu bytes, only %llu were sent", pStream->rxOff + n, pStream->txOff);
+			return ECHO_RCV_ERR;
+		}
+
+		pExpect = pStream->pSource + pStream->rxOff % pStream->period;
+		if (memcmp(pStream->pRecvBuf, pExpect, n) != 0)
+		{
+			for (i = 0; pStream->pRecvBuf[i] == pExpect[i]; i++)
+				;
+			log_echo("The echo differs from the payload at byte %llu", pStream->rxOff + i);
+			return ECHO_RCV_ERR;
+		}
+
+		pStream->rxOff += n;
+		pStream->lastByteNs = now;
+		echoStreamReport(pStream, now);
+	}
+
+	return ECHO_OK;
+}
+
+/***********************************************************************
+* Function Name  : echoStreamStart()
+* Description    : Streaming mode of the echo client - echo one large
+				   payload and measure the throughput
+* Input          : arg_values - <ip> <protocol>, TCP (plain, --tls or a
+				   unix stream socket)
+				   pConfig - streamBytes and/or streamFile, timeout,
+				   socket buffers
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : One non-blocking connection; the payload is sent a
+				   chunk at a time while the echo is read and verified
+				   against it, so the payload may be far bigger than
+				   memory and the server echoes it with its usual
+				   buffers. Every second the echo throughput is
+				   printed; at the end the sustained Gbit/s (payload
+				   bits echoed over the time to the last byte), the
+				   slowest and fastest second, and the time to the
+				   first and the last byte of the echo. The wire
+				   carries every bit twice, once each way. The stream
+				   fails when nothing moves for --timeout ms;
+************************************************************************/
+ECHO_STATUS echoStreamStart(char **arg_values, echoClientConfig *pConfig)
+{
+	echoClientGlobal_t *pClient = NULL;
+	echoStream stream;
+	struct pollfd pfd;
+	socklen_t optLen = sizeof(int);
+	int sndBuf = 0;
+	int rcvBuf = 0;
+	double elapsed = 0;
+	int n = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (ECHO_OK != (iRet = echoClientGlobalInit(&pClient)))
+		return iRet;
+
+	pClient->config = *pConfig;
+	if (ECHO_OK != (iRet = echoClientSetServer(pClient, arg_values[0], arg_values[1])) ||
+		pClient->protocol != IPPROTO_TCP || pConfig->timeoutMs < 1 ||
+		(pConfig->streamBytes == 0 && pConfig->streamFile == NULL))
+	{
+		log_echo("%s", arrErrors[ECHO_BAD_PARAM]);
+		return ECHO_BAD_PARAM;
+	}
+
+	if (ECHO_OK != (iRet = echoAffinityPinSelf(&pConfig->cpus)))
+		return iRet;
+
+	bzero(&stream, sizeof stream);
+	stream.pClient = pClient;
+	if (ECHO_OK != (iRet = echoStreamSource(&stream, pConfig)))
+		return iRet;
+	if (NULL == (stream.pRecvBuf = malloc(ECHO_STREAM_CHUNK)))
+		return ECHO_NO_MEM_ERR;
+
+	if (ECHO_OK != (iRet = echoClientOpen(pClient)))
+		return iRet;
+	fcntl(pClient->sockfd, F_SETFL, O_NONBLOCK);
+	getsockopt(pClient->sockfd, SOL_SOCKET, SO_SNDBUF, &sndBuf, &optLen);
+	getsockopt(pClient->sockfd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, &optLen);
+
+	log_echo("Stream: %s, %llu bytes of %s, %d KB chunks, socket buffers send %d, receive %d bytes",
+			 echoClientProtoName(pClient), stream.total, pConfig->streamFile ? pConfig->streamFile : "generated payload",
+			 ECHO_STREAM_CHUNK / 1024, sndBuf, rcvBuf);
+
+	stream.startNs = echoClientNowNs();
+	stream.reportNs = stream.startNs + ECHO_STREAM_REPORT_NS;
+	pfd.fd = pClient->sockfd;
+	while (stream.rxOff < stream.total)
+	{
+		if (ECHO_OK != (iRet = echoStreamSend(&stream)) || ECHO_OK != (iRet = echoStreamRecv(&stream)))
+			break;
+		if (stream.rxOff == stream.total)
+			break;
+
+		pfd.events = POLLIN | (stream.txOff < stream.total ? POLLOUT : 0);
+		if ((n = poll(&pfd, 1, pConfig->timeoutMs)) == 0)
+		{
+			log_echo("Nothing moved for %d ms, %llu bytes sent, %llu echoed", pConfig->timeoutMs, stream.txOff, stream.rxOff);
+			iRet = ECHO_RCV_ERR;
+			break;
+		}
+		if (n < 0 && errno != EINTR)
+		{
+			iRet = ECHO_RCV_ERR;
+			break;
+		}
+	}
+
+	echoTlsClientReport();
+	if (stream.rxOff > 0 && stream.lastByteNs > stream.startNs)
+	{
+		elapsed = (stream.lastByteNs - stream.startNs) / 1e9;
+		log_echo("echoed %llu of %llu bytes in %.3f s: %.3f Gbit/s sustained", stream.rxOff, stream.total, elapsed,
+				 stream.rxOff * 8 / elapsed / 1e9);
+		if (stream.maxGbps > 0)
+			log_echo("per second: slowest %.3f Gbit/s, fastest %.3f Gbit/s", stream.minGbps, stream.maxGbps);
+		log_echo("time to first byte %.3f ms, to last byte %.3f ms", (stream.firstByteNs - stream.startNs) / 1e6,
+				 (stream.lastByteNs - stream.startNs) / 1e6);
+	}
+
+	echoClientClose(pClient);
+	if (pConfig->streamFile)
+		munmap(stream.pSource, stream.sourceSize);
+	else
+		free(stream.pSource);
+	free(stream.pRecvBuf);
+
+	return iRet;
+}
@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include "echo_main.h"
+#include "echo_tls.h"
+
+#ifdef ECHO_TLS
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+static SSL_CTX *pServerCtx = NULL;
+static SSL_CTX *pClientCtx = NULL;
+
+/*Client side: handshakes done by every thread of the process and on how
+  many of them the kernel took over the record layer*/
+static unsigned long clientHandshakes = 0;
+static unsigned long clientKtlsTx = 0;
+static unsigned long clientKtlsRx = 0;
+static const char *szClientVersion = NULL; /*of the last handshake, OpenSSL's static strings*/
+static const char *szClientCipher = NULL;
+
+/*Log and drop what OpenSSL queued about the last failure*/
+static void echoTlsLogErrors(const char *szWhat)
+{
+	char szErr[256];
+	unsigned long err = 0;
+
+	while ((err = ERR_get_error()) != 0)
+	{
+		ERR_error_string_n(err, szErr, sizeof szErr);
+		log_echo_err("%s: %s", szWhat, szErr);
+	}
+}
+
+/*Settings both ends share: the versions, kTLS and the modes non-blocking
+  echo loops need - a write may end after a record (partial write) and a
+  write that has to be retried may come from another buffer, the data
+  being the same*/
+static SSL_CTX *echoTlsCtxNew(const SSL_METHOD *pMethod, int version, int ktlsOff)
+{
+	SSL_CTX *pCtx = NULL;
+
+	if (NULL == (pCtx = SSL_CTX_new(pMethod)))
+		return NULL;
+
+	/*--tls-version pins the version, both are offered otherwise*/
+	SSL_CTX_set_min_proto_version(pCtx, version ? version : TLS1_2_VERSION);
+	SSL_CTX_set_max_proto_version(pCtx, version);
+	SSL_CTX_set_mode(pCtx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	/*a peer that closes without close_notify is an ordinary end of the echo*/
+	SSL_CTX_set_options(pCtx, SSL_OP_IGNORE_UNEXPECTED_EOF | (ktlsOff ? 0 : SSL_OP_ENABLE_KTLS));
+
+	/*OpenSSL writes to the socket with write(); a client that went away
+	  must not end the process with SIGPIPE*/
+	signal(SIGPIPE, SIG_IGN);
+
+	return pCtx;
+}
+
+/*Key and self-signed certificate made up at start, so the server needs
+  no files; EC P-256 keeps the handshake cheap*/
+static ECHO_STATUS echoTlsSelfSigned(SSL_CTX *pCtx)
+{
+	EVP_PKEY *pKey = NULL;
+	X509 *pCert = NULL;
+	X509_NAME *pName = NULL;
+	ECHO_STATUS iRet = ECHO_FAIL;
+
+	if (NULL == (pKey = EVP_EC_gen("P-256")) || NULL == (pCert = X509_new()))
+		goto out;
+
+	X509_set_version(pCert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(pCert), (long)getpid());
+	X509_gmtime_adj(X509_getm_notBefore(pCert), 0);
+	X509_gmtime_adj(X509_getm_notAfter(pCert), 60L * 60 * 24 * ECHO_TLS_CERT_DAYS);
+	X509_set_pubkey(pCert, pKey);
+	pName = X509_get_subject_name(pCert);
+	X509_NAME_add_entry_by_txt(pName, "CN", MBSTRING_ASC, (const unsigned char *)ECHO_TLS_CERT_CN, -1, -1, 0);
+	X509_set_issuer_name(pCert, pName);
+
+	if (X509_sign(pCert, pKey, EVP_sha256()) > 0 && SSL_CTX_use_certificate(pCtx, pCert) == 1 &&
+		SSL_CTX_use_PrivateKey(pCtx, pKey) == 1)
+		iRet = ECHO_OK;
+
+out:
+	X509_free(pCert);
+	EVP_PKEY_free(pKey);
+	return iRet;
+}
+
+/***********************************************************************
+* Function Name  : echoTlsServerInit()
+* Description    : Prepare the TLS context of the --tls-port listener
+* Input          : pConfig - tlsCert/tlsKey (PEM, NULL - generate a
+				   self-signed certificate), tlsVersion, ktlsOff
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : With kTLS allowed OpenSSL hands the keys of every
+				   established session to the kernel (TCP_ULP "tls"),
+				   each direction it has support for. No session tickets
+				   are sent: a client never resumes, and a ticket would
+				   be a record a kernel receiving for the client has to
+				   hand up as a control message;
+************************************************************************/
+ECHO_STATUS echoTlsServerInit(echoServerConfig *pConfig)
+{
+	if (NULL == (pServerCtx = echoTlsCtxNew(TLS_server_method(), pConfig->tlsVersion, pConfig->ktlsOff)))
+	{
+		echoTlsLogErrors("SSL_CTX_new");
+		return ECHO_FAIL;
+	}
+
+	SSL_CTX_set_num_tickets(pServerCtx, 0);
+	/*idle sessions give their record buffers back*/
+	SSL_CTX_set_mode(pServerCtx, SSL_MODE_RELEASE_BUFFERS);
+
+	if (pConfig->tlsCert)
+	{
+		if (SSL_CTX_use_certificate_chain_file(pServerCtx, pConfig->tlsCert) != 1 ||
+			SSL_CTX_use_PrivateKey_file(pServerCtx, pConfig->tlsKey ? pConfig->tlsKey : pConfig->tlsCert,
+										SSL_FILETYPE_PEM) != 1)
+		{
+			echoTlsLogErrors(pConfig->tlsCert);
+			return ECHO_FAIL;
+		}
+	}
+	else if (ECHO_OK != echoTlsSelfSigned(pServerCtx))
+	{
+		echoTlsLogErrors("self-signed certificate");
+		return ECHO_FAIL;
+	}
+
+	log_echo("TLS on port %d with %s, %s, record layer %s", pConfig->tlsPort,
+			 pConfig->tlsCert ? pConfig->tlsCert : "a self-signed EC P-256 certificate",
+			 pConfig->tlsVersion == TLS1_2_VERSION ? "TLS 1.2" :
+			 pConfig->tlsVersion == TLS1_3_VERSION ? "TLS 1.3" : "TLS 1.2/1.3",
+			 pConfig->ktlsOff ? "in user space" : "in the kernel where supported (kTLS)");
+	return ECHO_OK;
+}
+
+/*Client context; the certificate is not verified - the client measures
+  the cost of the encryption, it does not protect anything*/
+ECHO_STATUS echoTlsClientInit(echoClientConfig *pConfig)
+{
+	if (pClientCtx)
+		return ECHO_OK;
+
+	if (NULL == (pClientCtx = echoTlsCtxNew(TLS_client_method(), pConfig->tlsVersion, pConfig->ktlsOff)))
+	{
+		echoTlsLogErrors("SSL_CTX_new");
+		return ECHO_FAIL;
+	}
+
+	SSL_CTX_set_verify(pClientCtx, SSL_VERIFY_NONE, NULL);
+	return ECHO_OK;
+}
+
+/*Server session of an accepted non-blocking socket, the handshake is
+  driven by echoTlsHandshake(); NULL on failure*/
+struct ssl_st *echoTlsAccept(int fd)
+{
+	SSL *pTls = NULL;
+
+	if (NULL == (pTls = SSL_new(pServerCtx)))
+		return NULL;
+
+	if (SSL_set_fd(pTls, fd) != 1)
+	{
+		SSL_free(pTls);
+		return NULL;
+	}
+
+	SSL_set_accept_state(pTls);
+	return pTls;
+}
+
+/*Client handshake on a connected blocking socket (its SO_RCVTIMEO and
+  SO_SNDTIMEO bound it)*/
+ECHO_STATUS echoTlsConnect(int fd, struct ssl_st **ppTls)
+{
+	SSL *pTls = NULL;
+	int ktls = 0;
+
+	/*the first request follows the client's Finished record right away;
+	  Nagle would hold it until the server ACKs (delayed, up to 40 ms)*/
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+	if (NULL == (pTls = SSL_new(pClientCtx)) || SSL_set_fd(pTls, fd) != 1 || SSL_connect(pTls) != 1)
+	{
+		log_echo("TLS handshake failed errno %d", errno);
+		echoTlsLogErrors("SSL_connect");
+		SSL_free(pTls);
+		return ECHO_CONNECT_ERR;
+	}
+
+	ktls = echoTlsKernel(pTls);
+	__atomic_add_fetch(&clientHandshakes, 1, __ATOMIC_RELAXED);
+	if (ktls & ECHO_TLS_KTLS_TX)
+		__atomic_add_fetch(&clientKtlsTx, 1, __ATOMIC_RELAXED);
+	if (ktls & ECHO_TLS_KTLS_RX)
+		__atomic_add_fetch(&clientKtlsRx, 1, __ATOMIC_RELAXED);
+	szClientVersion = SSL_get_version(pTls);
+	szClientCipher = SSL_get_cipher_name(pTls);
+
+	*ppTls = pTls;
+	return ECHO_OK;
+}
+
+/*One step of a non-blocking handshake: 1 - established, 0 - it waits
+  for the socket, -1 - failed*/
+int echoTlsHandshake(struct ssl_st *pTls)
+{
+	int res = SSL_do_handshake(pTls);
+
+	if (res == 1)
+		return 1;
+
+	switch (SSL_get_error(pTls, res))
+	{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			return 0;
+	}
+
+	ERR_clear_error();
+	return -1;
+}
+
+/*Directions of an established session the kernel runs, ECHO_TLS_KTLS_*/
+int echoTlsKernel(struct ssl_st *pTls)
+{
+	return (BIO_get_ktls_send(SSL_get_wbio(pTls)) ? ECHO_TLS_KTLS_TX : 0) |
+		   (BIO_get_ktls_recv(SSL_get_rbio(pTls)) ? ECHO_TLS_KTLS_RX : 0);
+}
+
+/*send()/recv() results of a failed SSL_write()/SSL_read(): -1 with
+  EAGAIN while the session waits for the socket, 0 for close_notify*/
+static ssize_t echoTlsResult(SSL *pTls, int res)
+{
+	switch (SSL_get_error(pTls, res))
+	{
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			errno = EAGAIN;
+			return -1;
+
+		case SSL_ERROR_ZERO_RETURN:
+			return 0;
+
+		case SSL_ERROR_SYSCALL:
+			ERR_clear_error();
+			return -1;
+	}
+
+	ERR_clear_error();
+	errno = EIO;
+	return -1;
+}
+
+/*send() through the session, plain send() without one*/
+ssize_t echoTlsSend(struct ssl_st *pTls, int fd, const void *pBuf, size_t len)
+{
+	int res = 0;
+
+	if (pTls == NULL)
+		return send(fd, pBuf, len, MSG_NOSIGNAL);
+
+	if ((res = SSL_write(pTls, pBuf, len)) > 0)
+		return res;
+	return echoTlsResult(pTls, res);
+}
+
+/*recv() through the session, plain recv() without one*/
+ssize_t echoTlsRecv(struct ssl_st *pTls, int fd, void *pBuf, size_t len)
+{
+	int res = 0;
+
+	if (pTls == NULL)
+		return recv(fd, pBuf, len, 0);
+
+	if ((res = SSL_read(pTls, pBuf, len)) > 0)
+		return res;
+	return echoTlsResult(pTls, res);
+}
+
+/*Free a session, notify - send close_notify first (best effort, the
+  socket is not waited for); the socket stays open*/
+void echoTlsFree(struct ssl_st *pTls, int notify)
+{
+	if (pTls == NULL)
+		return;
+
+	if (notify)
+		SSL_shutdown(pTls);
+	SSL_free(pTls);
+	ERR_clear_error();
+}
+
+/*Client summary: the negotiated session and the record layer's place*/
+void echoTlsClientReport(void)
+{
+	unsigned long handshakes = __atomic_load_n(&clientHandshakes, __ATOMIC_RELAXED);
+
+	if (handshakes == 0)
+		return;
+
+	log_echo("tls %s %s: %lu handshake(s), record layer in the kernel for tx on %lu, rx on %lu", szClientVersion,
+			 szClientCipher, handshakes, __atomic_load_n(&clientKtlsTx, __ATOMIC_RELAXED),
+			 __atomic_load_n(&clientKtlsRx, __ATOMIC_RELAXED));
+}
+
+#else /*ECHO_TLS*/
+
+/*Built with make NO_TLS=1: the TLS options are refused, the echo paths
+  never see a session*/
+ECHO_STATUS echoTlsServerInit(echoServerConfig *pConfig)
+{
+	log_echo_err("TLS on port %d: built without OpenSSL (make NO_TLS=1)", pConfig->tlsPort);
+	return ECHO_FAIL;
+}
+
+ECHO_STATUS echoTlsClientInit(echoClientConfig *pConfig)
+{
+	log_echo("--tls: built without OpenSSL (make NO_TLS=1)");
+	return ECHO_FAIL;
+}
+
+struct ssl_st *echoTlsAccept(int fd)
+{
+	return NULL;
+}
+
+ECHO_STATUS echoTlsConnect(int fd, struct ssl_st **ppTls)
+{
+	return ECHO_CONNECT_ERR;
+}
+
+int echoTlsHandshake(struct ssl_st *pTls)
+{
+	return -1;
+}
+
+int echoTlsKernel(struct ssl_st *pTls)
+{
+	return 0;
+}
+
+ssize_t echoTlsSend(struct ssl_st *pTls, int fd, const void *pBuf, size_t len)
+{
+	return send(fd, pBuf, len, MSG_NOSIGNAL);
+}
+
+ssize_t echoTlsRecv(struct ssl_st *pTls, int fd, void *pBuf, size_t len)
+{
+	return recv(fd, pBuf, len, 0);
+}
+
+void echoTlsFree(struct ssl_st *pTls, int notify)
+{
+}
+
+void echoTlsClientReport(void)
+{
+}
+
+#endif /*ECHO_TLS*/
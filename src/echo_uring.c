@@ -0,0 +1,1058 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/io_uring.h>
+#include "echo_main.h"
+#include "echo_epoll.h"
+#include "echo_uring.h"
+#include "echo_reflect.h"
+
+#define ECHO_URING_DATA(op, bid, fd) (((__u64)(op) << 56) | ((__u64)(bid) << 32) | (__u32)(fd))
+#define ECHO_URING_DATA_OP(data) ((int)((data) >> 56))
+#define ECHO_URING_DATA_BID(data) ((int)(((data) >> 32) & 0xffff))
+#define ECHO_URING_DATA_FD(data) ((int)((data) & 0xffffffff))
+
+/*There is no liburing in the build, the three system calls are used directly*/
+static int echoUringSetupSys(unsigned int entries, struct io_uring_params *pParams)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, pParams);
+}
+
+static int echoUringEnterSys(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int echoUringRegisterSys(int fd, unsigned int opcode, void *arg, unsigned int nrArgs)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+/*********************************************************************
+* Function Name  : echoUringInit()
+* Description    : Create an io_uring instance and map its queues
+* Input          : pRing - ring to initialize
+				   entries - submission queue size
+* Return         : ECHO_STATUS to indicate error/success
+***********************************************************************/
+static ECHO_STATUS echoUringInit(echoUring *pRing, unsigned int entries)
+{
+	struct io_uring_params params;
+	char *sq = NULL;
+	char *cq = NULL;
+
+	bzero(pRing, sizeof(echoUring));
+	bzero(&params, sizeof params);
+
+	if ((pRing->fd = echoUringSetupSys(entries, &params)) < 0)
+		return ECHO_FAIL;
+
+	/*one mmap for both rings is available since 5.4, everything used
+	  below is much newer*/
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+	{
+		close(pRing->fd);
+		return ECHO_FAIL;
+	}
+
+	pRing->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	pRing->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (pRing->cqRingSize > pRing->sqRingSize)
+		pRing->sqRingSize = pRing->cqRingSize;
+	pRing->cqRingSize = pRing->sqRingSize;
+
+	pRing->sqRing = mmap(NULL, pRing->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+						 pRing->fd, IORING_OFF_SQ_RING);
+	if (pRing->sqRing == MAP_FAILED)
+	{
+		close(pRing->fd);
+		return ECHO_NO_MEM_ERR;
+	}
+	pRing->cqRing = pRing->sqRing;
+
+	pRing->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	pRing->sqes = mmap(NULL, pRing->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					   pRing->fd, IORING_OFF_SQES);
+	if (pRing->sqes == MAP_FAILED)
+	{
+		munmap(pRing->sqRing, pRing->sqRingSize);
+		close(pRing->fd);
+		return ECHO_NO_MEM_ERR;
+	}
+
+	sq = (char *)pRing->sqRing;
+	cq = (char *)pRing->cqRing;
+	pRing->sqEntries = params.sq_entries;
+	pRing->sqMask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+	pRing->ksqHead = (unsigned int *)(sq + params.sq_off.head);
+	pRing->ksqTail = (unsigned int *)(sq + params.sq_off.tail);
+	pRing->ksqArray = (unsigned int *)(sq + params.sq_off.array);
+	pRing->sqTail = *pRing->ksqTail;
+	pRing->cqMask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+	pRing->kcqHead = (unsigned int *)(cq + params.cq_off.head);
+	pRing->kcqTail = (unsigned int *)(cq + params.cq_off.tail);
+	pRing->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	return ECHO_OK;
+}
+
+static void echoUringRelease(echoUring *pRing)
+{
+	munmap(pRing->sqes, pRing->sqesSize);
+	munmap(pRing->sqRing, pRing->sqRingSize);
+	close(pRing->fd);
+}
+
+static unsigned int echoUringSqSpace(echoUring *pRing)
+{
+	return pRing->sqEntries - (pRing->sqTail - __atomic_load_n(pRing->ksqHead, __ATOMIC_ACQUIRE));
+}
+
+/*Publish the queued SQEs and enter the kernel; waits for waitNr
+  completions when waitNr is not 0*/
+static int echoUringSubmit(echoUring *pRing, unsigned int waitNr)
+{
+	unsigned int toSubmit = 0;
+
+	__atomic_store_n(pRing->ksqTail, pRing->sqTail, __ATOMIC_RELEASE);
+	toSubmit = pRing->sqTail - __atomic_load_n(pRing->ksqHead, __ATOMIC_ACQUIRE);
+
+	if (toSubmit == 0 && waitNr == 0)
+		return 0;
+
+	return echoUringEnterSys(pRing->fd, toSubmit, waitNr, waitNr ? IORING_ENTER_GETEVENTS : 0);
+}
+
+static struct io_uring_sqe *echoUringGetSqe(echoUring *pRing)
+{
+	struct io_uring_sqe *pSqe = NULL;
+	unsigned int idx = 0;
+
+	if (echoUringSqSpace(pRing) == 0)
+		echoUringSubmit(pRing, 0);
+
+	if (echoUringSqSpace(pRing) == 0)
+	{
+		log_echo_warn("io_uring submission queue is full");
+		return NULL;
+	}
+
+	idx = pRing->sqTail & pRing->sqMask;
+	pSqe = &pRing->sqes[idx];
+	bzero(pSqe, sizeof(struct io_uring_sqe));
+	pRing->ksqArray[idx] = idx;
+	pRing->sqTail++;
+
+	return pSqe;
+}
+
+/*Give buffer bid back to the kernel*/
+static void echoUringBufReturn(echoUringBufGroup *pGroup, int bid)
+{
+	struct io_uring_buf *pBuf = &pGroup->ring->bufs[pGroup->tail & (pGroup->count - 1)];
+
+	pBuf->addr = (unsigned long)(pGroup->buffers + (size_t)bid * pGroup->bufSize);
+	pBuf->len = pGroup->bufSize;
+	pBuf->bid = bid;
+	pGroup->tail++;
+	pGroup->freeCount++;
+
+	__atomic_store_n(&pGroup->ring->tail, pGroup->tail, __ATOMIC_RELEASE);
+}
+
+/*********************************************************************
+* Function Name  : echoUringBufGroupInit()
+* Description    : Register a ring of provided buffers (Linux >= 5.19)
+* Input          : pRing - the io_uring instance
+				   pGroup - buffer group to create
+				   bgid - buffer group id used in the SQEs
+				   count - number of buffers, power of 2
+				   bufSize - size of one buffer, rounded up to a cache line
+				   hugePages - map the buffers on 2 MB pages
+* Return         : ECHO_STATUS to indicate error/success
+***********************************************************************/
+static ECHO_STATUS echoUringBufGroupInit(echoUring *pRing, echoUringBufGroup *pGroup, int bgid, int count, int bufSize, int hugePages)
+{
+	struct io_uring_buf_reg reg;
+	int bid = 0;
+
+	bzero(pGroup, sizeof(echoUringBufGroup));
+	pGroup->bgid = bgid;
+	pGroup->count = count;
+	pGroup->bufSize = ECHO_ALIGN_UP(bufSize, ECHO_CACHE_LINE);
+	pGroup->ringSize = count * sizeof(struct io_uring_buf);
+
+	pGroup->ring = mmap(NULL, pGroup->ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (pGroup->ring == MAP_FAILED)
+		return ECHO_NO_MEM_ERR;
+
+	pGroup->buffers = echoPoolRegionAlloc((size_t)count * pGroup->bufSize, hugePages, &pGroup->buffersSize);
+	if (pGroup->buffers == NULL)
+		return ECHO_NO_MEM_ERR;
+
+	bzero(&reg, sizeof reg);
+	reg.ring_addr = (unsigned long)pGroup->ring;
+	reg.ring_entries = count;
+	reg.bgid = bgid;
+
+	if (echoUringRegisterSys(pRing->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+		return ECHO_FAIL;
+
+	for (bid = 0; bid < count; bid++)
+		echoUringBufReturn(pGroup, bid);
+
+	return ECHO_OK;
+}
+
+/***********************************************************************
+* Function Name  : echoUringProbe()
+* Description    : Check that the kernel can run the io_uring backend
+* Return         : ECHO_OK if io_uring with provided buffer rings and
+				   multishot recv works, ECHO_FAIL otherwise
+* Logic          : io_uring may be missing, disabled by sysctl or a
+				   seccomp filter, or too old for multishot operations;
+				   a multishot recv over a socketpair covers all cases;
+************************************************************************/
+ECHO_STATUS echoUringProbe(void)
+{
+	echoUring ring;
+	echoUringBufGroup group;
+	struct io_uring_sqe *pSqe = NULL;
+	struct io_uring_cqe *pCqe = NULL;
+	int pair[2] = {-1, -1};
+	ECHO_STATUS iRet = ECHO_FAIL;
+
+	if (ECHO_OK != echoUringInit(&ring, 8))
+	{
+		log_echo_warn("io_uring is not available, errno %d", errno);
+		return ECHO_FAIL;
+	}
+
+	if (ECHO_OK != echoUringBufGroupInit(&ring, &group, 0, 1, 64, 0))
+	{
+		log_echo_warn("io_uring provided buffer rings are not supported, errno %d", errno);
+		goto out;
+	}
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0)
+		goto out;
+
+	pSqe = echoUringGetSqe(&ring);
+	pSqe->opcode = IORING_OP_RECV;
+	pSqe->fd = pair[0];
+	pSqe->ioprio = IORING_RECV_MULTISHOT;
+	pSqe->flags = IOSQE_BUFFER_SELECT;
+	pSqe->buf_group = 0;
+
+	if (write(pair[1], "x", 1) != 1 || echoUringSubmit(&ring, 1) < 0)
+		goto out;
+
+	pCqe = &ring.cqes[*ring.kcqHead & ring.cqMask];
+	if (pCqe->res == 1 && (pCqe->flags & IORING_CQE_F_MORE) && (pCqe->flags & IORING_CQE_F_BUFFER))
+		iRet = ECHO_OK;
+	else
+		log_echo_warn("io_uring multishot recv is not supported, res %d", pCqe->res);
+
+out:
+	if (pair[0] >= 0)
+	{
+		close(pair[0]);
+		close(pair[1]);
+	}
+	echoUringRelease(&ring);
+	if (group.ring && group.ring != MAP_FAILED)
+		munmap(group.ring, group.ringSize);
+	echoPoolRegionFree(group.buffers, group.buffersSize);
+
+	return iRet;
+}
+
+static void echoUringArmAccept(echoUringWorker *pWorker)
+{
+	struct io_uring_sqe *pSqe = echoUringGetSqe(&pWorker->ring);
+
+	if (pSqe == NULL)
+		return;
+
+	/*one SQE keeps accepting until cancelled*/
+	pSqe->opcode = IORING_OP_ACCEPT;
+	pSqe->fd = pWorker->tcpSocket;
+	pSqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	pSqe->accept_flags = SOCK_CLOEXEC;
+	pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_ACCEPT, 0, pWorker->tcpSocket);
+
+	pWorker->acceptArmed = 1;
+	pWorker->acceptCancelled = 0;
+}
+
+static void echoUringCancel(echoUringWorker *pWorker, __u64 userData)
+{
+	struct io_uring_sqe *pSqe = echoUringGetSqe(&pWorker->ring);
+
+	if (pSqe == NULL)
+		return;
+
+	pSqe->opcode = IORING_OP_ASYNC_CANCEL;
+	pSqe->addr = userData;
+	pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_CANCEL, 0, 0);
+}
+
+static void echoUringArmRecv(echoUringWorker *pWorker, int fd);
+
+/*Accept again if there is room for clients; otherwise check back later,
+  other workers may release connections. Connections the multishot accept
+  took above the limit are parked (not read) and served first*/
+static void echoUringResumeAccept(echoUringWorker *pWorker)
+{
+	echoServersData *pData = &pWorker->pGlobal->echoServersData;
+	struct io_uring_sqe *pSqe = NULL;
+	int fd = 0;
+
+	for (fd = 0; fd < pWorker->connsSize && pWorker->parkedCount > 0; fd++)
+	{
+		if (!pWorker->conns[fd].parked)
+			continue;
+
+		if (__atomic_load_n(&pData->iClientsCount, __ATOMIC_RELAXED) >= pData->tcpMaxConnections)
+			break;
+
+		pWorker->conns[fd].parked = 0;
+		pWorker->parkedCount--;
+		__atomic_add_fetch(&pData->iClientsCount, 1, __ATOMIC_RELAXED);
+		echoUringArmRecv(pWorker, fd);
+	}
+
+	if (pWorker->acceptArmed || pWorker->tcpSocket < 0)
+		return;
+
+	if (pWorker->parkedCount == 0 &&
+		__atomic_load_n(&pData->iClientsCount, __ATOMIC_RELAXED) < pData->tcpMaxConnections)
+	{
+		echoUringArmAccept(pWorker);
+		return;
+	}
+
+	if (pWorker->timeoutArmed || NULL == (pSqe = echoUringGetSqe(&pWorker->ring)))
+		return;
+
+	pSqe->opcode = IORING_OP_TIMEOUT;
+	pSqe->addr = (unsigned long)&pWorker->pauseTs;
+	pSqe->len = 1;
+	pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_TIMEOUT, 0, 0);
+	pWorker->timeoutArmed = 1;
+}
+
+static void echoUringArmRecv(echoUringWorker *pWorker, int fd)
+{
+	struct io_uring_sqe *pSqe = echoUringGetSqe(&pWorker->ring);
+
+	if (pSqe == NULL)
+		return;
+
+	/*every completion carries one buffer picked by the kernel from the
+	  TCP buffer group*/
+	pSqe->opcode = IORING_OP_RECV;
+	pSqe->fd = fd;
+	pSqe->ioprio = IORING_RECV_MULTISHOT;
+	pSqe->flags = IOSQE_BUFFER_SELECT;
+	pSqe->buf_group = ECHO_URING_BGID_TCP;
+	pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_RECV, 0, fd);
+
+	pWorker->conns[fd].recvArmed = 1;
+}
+
+static void echoUringArmUdpRecv(echoUringWorker *pWorker)
+{
+	struct io_uring_sqe *pSqe = echoUringGetSqe(&pWorker->ring);
+
+	if (pSqe == NULL)
+		return;
+
+	pSqe->opcode = IORING_OP_RECVMSG;
+	pSqe->fd = pWorker->udpSocket;
+	pSqe->addr = (unsigned long)&pWorker->udpRecvMsg;
+	pSqe->len = 1;
+	pSqe->ioprio = IORING_RECV_MULTISHOT;
+	pSqe->flags = IOSQE_BUFFER_SELECT;
+	pSqe->buf_group = ECHO_URING_BGID_UDP;
+	pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_UDP_RECV, 0, pWorker->udpSocket);
+
+	pWorker->udpArmed = 1;
+}
+
+/***********************************************************************
+* Function Name  : echoUringSendQueued()
+* Description    : Echo the buffers queued on a connection
+* Input          : pWorker - the worker
+				   fd - client socket
+* Logic          : Only one chain of sends is in flight per connection;
+				   the sends of a chain are linked with IOSQE_IO_LINK,
+				   so the kernel runs them strictly in order even when
+				   one has to wait for socket space. Buffers received
+				   meanwhile are queued for the next chain;
+************************************************************************/
+static void echoUringSendQueued(echoUringWorker *pWorker, int fd)
+{
+	echoUringConn *pConn = &pWorker->conns[fd];
+	echoUringBufGroup *pGroup = &pWorker->tcpBufs;
+	struct io_uring_sqe *pSqe = NULL;
+	struct io_uring_sqe *pPrev = NULL;
+	int bid = 0;
+
+	if (pConn->sendsInflight || pConn->queueHead < 0)
+		return;
+
+	/*a chain must not be split between two submissions*/
+	if (echoUringSqSpace(&pWorker->ring) < ECHO_URING_CHAIN_MAX)
+		echoUringSubmit(&pWorker->ring, 0);
+
+	while (pConn->queueHead >= 0 && pConn->sendsInflight < ECHO_URING_CHAIN_MAX &&
+		   NULL != (pSqe = echoUringGetSqe(&pWorker->ring)))
+	{
+		bid = pConn->queueHead;
+		pConn->queueHead = pGroup->next[bid];
+
+		pSqe->opcode = IORING_OP_SEND;
+		pSqe->fd = fd;
+		pSqe->addr = (unsigned long)(pGroup->buffers + (size_t)bid * pGroup->bufSize);
+		pSqe->len = pGroup->lens[bid];
+		/*MSG_WAITALL makes the kernel retry short sends internally*/
+		pSqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+		pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_SEND, bid, fd);
+
+		if (pPrev)
+			pPrev->flags |= IOSQE_IO_LINK;
+		pPrev = pSqe;
+		pConn->sendsInflight++;
+	}
+
+	if (pConn->queueHead < 0)
+		pConn->queueTail = -1;
+}
+
+/*Close the client once nothing is pending on it any more*/
+static void echoUringMaybeClose(echoUringWorker *pWorker, int fd)
+{
+	echoUringConn *pConn = &pWorker->conns[fd];
+	echoServersData *pData = &pWorker->pGlobal->echoServersData;
+	int bid = 0;
+
+	if (!pConn->active || !pConn->closing || pConn->recvArmed || pConn->sendsInflight)
+		return;
+
+	if (!pConn->failed && pConn->queueHead >= 0)
+		return;
+
+	while (pConn->queueHead >= 0)
+	{
+		bid = pConn->queueHead;
+		pConn->queueHead = pWorker->tcpBufs.next[bid];
+		echoUringBufReturn(&pWorker->tcpBufs, bid);
+	}
+
+	if (pConn->stalled)
+		pWorker->stalledCount--;
+
+	bzero(pConn, sizeof(echoUringConn));
+	close(fd);
+
+	__atomic_sub_fetch(&pData->iClientsCount, 1, __ATOMIC_RELAXED);
+	ECHO_STAT_ADD(pWorker->pStats->closed, 1);
+	echoUringResumeAccept(pWorker);
+}
+
+/*Re-arm the receives that stopped on -ENOBUFS once enough buffers are back*/
+static void echoUringResumeStalled(echoUringWorker *pWorker)
+{
+	int fd = 0;
+
+	if (pWorker->udpStalled && pWorker->udpBufs.freeCount > 0)
+	{
+		pWorker->udpStalled = 0;
+		echoUringArmUdpRecv(pWorker);
+	}
+
+	if (pWorker->stalledCount == 0 || pWorker->tcpBufs.freeCount < pWorker->tcpBufs.count / 8)
+		return;
+
+	for (fd = 0; fd < pWorker->connsSize && pWorker->stalledCount > 0; fd++)
+	{
+		if (!pWorker->conns[fd].stalled)
+			continue;
+
+		pWorker->conns[fd].stalled = 0;
+		pWorker->stalledCount--;
+		if (!pWorker->conns[fd].closing)
+			echoUringArmRecv(pWorker, fd);
+	}
+}
+
+static ECHO_STATUS echoUringConnsGrow(echoUringWorker *pWorker, int fd)
+{
+	echoUringConn *pConns = NULL;
+	int newSize = pWorker->connsSize ? pWorker->connsSize : 1024;
+
+	while (newSize <= fd)
+		newSize *= 2;
+
+	if (newSize == pWorker->connsSize)
+		return ECHO_OK;
+
+	if (NULL == (pConns = realloc(pWorker->conns, newSize * sizeof(echoUringConn))))
+		return ECHO_NO_MEM_ERR;
+
+	bzero(pConns + pWorker->connsSize, (newSize - pWorker->connsSize) * sizeof(echoUringConn));
+	pWorker->conns = pConns;
+	pWorker->connsSize = newSize;
+
+	return ECHO_OK;
+}
+
+static void echoUringOnAccept(echoUringWorker *pWorker, struct io_uring_cqe *pCqe)
+{
+	echoServersData *pData = &pWorker->pGlobal->echoServersData;
+	echoUringConn *pConn = NULL;
+	int fd = pCqe->res;
+
+	if (!(pCqe->flags & IORING_CQE_F_MORE))
+		pWorker->acceptArmed = 0;
+
+	if (fd < 0)
+	{
+		if (fd != -ECANCELED)
+			log_echo_warn("io_uring accept failed %d", fd);
+	}
+	else if (ECHO_OK != echoUringConnsGrow(pWorker, fd))
+	{
+		log_echo_err("Could not allocate memory for client %d", fd);
+		close(fd);
+	}
+	else
+	{
+		/*an echo bigger than one buffer is several linked sends - Nagle
+		  would hold the last one until the client's delayed ACK*/
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+
+		pConn = &pWorker->conns[fd];
+		bzero(pConn, sizeof(echoUringConn));
+		pConn->active = 1;
+		ECHO_STAT_ADD(pWorker->pStats->accepted, 1);
+		pConn->queueHead = -1;
+		pConn->queueTail = -1;
+
+		/*another worker or the cancel in flight let one more in - like a
+		  connection in the backlog it is not served until there is room*/
+		if (pWorker->parkedCount > 0 ||
+			__atomic_load_n(&pData->iClientsCount, __ATOMIC_RELAXED) >= pData->tcpMaxConnections)
+		{
+			pConn->parked = 1;
+			pWorker->parkedCount++;
+		}
+		else
+		{
+			__atomic_add_fetch(&pData->iClientsCount, 1, __ATOMIC_RELAXED);
+			echoUringArmRecv(pWorker, fd);
+		}
+
+		if (pWorker->acceptArmed && !pWorker->acceptCancelled &&
+			__atomic_load_n(&pData->iClientsCount, __ATOMIC_RELAXED) >= pData->tcpMaxConnections)
+		{
+			echoUringCancel(pWorker, ECHO_URING_DATA(ECHO_URING_OP_ACCEPT, 0, pWorker->tcpSocket));
+			pWorker->acceptCancelled = 1;
+		}
+	}
+
+	echoUringResumeAccept(pWorker);
+}
+
+static void echoUringOnRecv(echoUringWorker *pWorker, struct io_uring_cqe *pCqe, int fd)
+{
+	echoUringConn *pConn = &pWorker->conns[fd];
+	echoUringBufGroup *pGroup = &pWorker->tcpBufs;
+	int bid = 0;
+
+	if (!(pCqe->flags & IORING_CQE_F_MORE))
+		pConn->recvArmed = 0;
+
+	if (pCqe->res > 0)
+	{
+		bid = pCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		pGroup->freeCount--;
+		ECHO_STAT_ADD(pWorker->pStats->bytesIn, pCqe->res);
+
+		if (pConn->failed)
+		{
+			echoUringBufReturn(pGroup, bid);
+		}
+		else
+		{
+			pGroup->lens[bid] = pCqe->res;
+			pGroup->next[bid] = -1;
+			if (pConn->queueTail >= 0)
+				pGroup->next[pConn->queueTail] = bid;
+			else
+				pConn->queueHead = bid;
+			pConn->queueTail = bid;
+
+			echoUringSendQueued(pWorker, fd);
+		}
+
+		/*the multishot recv may stop for reasons other than an error*/
+		if (!pConn->recvArmed && !pConn->closing)
+			echoUringArmRecv(pWorker, fd);
+	}
+	else if (pCqe->res == -ENOBUFS && !pConn->closing)
+	{
+		/*every buffer is waiting to be echoed - stop reading this client*/
+		if (!pConn->stalled)
+		{
+			pConn->stalled = 1;
+			pWorker->stalledCount++;
+		}
+	}
+	else if (!pConn->recvArmed)
+	{
+		/*0 - orderly shutdown, negative - error or cancelled*/
+		pConn->closing = 1;
+	}
+
+	echoUringMaybeClose(pWorker, fd);
+}
+
+static void echoUringOnSend(echoUringWorker *pWorker, struct io_uring_cqe *pCqe, int fd, int bid)
+{
+	echoUringConn *pConn = &pWorker->conns[fd];
+
+	pConn->sendsInflight--;
+
+	if (pCqe->res > 0)
+		ECHO_STAT_ADD(pWorker->pStats->bytesOut, pCqe->res);
+
+	/*a failed send also cancels the sends linked behind it*/
+	if (pCqe->res != pWorker->tcpBufs.lens[bid] && !pConn->failed)
+	{
+		if (pCqe->res >= 0)
+			ECHO_STAT_ADD(pWorker->pStats->shortWrites, 1);
+		else if (pCqe->res != -ECANCELED)
+			ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+
+		if (pCqe->res != -ECANCELED)
+			log_echo_warn("io_uring send on socket %d failed %d", fd, pCqe->res);
+
+		pConn->failed = 1;
+		pConn->closing = 1;
+		if (pConn->recvArmed)
+			echoUringCancel(pWorker, ECHO_URING_DATA(ECHO_URING_OP_RECV, 0, fd));
+	}
+
+	echoUringBufReturn(&pWorker->tcpBufs, bid);
+
+	if (pConn->sendsInflight == 0 && !pConn->failed)
+		echoUringSendQueued(pWorker, fd);
+
+	echoUringMaybeClose(pWorker, fd);
+}
+
+/*A datagram arrived - reflect it with sendmsg() straight from its buffer*/
+static void echoUringOnUdpRecv(echoUringWorker *pWorker, struct io_uring_cqe *pCqe)
+{
+	echoUringBufGroup *pGroup = &pWorker->udpBufs;
+	struct io_uring_recvmsg_out *pOut = NULL;
+	struct io_uring_sqe *pSqe = NULL;
+	struct msghdr *pMsg = NULL;
+	struct msghdr control;
+	char *pBuf = NULL;
+	int bid = 0;
+
+	if (!(pCqe->flags & IORING_CQE_F_MORE))
+		pWorker->udpArmed = 0;
+
+	if (pCqe->res >= 0 && (pCqe->flags & IORING_CQE_F_BUFFER))
+	{
+		bid = pCqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		pGroup->freeCount--;
+		pBuf = pGroup->buffers + (size_t)bid * pGroup->bufSize;
+		pOut = (struct io_uring_recvmsg_out *)pBuf;
+
+		/*buffer layout: header, source address, control data, payload*/
+		pMsg = &pGroup->msgs[bid];
+		pMsg->msg_name = pBuf + sizeof(struct io_uring_recvmsg_out);
+		pMsg->msg_namelen = pOut->namelen;
+		pGroup->iovs[bid].iov_base = pBuf + sizeof(struct io_uring_recvmsg_out) +
+									 pWorker->udpRecvMsg.msg_namelen + pWorker->udpRecvMsg.msg_controllen;
+		pGroup->iovs[bid].iov_len = pOut->payloadlen;
+		pMsg->msg_iov = &pGroup->iovs[bid];
+		pMsg->msg_iovlen = 1;
+		ECHO_STAT_ADD(pWorker->pStats->datagrams, 1);
+		ECHO_STAT_ADD(pWorker->pStats->bytesIn, pOut->payloadlen);
+
+		/*bigger than the buffer - dropped rather than echoed cut*/
+		if (pOut->flags & MSG_TRUNC)
+		{
+			ECHO_STAT_ADD(pWorker->pStats->udpDropped, 1);
+			echoUringBufReturn(pGroup, bid);
+			if (!pWorker->udpArmed && !pWorker->udpStalled)
+				echoUringArmUdpRecv(pWorker);
+			return;
+		}
+
+		if (pWorker->pGlobal->config.udpReflect)
+		{
+			bzero(&control, sizeof control);
+			control.msg_control = pBuf + sizeof(struct io_uring_recvmsg_out) + pWorker->udpRecvMsg.msg_namelen;
+			control.msg_controllen = pOut->controllen;
+			echoReflectStamp(pGroup->iovs[bid].iov_base, pOut->payloadlen, echoReflectRxNs(&control), &pWorker->reflectSeq);
+		}
+
+		if (NULL == (pSqe = echoUringGetSqe(&pWorker->ring)))
+		{
+			ECHO_STAT_ADD(pWorker->pStats->udpDropped, 1);
+			echoUringBufReturn(pGroup, bid);
+		}
+		else
+		{
+			pSqe->opcode = IORING_OP_SENDMSG;
+			pSqe->fd = pWorker->udpSocket;
+			pSqe->addr = (unsigned long)pMsg;
+			pSqe->len = 1;
+			pSqe->user_data = ECHO_URING_DATA(ECHO_URING_OP_UDP_SEND, bid, pWorker->udpSocket);
+		}
+	}
+	else if (pCqe->res == -ENOBUFS)
+	{
+		pWorker->udpStalled = 1;
+	}
+	else if (pCqe->res < 0)
+	{
+		log_echo_warn("io_uring UDP recvmsg failed %d", pCqe->res);
+	}
+
+	if (!pWorker->udpArmed && !pWorker->udpStalled)
+		echoUringArmUdpRecv(pWorker);
+}
+
+/*The echo of a datagram went out (or not) - its buffer is free again*/
+static void echoUringOnUdpSend(echoUringWorker *pWorker, struct io_uring_cqe *pCqe, int bid)
+{
+	if (pCqe->res >= 0)
+	{
+		ECHO_STAT_ADD(pWorker->pStats->bytesOut, pCqe->res);
+	}
+	else
+	{
+		ECHO_STAT_ADD(pWorker->pStats->udpDropped, 1);
+		ECHO_STAT_ADD(pWorker->pStats->sendErrors, 1);
+	}
+
+	echoUringBufReturn(&pWorker->udpBufs, bid);
+}
+
+static void echoUringHandleCqe(echoUringWorker *pWorker, struct io_uring_cqe *pCqe)
+{
+	__u64 data = pCqe->user_data;
+	int fd = ECHO_URING_DATA_FD(data);
+
+	switch (ECHO_URING_DATA_OP(data))
+	{
+		case ECHO_URING_OP_ACCEPT:
+			echoUringOnAccept(pWorker, pCqe);
+			break;
+
+		case ECHO_URING_OP_RECV:
+			echoUringOnRecv(pWorker, pCqe, fd);
+			break;
+
+		case ECHO_URING_OP_SEND:
+			echoUringOnSend(pWorker, pCqe, fd, ECHO_URING_DATA_BID(data));
+			echoUringResumeStalled(pWorker);
+			break;
+
+		case ECHO_URING_OP_UDP_RECV:
+			echoUringOnUdpRecv(pWorker, pCqe);
+			break;
+
+		case ECHO_URING_OP_UDP_SEND:
+			echoUringOnUdpSend(pWorker, pCqe, ECHO_URING_DATA_BID(data));
+			echoUringResumeStalled(pWorker);
+			break;
+
+		case ECHO_URING_OP_TIMEOUT:
+			pWorker->timeoutArmed = 0;
+			echoUringResumeAccept(pWorker);
+			break;
+
+		case ECHO_URING_OP_CANCEL:
+		default:
+			break;
+	}
+}
+
+/************************************************************************
+* Function Name  : echoUringWorkerLoop()
+* Description    : A function that will be executed by pthread; runs
+				   the completion loop of one io_uring worker;
+* Input          : pWorker - worker with the sockets to serve;
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : A single io_uring_enter() both submits the new SQEs
+				   and waits for completions; multishot accept/recv
+				   keep producing completions without new submissions;
+*************************************************************************/
+void *echoUringWorkerLoop(void *pWorkerPar)
+{
+	echoUringWorker *pWorker = (echoUringWorker *)pWorkerPar;
+	echoUring *pRing = &pWorker->ring;
+	unsigned int head = 0;
+	unsigned int tail = 0;
+	unsigned int waitNr = 1;
+	static ECHO_STATUS ret;
+
+	log_echo("io_uring worker %d is serving tcp sock=[%d] udp sock=[%d] on cpu %d", pWorker->id, pWorker->tcpSocket,
+			 pWorker->udpSocket, sched_getcpu());
+
+	if (pWorker->tcpSocket >= 0)
+		echoUringArmAccept(pWorker);
+
+	if (pWorker->udpSocket >= 0)
+		echoUringArmUdpRecv(pWorker);
+
+	while (1)
+	{
+		/*busy poll: only peek at the completion queue (no syscall when
+		  there is nothing to submit) until the spin time is over*/
+		if (pWorker->busyPoll.spinNs)
+			waitNr = echoBusyPollTimeout(&pWorker->busyPoll, 1);
+
+		if (echoUringSubmit(pRing, waitNr) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			log_echo_err("io_uring_enter failed errno %d", errno);
+			ret = ECHO_FAIL;
+			pthread_exit(&ret);
+		}
+
+		head = *pRing->kcqHead;
+		tail = __atomic_load_n(pRing->kcqTail, __ATOMIC_ACQUIRE);
+		if (pWorker->busyPoll.spinNs)
+			echoBusyPollWoke(&pWorker->busyPoll, tail - head);
+
+		for (; head != tail; head++)
+			echoUringHandleCqe(pWorker, &pRing->cqes[head & pRing->cqMask]);
+
+		__atomic_store_n(pRing->kcqHead, head, __ATOMIC_RELEASE);
+		if (pWorker->busyPoll.spinNs)
+			echoBusyPollWorked(&pWorker->busyPoll);
+	}
+
+	ret = ECHO_OK;
+	pthread_exit(&ret);
+}
+
+/*Buffers of a provided buffer ring: count by default, fewer (a power of 2)
+  when --buffer-size makes them bigger than defSize, so a ring does not
+  take more memory than with the defaults*/
+static int echoUringBufCount(int count, int defSize, int bufSize)
+{
+	int total = count;
+
+	while (count > ECHO_URING_MIN_BUFFERS && (size_t)count * bufSize > (size_t)total * defSize)
+		count /= 2;
+
+	return count;
+}
+
+/*Prepare one io_uring worker around the already opened server sockets*/
+static ECHO_STATUS echoUringWorkerInit(echoUringWorker *pWorker, EchoGlobal_t *pGlobal, int id, int tcpSocket, int udpSocket)
+{
+	ECHO_STATUS iRet = ECHO_OK;
+	int bufSize = ECHO_CONFIG_BUFSIZE(&pGlobal->config, ECHO_TCP_RING_SIZE);
+	int udpSize = ECHO_CONFIG_BUFSIZE(&pGlobal->config, ECHO_UDP_BUFSIZE);
+	int tcpCount = echoUringBufCount(ECHO_URING_TCP_BUFFERS, ECHO_BUFSIZE, bufSize); /*256 of the default 16 KB*/
+	int udpCount = echoUringBufCount(ECHO_URING_UDP_BUFFERS, ECHO_BUFSIZE, udpSize);
+	int udpBufSize = 0;
+
+	bzero(pWorker, sizeof(echoUringWorker));
+	pWorker->id = id;
+	pWorker->pGlobal = pGlobal;
+	pWorker->tcpSocket = tcpSocket;
+	pWorker->udpSocket = udpSocket;
+	pWorker->pStats = echoStatsSlotGet(id);
+	pWorker->pauseTs.tv_nsec = ECHO_EPOLL_PAUSE_MS * 1000000L;
+
+	/*io_uring waits for readiness itself; with O_NONBLOCK it would hand
+	  -EAGAIN back instead*/
+	if (tcpSocket >= 0)
+		fcntl(tcpSocket, F_SETFL, fcntl(tcpSocket, F_GETFL) & ~O_NONBLOCK);
+	if (udpSocket >= 0)
+		fcntl(udpSocket, F_SETFL, fcntl(udpSocket, F_GETFL) & ~O_NONBLOCK);
+
+	if (ECHO_OK != (iRet = echoUringInit(&pWorker->ring, ECHO_URING_ENTRIES)))
+		return iRet;
+
+	/*a blocking wait busy polls the queues of the ring's sockets first*/
+	echoBusyPollInit(&pWorker->busyPoll, pGlobal->config.busyPoll, pWorker->pStats);
+	if (pGlobal->config.busyPoll > 0 &&
+		echoUringRegisterSys(pWorker->ring.fd, IORING_REGISTER_NAPI,
+							 &(struct io_uring_napi){.busy_poll_to = pGlobal->config.busyPoll, .prefer_busy_poll = 1}, 1) < 0)
+		log_echo_warn("IORING_REGISTER_NAPI failed errno %d, set net.core.busy_poll instead", errno);
+
+	if (ECHO_OK != (iRet = echoUringConnsGrow(pWorker, 0)))
+		return iRet;
+
+	if (ECHO_OK != (iRet = echoUringBufGroupInit(&pWorker->ring, &pWorker->tcpBufs, ECHO_URING_BGID_TCP,
+												 tcpCount, bufSize, pGlobal->config.hugePages)))
+		return iRet;
+
+	pWorker->tcpBufs.lens = calloc(tcpCount, sizeof(int));
+	pWorker->tcpBufs.next = calloc(tcpCount, sizeof(int));
+	if (!pWorker->tcpBufs.lens || !pWorker->tcpBufs.next)
+		return ECHO_NO_MEM_ERR;
+
+	/*room for the recvmsg header, the source address and (reflector) the
+	  receive time before the payload*/
+	pWorker->udpRecvMsg.msg_namelen = sizeof(struct sockaddr_in);
+	if (pGlobal->config.udpReflect && udpSocket >= 0)
+	{
+		echoReflectEnable(udpSocket);
+		pWorker->udpRecvMsg.msg_controllen = sizeof(echoReflectControl);
+	}
+	udpBufSize = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + pWorker->udpRecvMsg.msg_controllen +
+				 udpSize;
+
+	if (ECHO_OK != (iRet = echoUringBufGroupInit(&pWorker->ring, &pWorker->udpBufs, ECHO_URING_BGID_UDP,
+												 udpCount, udpBufSize, pGlobal->config.hugePages)))
+		return iRet;
+
+	pWorker->udpBufs.msgs = calloc(udpCount, sizeof(struct msghdr));
+	pWorker->udpBufs.iovs = calloc(udpCount, sizeof(struct iovec));
+	if (!pWorker->udpBufs.msgs || !pWorker->udpBufs.iovs)
+		return ECHO_NO_MEM_ERR;
+
+	return ECHO_OK;
+}
+
+/*********************************************************************
+* Function Name  : echoUringServersStart()
+* Description    : Start echo tcp/udp servers on io_uring workers
+* Input          : pGlobal - reference to global echo servers DB
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Same layout as the epoll reactors - config.workers
+				   threads, each with its own ring and (SO_REUSEPORT)
+				   sockets; if the kernel can not run the backend the
+				   servers fall back to the epoll reactors;
+***********************************************************************/
+ECHO_STATUS echoUringServersStart(EchoGlobal_t *pGlobal)
+{
+	echoServersData *pData = &pGlobal->echoServersData;
+	echoUringWorker *pWorkers = NULL;
+	int workers = pGlobal->config.workers;
+	int reusePort = workers > 1;
+	pthread_attr_t attr;
+	int tcpSocket = -1;
+	int udpSocket = -1;
+	int cpu = -1;
+	int started = 0;
+	int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (ECHO_OK != echoUringProbe())
+	{
+		log_echo_warn("io_uring backend unavailable, falling back to epoll");
+		pGlobal->config.ioMode = ECHO_IO_EPOLL;
+		return echoEpollServersStart(pGlobal);
+	}
+
+	echoServerCloseConnections(pGlobal, IPPROTO_TCP);
+	echoServerCloseConnections(pGlobal, IPPROTO_UDP);
+
+	/*one counter slot per worker, then the unix, shared-memory and AF_XDP threads*/
+	if (ECHO_OK != (iRet = echoStatsInit(&pGlobal->config, workers + echoAuxSlots(&pGlobal->config))))
+		return iRet;
+
+	if (NULL == (pWorkers = calloc(workers, sizeof(echoUringWorker))))
+	{
+		log_echo_err("Could not allocate memory for %d io_uring workers", workers);
+		return ECHO_NO_MEM_ERR;
+	}
+
+	for (i = 0; i < workers && ECHO_OK == iRet; i++)
+	{
+		tcpSocket = -1;
+		udpSocket = -1;
+		cpu = echoAffinityCpu(&pGlobal->config.cpus, i);
+
+		/*the buffers of a pinned worker go to the NUMA node of its CPU*/
+		if (cpu >= 0)
+			echoAffinityMemPrefer(echoAffinityCpuNode(cpu));
+
+		if (pData->tcpStatus)
+			iRet = echoOpenServerSocket(IPPROTO_TCP, &pGlobal->config, reusePort, &tcpSocket);
+
+		if (ECHO_OK == iRet && pData->udpStatus)
+			iRet = echoOpenServerSocket(IPPROTO_UDP, &pGlobal->config, reusePort, &udpSocket);
+
+		if (i == 0)
+		{
+			pData->tcpSocket = tcpSocket;
+			pData->udpSocket = udpSocket;
+		}
+
+		if (ECHO_OK == iRet && pGlobal->config.incomingCpu)
+		{
+			echoAffinityIncomingCpu(tcpSocket, cpu);
+			echoAffinityIncomingCpu(udpSocket, cpu);
+		}
+
+		if (ECHO_OK == iRet)
+			iRet = echoUringWorkerInit(&pWorkers[i], pGlobal, i, tcpSocket, udpSocket);
+	}
+
+	if (pGlobal->config.cpus.count > 0)
+		echoAffinityMemPrefer(-1);
+
+	if (ECHO_OK != iRet)
+	{
+		log_echo_err("Could not prepare io_uring worker %d - %s", i - 1, arrErrors[iRet]);
+		return iRet;
+	}
+
+	/*the unix sockets, --shm and --xdp are served by threads of their
+	  own; a failure returns before any worker runs*/
+	if (ECHO_OK != (iRet = echoAuxServersStart(pGlobal, workers)))
+		return iRet;
+
+	for (started = 0; started < workers; started++)
+	{
+		/*worker n runs on the n-th CPU of --cpus from its first instruction*/
+		if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pGlobal->config.cpus, started)))
+			break;
+		if (pthread_create(&pWorkers[started].threadId, &attr, echoUringWorkerLoop, (void*)&pWorkers[started]) != 0)
+			iRet = ECHO_PTHREAD_ERR;
+		pthread_attr_destroy(&attr);
+		if (ECHO_OK != iRet)
+		{
+			perror("could not create thread - echoUringWorkerLoop!");
+			break;
+		}
+	}
+
+	log_echo("%d io_uring worker(s) started", started);
+
+	/*the workers never return; the main thread reports their counters*/
+	if (ECHO_OK == iRet && pGlobal->config.statsInterval > 0)
+		echoStatsReportLoop(pGlobal->config.statsInterval);
+
+	for (i = 0; i < started; i++)
+		pthread_join(pWorkers[i].threadId, NULL);
+
+	return iRet;
+}
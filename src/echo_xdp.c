@@ -0,0 +1,531 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+#include "echo_reflect.h"
+#include "echo_xdp.h"
+
+#define ECHO_XDP_HEADERS (sizeof(struct ethhdr) + sizeof(struct iphdr) + sizeof(struct udphdr))
+
+/*BPF instructions, as the kernel's samples write them*/
+#define ECHO_BPF_INSN(c, d, s, o, i) ((struct bpf_insn){.code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i)})
+#define ECHO_BPF_MOV_REG(d, s) ECHO_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, d, s, 0, 0)
+#define ECHO_BPF_MOV_IMM(d, i) ECHO_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, d, 0, 0, i)
+#define ECHO_BPF_ADD_IMM(d, i) ECHO_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, d, 0, 0, i)
+#define ECHO_BPF_AND_IMM(d, i) ECHO_BPF_INSN(BPF_ALU64 | BPF_AND | BPF_K, d, 0, 0, i)
+#define ECHO_BPF_LOAD(size, d, s, o) ECHO_BPF_INSN(BPF_LDX | BPF_MEM | (size), d, s, o, 0)
+#define ECHO_BPF_JGT_REG(d, s) ECHO_BPF_INSN(BPF_JMP | BPF_JGT | BPF_X, d, s, 0, 0)
+#define ECHO_BPF_JNE_IMM(d, i) ECHO_BPF_INSN(BPF_JMP | BPF_JNE | BPF_K, d, 0, 0, i)
+#define ECHO_BPF_MAP_FD(d, fd) ECHO_BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, d, BPF_PSEUDO_MAP_FD, 0, fd), ECHO_BPF_INSN(0, 0, 0, 0, 0)
+#define ECHO_BPF_CALL(f) ECHO_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, f)
+#define ECHO_BPF_EXIT() ECHO_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+
+static char xdpVerifierLog[16384];
+
+static int echoXdpBpf(int cmd, union bpf_attr *pAttr)
+{
+	return (int)syscall(__NR_bpf, cmd, pAttr, sizeof(union bpf_attr));
+}
+
+/***********************************************************************
+* Function Name  : echoXdpProgLoad()
+* Description    : Load the XDP program that steers echo datagrams to the
+				   AF_XDP sockets
+* Input          : port - UDP port of the echo server
+				   mapFd - XSKMAP, RX queue -> AF_XDP socket
+* Return         : program fd, -1 on error
+* Logic          : Written in BPF instructions directly, so neither clang
+				   nor libbpf is needed:
+				   if the frame is IPv4 without options, not a fragment,
+				   UDP and to the echo port
+				       return bpf_redirect_map(xsks, rx_queue, XDP_PASS)
+				   return XDP_PASS
+				   Everything else - ARP, TCP, other ports - goes to the
+				   stack, as does a datagram of a queue without socket;
+************************************************************************/
+static int echoXdpProgLoad(int port, int mapFd)
+{
+	struct bpf_insn prog[] = {
+		ECHO_BPF_MOV_REG(BPF_REG_6, BPF_REG_1),
+		ECHO_BPF_LOAD(BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data)),
+		ECHO_BPF_LOAD(BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end)),
+		ECHO_BPF_MOV_REG(BPF_REG_4, BPF_REG_2),
+		ECHO_BPF_ADD_IMM(BPF_REG_4, ECHO_XDP_HEADERS),
+		ECHO_BPF_JGT_REG(BPF_REG_4, BPF_REG_3),
+		ECHO_BPF_LOAD(BPF_H, BPF_REG_5, BPF_REG_2, offsetof(struct ethhdr, h_proto)),
+		ECHO_BPF_JNE_IMM(BPF_REG_5, htons(ETH_P_IP)),
+		ECHO_BPF_LOAD(BPF_B, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr)), /*version and header length*/
+		ECHO_BPF_JNE_IMM(BPF_REG_5, 0x45),
+		ECHO_BPF_LOAD(BPF_B, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr) + offsetof(struct iphdr, protocol)),
+		ECHO_BPF_JNE_IMM(BPF_REG_5, IPPROTO_UDP),
+		ECHO_BPF_LOAD(BPF_H, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr) + offsetof(struct iphdr, frag_off)),
+		ECHO_BPF_AND_IMM(BPF_REG_5, htons(IP_MF | IP_OFFMASK)),
+		ECHO_BPF_JNE_IMM(BPF_REG_5, 0),
+		ECHO_BPF_LOAD(BPF_H, BPF_REG_5, BPF_REG_2, sizeof(struct ethhdr) + sizeof(struct iphdr) + offsetof(struct udphdr, dest)),
+		ECHO_BPF_JNE_IMM(BPF_REG_5, htons(port)),
+		ECHO_BPF_LOAD(BPF_W, BPF_REG_2, BPF_REG_6, offsetof(struct xdp_md, rx_queue_index)),
+		ECHO_BPF_MAP_FD(BPF_REG_1, mapFd),
+		ECHO_BPF_MOV_IMM(BPF_REG_3, XDP_PASS), /*action when the queue has no socket*/
+		ECHO_BPF_CALL(BPF_FUNC_redirect_map),
+		ECHO_BPF_EXIT(),
+		ECHO_BPF_MOV_IMM(BPF_REG_0, XDP_PASS), /*every check above jumps here*/
+		ECHO_BPF_EXIT(),
+	};
+	int count = sizeof prog / sizeof prog[0];
+	union bpf_attr attr;
+	int fd = -1;
+	int i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if (prog[i].code == (BPF_JMP | BPF_JGT | BPF_X) || prog[i].code == (BPF_JMP | BPF_JNE | BPF_K))
+			prog[i].off = count - 2 - (i + 1);
+	}
+
+	bzero(&attr, sizeof attr);
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns = (unsigned long)prog;
+	attr.insn_cnt = count;
+	attr.license = (unsigned long)"GPL";
+	attr.log_buf = (unsigned long)xdpVerifierLog;
+	attr.log_size = sizeof xdpVerifierLog;
+	attr.log_level = 1;
+
+	if ((fd = echoXdpBpf(BPF_PROG_LOAD, &attr)) < 0)
+		log_echo_err("BPF_PROG_LOAD failed errno %d: %.200s", errno, xdpVerifierLog);
+
+	return fd;
+}
+
+/*Map one ring of the socket; offsets come from XDP_MMAP_OFFSETS*/
+static ECHO_STATUS echoXdpRingMap(echoXdpRing *pRing, int fd, struct xdp_ring_offset *pOff, unsigned int size,
+								  size_t descSize, off_t pgoff)
+{
+	pRing->size = size;
+	pRing->mapSize = pOff->desc + size * descSize;
+	pRing->map = mmap(NULL, pRing->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, pgoff);
+	if (pRing->map == MAP_FAILED)
+	{
+		log_echo_err("mmap of an AF_XDP ring failed errno %d", errno);
+		return ECHO_NO_MEM_ERR;
+	}
+
+	pRing->producer = (unsigned int *)((char *)pRing->map + pOff->producer);
+	pRing->consumer = (unsigned int *)((char *)pRing->map + pOff->consumer);
+	pRing->flags = (unsigned int *)((char *)pRing->map + pOff->flags);
+	pRing->descs = (char *)pRing->map + pOff->desc;
+	return ECHO_OK;
+}
+
+/*Entries the consumer can take*/
+static unsigned int echoXdpRingReady(echoXdpRing *pRing)
+{
+	return __atomic_load_n(pRing->producer, __ATOMIC_ACQUIRE) - *pRing->consumer;
+}
+
+/*Entries the producer can add*/
+static unsigned int echoXdpRingFree(echoXdpRing *pRing)
+{
+	return pRing->size - (*pRing->producer - __atomic_load_n(pRing->consumer, __ATOMIC_ACQUIRE));
+}
+
+/***********************************************************************
+* Function Name  : echoXdpQueueInit()
+* Description    : Open the AF_XDP socket of one RX queue
+* Input          : pQueue - the queue
+				   ifindex - the interface
+				   pConfig - huge pages, busy polling, native mode
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : The UMEM holds all frames of the queue and all of
+				   them start on the fill ring. With XDP_USE_NEED_WAKEUP
+				   the kernel only wants a syscall when it ran out of
+				   work, not per packet;
+************************************************************************/
+static ECHO_STATUS echoXdpQueueInit(echoXdpQueue *pQueue, int ifindex, echoServerConfig *pConfig)
+{
+	struct xdp_umem_reg umemReg;
+	struct xdp_mmap_offsets off;
+	struct sockaddr_xdp addr;
+	socklen_t offLen = sizeof off;
+	unsigned int ringSize = ECHO_XDP_RING_SIZE;
+	unsigned int fillSize = ECHO_XDP_FRAMES;
+	__u64 *pFill = NULL;
+	unsigned int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if ((pQueue->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0)) < 0)
+	{
+		log_echo_err("AF_XDP socket failed errno %d", errno);
+		return ECHO_OPEN_SOCK_ERR;
+	}
+
+	if (NULL == (pQueue->umem = echoPoolRegionAlloc((size_t)ECHO_XDP_FRAMES * ECHO_XDP_FRAME_SIZE, pConfig->hugePages,
+													&pQueue->umemSize)))
+		return ECHO_NO_MEM_ERR;
+
+	bzero(&umemReg, sizeof umemReg);
+	umemReg.addr = (unsigned long)pQueue->umem;
+	umemReg.len = (__u64)ECHO_XDP_FRAMES * ECHO_XDP_FRAME_SIZE;
+	umemReg.chunk_size = ECHO_XDP_FRAME_SIZE;
+
+	if (setsockopt(pQueue->fd, SOL_XDP, XDP_UMEM_REG, &umemReg, sizeof umemReg) < 0 ||
+		setsockopt(pQueue->fd, SOL_XDP, XDP_UMEM_FILL_RING, &fillSize, sizeof fillSize) < 0 ||
+		setsockopt(pQueue->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringSize, sizeof ringSize) < 0 ||
+		setsockopt(pQueue->fd, SOL_XDP, XDP_RX_RING, &ringSize, sizeof ringSize) < 0 ||
+		setsockopt(pQueue->fd, SOL_XDP, XDP_TX_RING, &ringSize, sizeof ringSize) < 0 ||
+		getsockopt(pQueue->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &offLen) < 0)
+	{
+		log_echo_err("AF_XDP UMEM/ring setup failed errno %d", errno);
+		return ECHO_SET_SOCK_FLG_ERR;
+	}
+
+	if (ECHO_OK != (iRet = echoXdpRingMap(&pQueue->rx, pQueue->fd, &off.rx, ringSize, sizeof(struct xdp_desc),
+										  XDP_PGOFF_RX_RING)) ||
+		ECHO_OK != (iRet = echoXdpRingMap(&pQueue->tx, pQueue->fd, &off.tx, ringSize, sizeof(struct xdp_desc),
+										  XDP_PGOFF_TX_RING)) ||
+		ECHO_OK != (iRet = echoXdpRingMap(&pQueue->fill, pQueue->fd, &off.fr, fillSize, sizeof(__u64),
+										  XDP_UMEM_PGOFF_FILL_RING)) ||
+		ECHO_OK != (iRet = echoXdpRingMap(&pQueue->comp, pQueue->fd, &off.cr, ringSize, sizeof(__u64),
+										  XDP_UMEM_PGOFF_COMPLETION_RING)))
+		return iRet;
+
+	pFill = (__u64 *)pQueue->fill.descs;
+	for (i = 0; i < ECHO_XDP_FRAMES; i++)
+		pFill[i] = (__u64)i * ECHO_XDP_FRAME_SIZE;
+	__atomic_store_n(pQueue->fill.producer, ECHO_XDP_FRAMES, __ATOMIC_RELEASE);
+
+	/*generic (SKB) mode always copies; a native driver may map the UMEM*/
+	bzero(&addr, sizeof addr);
+	addr.sxdp_family = AF_XDP;
+	addr.sxdp_ifindex = ifindex;
+	addr.sxdp_queue_id = pQueue->queue;
+	addr.sxdp_flags = XDP_USE_NEED_WAKEUP | (pConfig->xdpNative ? 0 : XDP_COPY);
+	if (bind(pQueue->fd, (struct sockaddr *)&addr, sizeof addr) < 0)
+	{
+		log_echo_err("AF_XDP bind to queue %d failed errno %d", pQueue->queue, errno);
+		return ECHO_BIND_ERR;
+	}
+
+	echoBusyPollSocket(pQueue->fd, pConfig->busyPoll);
+	echoBusyPollInit(&pQueue->busyPoll, pConfig->busyPoll, pQueue->pStats);
+	return ECHO_OK;
+}
+
+/*UDP checksum over the pseudo header, header and payload, summed in
+  memory order so the result needs no byte swapping*/
+static uint16_t echoXdpUdpChecksum(struct iphdr *pIp, struct udphdr *pUdp, unsigned int len)
+{
+	const uint16_t *p = (const uint16_t *)pUdp;
+	uint32_t sum = 0;
+	uint16_t last = 0;
+
+	pUdp->check = 0;
+	sum += (pIp->saddr & 0xffff) + (pIp->saddr >> 16) + (pIp->daddr & 0xffff) + (pIp->daddr >> 16);
+	sum += htons(IPPROTO_UDP) + htons(len);
+	for (; len > 1; len -= 2)
+		sum += *p++;
+	if (len)
+	{
+		memcpy(&last, p, 1);
+		sum += last;
+	}
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum ? (uint16_t)~sum : 0xffff;
+}
+
+/***********************************************************************
+* Function Name  : echoXdpEcho()
+* Description    : Turn a received echo frame into its reply in place
+* Input          : pQueue - the queue (reflector counter)
+				   pFrame, len - the Ethernet frame
+* Return         : 1 - send the frame back, 0 - drop it
+* Logic          : Swap the MAC and IP addresses and the UDP ports. The
+				   IP checksum does not change with swapped addresses;
+				   the UDP one is recomputed, because a frame from a
+				   local sender (veth) may carry only the partial sum of
+				   checksum offload;
+************************************************************************/
+static int echoXdpEcho(echoXdpQueue *pQueue, char *pFrame, unsigned int len)
+{
+	struct ethhdr *pEth = (struct ethhdr *)pFrame;
+	struct iphdr *pIp = (struct iphdr *)(pEth + 1);
+	struct udphdr *pUdp = (struct udphdr *)(pIp + 1);
+	unsigned char mac[ETH_ALEN];
+	unsigned int udpLen = 0;
+	uint32_t ip = 0;
+	uint16_t port = 0;
+
+	if (len < ECHO_XDP_HEADERS || pEth->h_proto != htons(ETH_P_IP) || pIp->ihl != 5 || pIp->protocol != IPPROTO_UDP)
+		return 0;
+
+	udpLen = ntohs(pUdp->len);
+	if (udpLen < sizeof(struct udphdr) || sizeof(struct ethhdr) + sizeof(struct iphdr) + udpLen > len)
+		return 0;
+
+	memcpy(mac, pEth->h_dest, ETH_ALEN);
+	memcpy(pEth->h_dest, pEth->h_source, ETH_ALEN);
+	memcpy(pEth->h_source, mac, ETH_ALEN);
+	ip = pIp->saddr;
+	pIp->saddr = pIp->daddr;
+	pIp->daddr = ip;
+	port = pUdp->source;
+	pUdp->source = pUdp->dest;
+	pUdp->dest = port;
+
+	if (pQueue->pGlobal->config.udpReflect)
+		echoReflectStamp((char *)(pUdp + 1), udpLen - sizeof(struct udphdr), 0, &pQueue->reflectSeq);
+
+	pUdp->check = echoXdpUdpChecksum(pIp, pUdp, udpLen);
+	ECHO_STAT_ADD(pQueue->pStats->bytesIn, udpLen - sizeof(struct udphdr));
+	return 1;
+}
+
+/*Frames the kernel finished sending go back to the fill ring*/
+static void echoXdpRecycle(echoXdpQueue *pQueue)
+{
+	unsigned int done = echoXdpRingReady(&pQueue->comp);
+	unsigned int cons = *pQueue->comp.consumer;
+	unsigned int prod = *pQueue->fill.producer;
+	__u64 *pComp = (__u64 *)pQueue->comp.descs;
+	__u64 *pFill = (__u64 *)pQueue->fill.descs;
+	unsigned int i = 0;
+
+	/*the fill ring holds every frame, so it always has room*/
+	for (i = 0; i < done; i++)
+		pFill[(prod + i) & (pQueue->fill.size - 1)] = pComp[(cons + i) & (pQueue->comp.size - 1)] & ~(__u64)(ECHO_XDP_FRAME_SIZE - 1);
+
+	__atomic_store_n(pQueue->fill.producer, prod + done, __ATOMIC_RELEASE);
+	__atomic_store_n(pQueue->comp.consumer, cons + done, __ATOMIC_RELEASE);
+	pQueue->outstanding -= done;
+}
+
+/*Echo one batch of the RX ring; returns the frames taken*/
+static unsigned int echoXdpRxBatch(echoXdpQueue *pQueue)
+{
+	struct xdp_desc *pRx = (struct xdp_desc *)pQueue->rx.descs;
+	struct xdp_desc *pTx = (struct xdp_desc *)pQueue->tx.descs;
+	__u64 *pFill = (__u64 *)pQueue->fill.descs;
+	unsigned int ready = echoXdpRingReady(&pQueue->rx);
+	unsigned int room = echoXdpRingFree(&pQueue->tx);
+	unsigned int rxCons = *pQueue->rx.consumer;
+	unsigned int txProd = *pQueue->tx.producer;
+	unsigned int fillProd = *pQueue->fill.producer;
+	unsigned int sent = 0;
+	unsigned int i = 0;
+	struct xdp_desc desc;
+
+	if (ready > ECHO_XDP_BATCH)
+		ready = ECHO_XDP_BATCH;
+
+	for (i = 0; i < ready; i++)
+	{
+		desc = pRx[(rxCons + i) & (pQueue->rx.size - 1)];
+		if (sent < room && echoXdpEcho(pQueue, pQueue->umem + desc.addr, desc.len))
+		{
+			pTx[(txProd + sent) & (pQueue->tx.size - 1)] = desc;
+			ECHO_STAT_ADD(pQueue->pStats->bytesOut, desc.len - ECHO_XDP_HEADERS);
+			sent++;
+		}
+		else
+		{
+			/*not an echo datagram or no room to send: the frame goes back to the fill ring*/
+			pFill[fillProd++ & (pQueue->fill.size - 1)] = desc.addr & ~(__u64)(ECHO_XDP_FRAME_SIZE - 1);
+			ECHO_STAT_ADD(pQueue->pStats->udpDropped, 1);
+		}
+	}
+
+	__atomic_store_n(pQueue->rx.consumer, rxCons + ready, __ATOMIC_RELEASE);
+	__atomic_store_n(pQueue->fill.producer, fillProd, __ATOMIC_RELEASE);
+	__atomic_store_n(pQueue->tx.producer, txProd + sent, __ATOMIC_RELEASE);
+	pQueue->outstanding += sent;
+
+	ECHO_STAT_ADD(pQueue->pStats->datagrams, ready);
+	ECHO_STAT_ADD(pQueue->pStats->xdpPackets, sent);
+
+	/*one syscall per batch, and only when the kernel asks for it (copy
+	  mode always does - it sends from within the syscall)*/
+	if (sent && (__atomic_load_n(pQueue->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) &&
+		sendto(pQueue->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0 &&
+		errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+		ECHO_STAT_ADD(pQueue->pStats->sendErrors, 1);
+
+	return ready;
+}
+
+/************************************************************************
+* Function Name  : echoXdpWorker()
+* Description    : A function that will be executed by pthread; echoes
+				   the datagrams of one AF_XDP queue
+* Input          : pQueue - the queue
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : While the RX ring has frames they are echoed in
+				   batches without any syscall; an empty ring blocks in
+				   poll() (--busy-poll: after spinning), with frames
+				   still on the TX ring only briefly, so their
+				   completions are recycled;
+*************************************************************************/
+void *echoXdpWorker(void *pQueuePar)
+{
+	echoXdpQueue *pQueue = (echoXdpQueue *)pQueuePar;
+	struct pollfd pfd = {pQueue->fd, POLLIN, 0};
+	unsigned int taken = 0;
+	int blockMs = -1;
+	static ECHO_STATUS ret;
+
+	log_echo("AF_XDP queue %d is serving udp sock=[%d] on cpu %d", pQueue->queue, pQueue->fd, sched_getcpu());
+
+	while (1)
+	{
+		echoXdpRecycle(pQueue);
+		taken = echoXdpRxBatch(pQueue);
+
+		if (pQueue->busyPoll.spinNs)
+		{
+			echoBusyPollWoke(&pQueue->busyPoll, taken);
+			echoBusyPollWorked(&pQueue->busyPoll);
+		}
+		if (taken)
+			continue;
+
+		blockMs = pQueue->outstanding ? ECHO_XDP_WAIT_MS : -1;
+		if (pQueue->busyPoll.spinNs && 0 == (blockMs = echoBusyPollTimeout(&pQueue->busyPoll, blockMs)))
+			continue;
+
+		if (poll(&pfd, 1, blockMs) < 0 && errno != EINTR)
+		{
+			log_echo_err("poll on AF_XDP queue %d failed errno %d", pQueue->queue, errno);
+			ret = ECHO_FAIL;
+			pthread_exit(&ret);
+		}
+	}
+
+	ret = ECHO_OK;
+	pthread_exit(&ret);
+}
+
+/*Counter slots the AF_XDP queues take after the backend's own*/
+int echoXdpSlots(echoServerConfig *pConfig)
+{
+	return pConfig->xdpIfname ? pConfig->xdpQueues : 0;
+}
+
+/*********************************************************************
+* Function Name  : echoXdpStart()
+* Description    : Start the AF_XDP fast path of the UDP echo server
+* Input          : pGlobal - the server, config.xdpIfname/xdpQueues
+				   firstSlot - counter slot of the first queue
+* Return         : ECHO_STATUS to indicate error/success
+* Logic          : Open one AF_XDP socket per RX queue, register them in
+				   an XSKMAP and attach the steering program to the
+				   interface (generic SKB mode unless --xdp-native)
+				   through a BPF link, which the kernel detaches when
+				   the server exits. The socket backend keeps serving
+				   TCP and whatever the program passes on;
+***********************************************************************/
+ECHO_STATUS echoXdpStart(EchoGlobal_t *pGlobal, int firstSlot)
+{
+	echoServerConfig *pConfig = &pGlobal->config;
+	echoXdpQueue *pQueues = NULL;
+	pthread_attr_t attr;
+	union bpf_attr bpfAttr;
+	int ifindex = 0;
+	int mapFd = -1;
+	int progFd = -1;
+	int linkFd = -1;
+	int i = 0;
+	ECHO_STATUS iRet = ECHO_OK;
+
+	if (!pConfig->xdpIfname)
+		return ECHO_OK;
+
+	if (0 == (ifindex = if_nametoindex(pConfig->xdpIfname)))
+	{
+		log_echo_err("No interface %s for AF_XDP", pConfig->xdpIfname);
+		return ECHO_BAD_PARAM;
+	}
+
+	if (NULL == (pQueues = calloc(pConfig->xdpQueues, sizeof(echoXdpQueue))))
+		return ECHO_NO_MEM_ERR;
+
+	bzero(&bpfAttr, sizeof bpfAttr);
+	bpfAttr.map_type = BPF_MAP_TYPE_XSKMAP;
+	bpfAttr.key_size = sizeof(int);
+	bpfAttr.value_size = sizeof(int);
+	bpfAttr.max_entries = pConfig->xdpQueues;
+	if ((mapFd = echoXdpBpf(BPF_MAP_CREATE, &bpfAttr)) < 0)
+	{
+		log_echo_err("XSKMAP create failed errno %d", errno);
+		return ECHO_FAIL;
+	}
+
+	for (i = 0; i < pConfig->xdpQueues; i++)
+	{
+		pQueues[i].queue = i;
+		pQueues[i].pGlobal = pGlobal;
+		pQueues[i].pStats = echoStatsSlotGet(firstSlot + i);
+		if (ECHO_OK != (iRet = echoXdpQueueInit(&pQueues[i], ifindex, pConfig)))
+			return iRet;
+
+		bzero(&bpfAttr, sizeof bpfAttr);
+		bpfAttr.map_fd = mapFd;
+		bpfAttr.key = (unsigned long)&pQueues[i].queue;
+		bpfAttr.value = (unsigned long)&pQueues[i].fd;
+		if (echoXdpBpf(BPF_MAP_UPDATE_ELEM, &bpfAttr) < 0)
+		{
+			log_echo_err("XSKMAP update of queue %d failed errno %d", i, errno);
+			return ECHO_FAIL;
+		}
+	}
+
+	if ((progFd = echoXdpProgLoad(pConfig->port, mapFd)) < 0)
+		return ECHO_FAIL;
+
+	bzero(&bpfAttr, sizeof bpfAttr);
+	bpfAttr.link_create.prog_fd = progFd;
+	bpfAttr.link_create.target_ifindex = ifindex;
+	bpfAttr.link_create.attach_type = BPF_XDP;
+	bpfAttr.link_create.flags = pConfig->xdpNative ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+	if ((linkFd = echoXdpBpf(BPF_LINK_CREATE, &bpfAttr)) < 0)
+	{
+		log_echo_err("Attaching XDP to %s failed errno %d", pConfig->xdpIfname, errno);
+		return ECHO_FAIL;
+	}
+
+	for (i = 0; i < pConfig->xdpQueues; i++)
+	{
+		/*queue n runs on the CPU after the last worker's in --cpus*/
+		if (ECHO_OK != (iRet = echoAffinityAttrInit(&attr, &pConfig->cpus, firstSlot + i)))
+			return iRet;
+		if (pthread_create(&pQueues[i].threadId, &attr, echoXdpWorker, (void*)&pQueues[i]) != 0)
+			iRet = ECHO_PTHREAD_ERR;
+		pthread_attr_destroy(&attr);
+		if (ECHO_OK != iRet)
+		{
+			perror("could not create thread - echoXdpWorker!");
+			return iRet;
+		}
+	}
+
+	log_echo("AF_XDP on %s (%s mode): %d queue(s), udp port %d", pConfig->xdpIfname, pConfig->xdpNative ? "native" : "skb",
+			 pConfig->xdpQueues, pConfig->port);
+	return ECHO_OK;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#include "echo_main.h"
+#include "echo_zerocopy.h"
+
+/***********************************************************************
+* Function Name  : echoZcSocket()
+* Description    : Allow MSG_ZEROCOPY sends on a TCP listener
+* Input          : sock - the listening socket, accepted sockets inherit
+				   SO_ZEROCOPY
+				   pConfig - zeroCopy, cleared when the kernel refuses
+* Logic          : Without SO_ZEROCOPY the kernel ignores MSG_ZEROCOPY
+				   and copies without reporting a completion - pinned
+				   buffers would never come back, so the option has to
+				   be in place before the first send uses the flag;
+************************************************************************/
+void echoZcSocket(int sock, echoServerConfig *pConfig)
+{
+	if (!pConfig->zeroCopy)
+		return;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &(int){1}, sizeof(int)) < 0)
+	{
+		log_echo_warn("setsockopt(SO_ZEROCOPY) failed errno %d, TCP echoes are copied", errno);
+		pConfig->zeroCopy = 0;
+	}
+}
+
+/***********************************************************************
+* Function Name  : echoZcSend()
+* Description    : Send part of a buffer with MSG_ZEROCOPY
+* Input          : fd - TCP socket with SO_ZEROCOPY
+				   pZc - the socket's sends in flight
+				   pBuf - the buffer, off/len - the bytes to send
+				   pStats - counters of the calling thread
+* Return         : what send() returns
+* Logic          : The kernel sends from the pages of pBuf until it
+				   reports the send complete; every send that took
+				   data adds to the buffer's pending sends, and the
+				   caller has to echoZcPin() it before the buffer is
+				   written again. Pages pinned by zerocopy sends count
+				   against net.core.optmem_max - at the limit the send
+				   fails with ENOBUFS and the data is copied instead;
+************************************************************************/
+ssize_t echoZcSend(int fd, echoZcInflight *pZc, echoBuf *pBuf, unsigned int off, unsigned int len, echoStatsSlot *pStats)
+{
+	ssize_t n = send(fd, pBuf->data + off, len, MSG_NOSIGNAL | MSG_ZEROCOPY);
+
+	if (n < 0 && errno == ENOBUFS)
+	{
+		ECHO_STAT_ADD(pStats->zcFallbacks, 1);
+		return send(fd, pBuf->data + off, len, MSG_NOSIGNAL);
+	}
+	if (n <= 0)
+		return n;
+
+	if (pBuf->zcPending == 0)
+		pBuf->zcFirst = pZc->nextSeq;
+	pBuf->zcLast = pZc->nextSeq++;
+	pBuf->zcPending++;
+	ECHO_STAT_ADD(pStats->zcSends, 1);
+	return n;
+}
+
+/*Keep a buffer out of the pool while the kernel sends from it; returns
+  0 when no zerocopy send used it, the buffer is free to reuse*/
+int echoZcPin(echoZcInflight *pZc, echoBuf *pBuf)
+{
+	if (pBuf->zcPending == 0)
+		return 0;
+
+	pBuf->next = NULL;
+	if (pZc->pTail)
+		pZc->pTail->next = pBuf;
+	else
+		pZc->pHead = pBuf;
+	pZc->pTail = pBuf;
+	pZc->count++;
+	return 1;
+}
+
+/*Count the sends lo..hi complete; buffers without pending sends go back
+  to the pool. Sequence numbers wrap, so they are compared by distance*/
+static int echoZcComplete(echoZcInflight *pZc, echoBufPool *pPool, unsigned int lo, unsigned int hi)
+{
+	echoBuf *pPrev = NULL;
+	echoBuf *pBuf = pZc->pHead;
+	echoBuf *pNext = NULL;
+	unsigned int from = 0;
+	unsigned int to = 0;
+	int released = 0;
+
+	/*the list is in send order, nothing past hi is affected*/
+	for (; pBuf && (int)(pBuf->zcFirst - hi) <= 0; pBuf = pNext)
+	{
+		pNext = pBuf->next;
+		from = (int)(pBuf->zcFirst - lo) > 0 ? pBuf->zcFirst : lo;
+		to = (int)(pBuf->zcLast - hi) < 0 ? pBuf->zcLast : hi;
+		if ((int)(to - from) >= 0)
+			pBuf->zcPending -= to - from + 1;
+
+		if (pBuf->zcPending > 0)
+		{
+			pPrev = pBuf;
+			continue;
+		}
+
+		if (pPrev)
+			pPrev->next = pNext;
+		else
+			pZc->pHead = pNext;
+		if (pZc->pTail == pBuf)
+			pZc->pTail = pPrev;
+		pZc->count--;
+		echoBufPut(pPool, pBuf);
+		released++;
+	}
+
+	return released;
+}
+
+/***********************************************************************
+* Function Name  : echoZcReap()
+* Description    : Read the zerocopy completions of a socket
+* Input          : fd - the socket
+				   pZc - its pinned buffers
+				   pPool - where released buffers go
+				   pStats - counters of the calling thread
+* Return         : number of buffers released
+* Logic          : Every report on the error queue covers a range of
+				   sends (ee_info..ee_data). SO_EE_CODE_ZEROCOPY_COPIED
+				   says the kernel copied the data after all - always
+				   the case on loopback, where the pages would otherwise
+				   reach the receiving socket;
+************************************************************************/
+int echoZcReap(int fd, echoZcInflight *pZc, echoBufPool *pPool, echoStatsSlot *pStats)
+{
+	union
+	{
+		char buf[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+		struct cmsghdr align;
+	}control;
+	struct msghdr msg;
+	struct cmsghdr *pCmsg = NULL;
+	struct sock_extended_err *pErr = NULL;
+	unsigned int sends = 0;
+	int released = 0;
+
+	while (pZc->count > 0)
+	{
+		bzero(&msg, sizeof msg);
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof control.buf;
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (pCmsg = CMSG_FIRSTHDR(&msg); pCmsg; pCmsg = CMSG_NXTHDR(&msg, pCmsg))
+		{
+			if (!(pCmsg->cmsg_level == SOL_IP && pCmsg->cmsg_type == IP_RECVERR) &&
+				!(pCmsg->cmsg_level == SOL_IPV6 && pCmsg->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			pErr = (struct sock_extended_err *)CMSG_DATA(pCmsg);
+			if (pErr->ee_errno != 0 || pErr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			sends = pErr->ee_data - pErr->ee_info + 1;
+			ECHO_STAT_ADD(pStats->zcCompletions, sends);
+			if (pErr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				ECHO_STAT_ADD(pStats->zcCopied, sends);
+			released += echoZcComplete(pZc, pPool, pErr->ee_info, pErr->ee_data);
+		}
+	}
+
+	return released;
+}
+
+/***********************************************************************
+* Function Name  : echoZcWait()
+* Description    : Blocking socket: wait until the kernel releases one
+				   of the pinned buffers
+* Input          : see echoZcReap()
+* Return         : number of buffers released, 0 - none within
+				   ECHO_ZC_WAIT_MS (a peer that stopped reading keeps
+				   the data unacknowledged)
+************************************************************************/
+int echoZcWait(int fd, echoZcInflight *pZc, echoBufPool *pPool, echoStatsSlot *pStats)
+{
+	struct pollfd pfd;
+	int waited = 0;
+	int released = 0;
+
+	pfd.fd = fd;
+	pfd.events = 0;
+	for (waited = 0; pZc->count > 0 && waited < ECHO_ZC_WAIT_MS; waited += ECHO_ZC_POLL_MS)
+	{
+		if ((released = echoZcReap(fd, pZc, pPool, pStats)) > 0)
+			return released;
+
+		/*a socket with reports on its error queue polls as POLLERR
+		  whatever events were asked for; a hung up one polls at once*/
+		if (poll(&pfd, 1, ECHO_ZC_POLL_MS) > 0 && !(pfd.revents & POLLERR))
+			usleep(ECHO_ZC_POLL_MS * 1000);
+	}
+
+	return 0;
+}
+
+/*Put every pinned buffer back without its completions - only once the
+  socket is gone and nothing can be sent from them any more*/
+void echoZcDrop(echoZcInflight *pZc, echoBufPool *pPool)
+{
+	echoBuf *pBuf = NULL;
+
+	while ((pBuf = pZc->pHead))
+	{
+		pZc->pHead = pBuf->next;
+		pBuf->zcPending = 0;
+		echoBufPut(pPool, pBuf);
+	}
+
+	pZc->pTail = NULL;
+	pZc->count = 0;
+}
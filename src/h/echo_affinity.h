@@ -0,0 +1,24 @@
+#ifndef _ECHO_AFFINITY_H_
+#define _ECHO_AFFINITY_H_
+
+#include <pthread.h>
+
+#define ECHO_AFFINITY_MAX_CPUS 512 /*entries of one CPU list*/
+
+/*CPUs given on the command line as "0-3,8,10-11", in that order; the
+  n-th worker/thread runs on cpus[n % count]. count 0 - no pinning*/
+typedef struct echoCpuList_t
+{
+	int count;
+	int cpus[ECHO_AFFINITY_MAX_CPUS];
+}echoCpuList;
+
+ECHO_STATUS echoCpuListParse(const char *szList, echoCpuList *pList);
+int echoAffinityCpu(const echoCpuList *pList, int index);
+ECHO_STATUS echoAffinityAttrInit(pthread_attr_t *pAttr, const echoCpuList *pList, int index);
+ECHO_STATUS echoAffinityPinSelf(const echoCpuList *pList);
+int echoAffinityCpuNode(int cpu);
+void echoAffinityMemPrefer(int node);
+void echoAffinityIncomingCpu(int sock, int cpu);
+
+#endif /* _ECHO_AFFINITY_H_ */
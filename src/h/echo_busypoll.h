@@ -0,0 +1,41 @@
+#ifndef _ECHO_BUSYPOLL_H_
+#define _ECHO_BUSYPOLL_H_
+
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include "echo_main.h"
+#include "echo_stats.h"
+
+#define ECHO_BUSY_POLL_BUDGET 64 /*packets per busy-poll round, more needs CAP_NET_ADMIN*/
+
+/*epoll busy-poll parameters, Linux >= 6.9; older headers lack them*/
+#ifndef EPIOCSPARAMS
+struct epoll_params
+{
+	__u32 busy_poll_usecs;
+	__u16 busy_poll_budget;
+	__u8 prefer_busy_poll;
+	__u8 __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+/*Spin state of one server worker. The worker polls without blocking
+  while it finds work; after spinNs without any it blocks until the next
+  event, so an idle server does not burn a core*/
+typedef struct echoBusyPoll_t
+{
+	unsigned long long spinNs; /*0 - busy polling is off*/
+	unsigned long long idleSince; /*first empty poll of the current spin, 0 - not spinning*/
+	unsigned long long workSince; /*the worker found events and is handling them, 0 - not*/
+	int blocked; /*the last wait was a blocking one*/
+	echoStatsSlot *pStats;
+}echoBusyPoll;
+
+void echoBusyPollSocket(int sock, int usecs);
+void echoBusyPollInit(echoBusyPoll *pBusy, int usecs, echoStatsSlot *pStats);
+int echoBusyPollTimeout(echoBusyPoll *pBusy, int blockMs);
+void echoBusyPollWoke(echoBusyPoll *pBusy, int events);
+void echoBusyPollWorked(echoBusyPoll *pBusy);
+
+#endif /* _ECHO_BUSYPOLL_H_ */
@@ -0,0 +1,33 @@
+#ifndef _ECHO_CHURN_H_
+#define _ECHO_CHURN_H_
+
+#include "echo_main.h"
+#include "echo_hist.h"
+
+typedef struct echoChurnStats_t
+{
+	unsigned long connections; /*connect + echo + close cycles that completed*/
+	unsigned long errors; /*failed connects/sends, broken or corrupted echoes*/
+	unsigned long timeouts;
+	unsigned long synData; /*TFO: connections whose data went out with the SYN*/
+}echoChurnStats;
+
+/*One churn thread; it opens, uses and closes one connection at a time*/
+typedef struct echoChurnThread_t
+{
+	int id;
+	pthread_t threadId;
+	echoClientGlobal_t *pClient; /*server address and settings*/
+	char *pRequest;
+	char *pEcho;
+	unsigned long long endNs;
+	echoChurnStats stats;
+	echoHist connectLatency; /*socket() until the connection can carry data*/
+	echoHist cycleLatency; /*socket() until the echo is verified and the socket closed*/
+}echoChurnThread;
+
+void *echoChurnWorker(void *pThread);
+
+ECHO_STATUS echoChurnStart(char **arg_values, echoClientConfig *pConfig);
+
+#endif /* _ECHO_CHURN_H_ */
@@ -0,0 +1,127 @@
+#ifndef _ECHO_EPOLL_H_
+#define _ECHO_EPOLL_H_
+
+#include <sys/epoll.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+#include "echo_stats.h"
+#include "echo_busypoll.h"
+#include "echo_zerocopy.h"
+#include "echo_slab.h"
+
+#define ECHO_EPOLL_MAX_EVENTS 256
+#define ECHO_EPOLL_PAUSE_MS 100 /*How often a paused listener re-checks tcpMaxConnections*/
+#define ECHO_SPLICE_PIPE_SIZE (256 * 1024) /*capacity requested for the pooled pipes*/
+#define ECHO_SPLICE_POOL_MAX 1024 /*idle pipes kept per reactor*/
+#define ECHO_TCP_RING_SIZE (16 * 1024) /*output ring of a connection, also the read size; --buffer-size*/
+#define ECHO_TCP_RING_HIGH_WATER(cap) ((cap) * 3 / 4) /*stop reading a client above this*/
+
+/*Kind of descriptor registered in the reactor*/
+#define ECHO_CONN_TCP_LISTEN 1
+#define ECHO_CONN_UDP 2
+#define ECHO_CONN_TCP 3
+#define ECHO_CONN_TLS_LISTEN 4
+#define ECHO_CONN_TLS_HANDSHAKE 5 /*accepted on the TLS listener, handshake not complete*/
+#define ECHO_CONN_TLS 6 /*established, OpenSSL encrypts; with kTLS both ways the client becomes ECHO_CONN_TCP*/
+#define ECHO_CONN_TCP_ZC_CLOSING 7 /*client gone, the socket is kept until the kernel releases its zerocopy buffers or ECHO_ZC_CLOSE_MS*/
+
+/*A descriptor registered in the reactor. Clients come from the reactor's
+  connection slab and hold no buffer while they are idle - a pipe, a ring
+  or a pinned buffer is attached only while their data is in flight - so
+  the flags are bytes: 72 bytes per client*/
+typedef struct echoConn_t
+{
+	int fd;
+	int pipeFds[2]; /*splice mode: pipe borrowed from the reactor pool, -1 if none*/
+	int pipeBytes; /*bytes in the pipe not yet spliced back to the socket*/
+	unsigned int outHead; /*ring offset of the first unsent byte, pOut->len bytes are queued*/
+	unsigned char type;
+	unsigned char outBlocked; /*the socket was full, nothing is sent before EPOLLOUT*/
+	unsigned char readPaused; /*the ring is above the high-water mark*/
+	unsigned char eof; /*the client finished sending, close once the ring is empty*/
+	unsigned char zeroCopy; /*echoes of the TCP listener's clients may be sent with MSG_ZEROCOPY*/
+	union
+	{
+		struct
+		{
+			echoBuf *pOut; /*output ring, attached from the pool while echo data waits for the socket*/
+			struct ssl_st *pTls; /*TLS session of a client of the TLS listener, NULL - plain TCP*/
+		};
+		struct /*ECHO_CONN_TCP_ZC_CLOSING - no ring, no session any more*/
+		{
+			struct echoConn_t *pNextClosing;
+			unsigned long long closeDeadlineMs; /*CLOCK_MONOTONIC*/
+		};
+	};
+	echoZcInflight zc; /*buffers of the reactor pool the kernel still sends from*/
+}echoConn;
+
+/*Idle pipes of one reactor; a connection borrows one while it has data in
+  flight, so pipes are not created and destroyed per connection*/
+typedef struct echoPipePool_t
+{
+	int count;
+	int pipeSize;
+	int fds[ECHO_SPLICE_POOL_MAX][2];
+}echoPipePool;
+
+/*Ancillary data of one datagram: the UDP_GRO segment size on receive,
+  the UDP_SEGMENT size of the echo on send*/
+typedef union echoUdpControl_t
+{
+	char buf[CMSG_SPACE(sizeof(int)) + CMSG_SPACE(sizeof(struct timespec))]; /*UDP_GRO, SO_TIMESTAMPNS*/
+	struct cmsghdr align;
+}echoUdpControl;
+
+/*Preallocated recvmmsg()/sendmmsg() vectors; datagram i is received
+  into buffers + i * slotSize from addrs[i] and reflected in place;
+  slots are cache-line aligned*/
+typedef struct echoUdpBatch_t
+{
+	int size;
+	int slotSize;
+	int gro;
+	int reflect; /*stamp reflector test datagrams*/
+	unsigned int reflectSeq; /*reflector counter of this reactor*/
+	size_t buffersSize; /*bytes mapped for buffers*/
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	struct sockaddr_storage *addrs; /*IPv4 or unix domain sources*/
+	echoUdpControl *controls;
+	char *buffers;
+}echoUdpBatch;
+
+/*Reactor state - one epoll instance owning the listening sockets, the UDP
+  socket and every accepted TCP client*/
+typedef struct echoWorker_t
+{
+	int id;
+	int local; /*serves the unix domain sockets*/
+	int epfd;
+	int tcpSocket;
+	int udpSocket;
+	int tlsSocket; /*TLS listener, -1 - none*/
+	int listenPaused;
+	pthread_t threadId;
+	EchoGlobal_t *pGlobal;
+	echoConn tcpListenConn;
+	echoConn udpConn;
+	echoConn tlsListenConn;
+	echoUdpBatch udpBatch;
+	echoPipePool *pPipePool;
+	echoStatsSlot *pStats; /*this reactor's counters in the shared segment*/
+	echoBufPool bufPool;
+	echoSlab connSlab; /*state of the clients*/
+	echoConn *pClosingHead; /*closed zerocopy clients waiting for completions, oldest first*/
+	echoConn *pClosingTail;
+	echoBuf *pRecvBuf; /*TCP data is echoed from here while a client has nothing queued*/
+	unsigned int zcThreshold; /*--zerocopy: smallest echo sent with MSG_ZEROCOPY, 0 - off*/
+	echoBusyPoll busyPoll; /*--busy-poll: spin state, spinNs 0 - always block*/
+}echoWorker;
+
+void *echoEpollWorker(void *pWorker);
+
+ECHO_STATUS echoEpollServersStart(EchoGlobal_t *pGlobal);
+ECHO_STATUS echoEpollAuxStart(EchoGlobal_t *pGlobal, int slot);
+
+#endif /* _ECHO_EPOLL_H_ */
@@ -0,0 +1,30 @@
+#ifndef _ECHO_HIST_H_
+#define _ECHO_HIST_H_
+
+#include "echo_main.h"
+
+/*Log-linear (HDR-style) latency histogram: values below 2^SUB_BITS ns are
+  exact, above that every power of 2 is split into 2^(SUB_BITS-1) equal
+  buckets, so any recorded value is off by less than 1%*/
+#define ECHO_HIST_SUB_BITS 8
+#define ECHO_HIST_SUB_COUNT (1 << ECHO_HIST_SUB_BITS)
+#define ECHO_HIST_HALF_COUNT (ECHO_HIST_SUB_COUNT / 2)
+#define ECHO_HIST_MAX_BITS 40 /*about 18 minutes, longer values are clamped*/
+#define ECHO_HIST_BUCKETS (ECHO_HIST_SUB_COUNT + (ECHO_HIST_MAX_BITS - ECHO_HIST_SUB_BITS + 1) * ECHO_HIST_HALF_COUNT)
+
+typedef struct echoHist_t
+{
+	unsigned long count;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long sum;
+	unsigned long counts[ECHO_HIST_BUCKETS];
+}echoHist;
+
+void echoHistInit(echoHist *pHist);
+void echoHistRecord(echoHist *pHist, unsigned long long value);
+void echoHistMerge(echoHist *pDst, echoHist *pSrc);
+unsigned long long echoHistPercentile(echoHist *pHist, double percentile);
+void echoHistPrint(echoHist *pHist, char *szName);
+
+#endif /* _ECHO_HIST_H_ */
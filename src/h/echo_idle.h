@@ -0,0 +1,37 @@
+#ifndef _ECHO_IDLE_H_
+#define _ECHO_IDLE_H_
+
+#include "echo_main.h"
+
+#define ECHO_IDLE_WINDOW 256 /*connects or probes in flight, well below the listen() backlog*/
+#define ECHO_IDLE_MAX_EVENTS 256
+#define ECHO_IDLE_PER_SOURCE 20000 /*loopback: connections per source address, each has the ~28k ephemeral ports*/
+#define ECHO_IDLE_SETTLE_S 1 /*wait before the memory is sampled*/
+#define ECHO_IDLE_PROBE 'i' /*the byte every connection echoes*/
+
+/*State of one connection of the idle client*/
+#define ECHO_IDLE_CLOSED 0
+#define ECHO_IDLE_CONNECTING 1
+#define ECHO_IDLE_ECHOING 2 /*the probe is sent, its echo not back yet*/
+#define ECHO_IDLE_IDLE 3
+
+/*Many connections that stay open and silent; a round connects them (or
+  probes the open ones) a window at a time and waits for the echo of one
+  byte on each, so the server has accepted and served every one*/
+typedef struct echoIdle_t
+{
+	echoClientGlobal_t *pClient; /*server address and settings*/
+	int epfd;
+	int count; /*connections asked for*/
+	int *fds;
+	unsigned char *states;
+	int loopback; /*spread the connections over 127.0.0.x source addresses*/
+	int pending; /*connects/probes of the round in flight*/
+	int echoed; /*connections of the round whose probe came back*/
+	int failed;
+	int lastErrno;
+}echoIdle;
+
+ECHO_STATUS echoIdleStart(char **arg_values, echoClientConfig *pConfig);
+
+#endif /* _ECHO_IDLE_H_ */
@@ -0,0 +1,71 @@
+#ifndef _ECHO_LOAD_H_
+#define _ECHO_LOAD_H_
+
+#include <sys/epoll.h>
+#include "echo_main.h"
+#include "echo_hist.h"
+
+#define ECHO_LOAD_THREADS_DEFAULT 1
+#define ECHO_LOAD_CONNECTIONS_DEFAULT 1
+#define ECHO_LOAD_DURATION_DEFAULT 10 /*seconds*/
+#define ECHO_LOAD_SIZE_DEFAULT 64
+#define ECHO_LOAD_DEPTH_DEFAULT 1
+#define ECHO_LOAD_TIMEOUT_DEFAULT 1000 /*ms*/
+#define ECHO_LOAD_MAX_UDP_SIZE 65507 /*biggest UDP payload*/
+#define ECHO_LOAD_MAX_TCP_SIZE ECHO_BUFSIZE_MAX
+#define ECHO_LOAD_MAX_SIZE(protocol) ((protocol) == IPPROTO_UDP ? ECHO_LOAD_MAX_UDP_SIZE : ECHO_LOAD_MAX_TCP_SIZE)
+#define ECHO_LOAD_MAX_THREADS 256
+#define ECHO_LOAD_MAX_EVENTS 256
+#define ECHO_LOAD_RECV_BUFSIZE (64 * 1024)
+#define ECHO_LOAD_TICK_MS 10 /*how often the timeouts are checked*/
+#define ECHO_LOAD_OPEN_SLOTS 4096 /*open loop: requests in flight per connection before sends are missed*/
+
+typedef struct echoLoadStats_t
+{
+	unsigned long sent; /*requests put on the wire*/
+	unsigned long missed; /*open loop: sends skipped, too many requests in flight*/
+	unsigned long requests; /*echoes received and verified*/
+	unsigned long bytes; /*payload bytes echoed back*/
+	unsigned long errors; /*corrupted echoes, failed sends, broken connections*/
+	unsigned long timeouts;
+}echoLoadStats;
+
+/*One connection of the load generator; requests are answered in order,
+  so the send times of the requests in flight are kept in a FIFO*/
+typedef struct echoLoadConn_t
+{
+	int fd;
+	struct echoShmConn_t *pShm; /*shm: the channel instead of fd*/
+	struct ssl_st *pTls; /*--tls: the session on fd*/
+	unsigned long pendingBytes; /*TCP: bytes of issued requests not yet written*/
+	unsigned int txOff; /*TCP: offset in the request being written*/
+	unsigned int rxOff; /*TCP: offset in the echo being received*/
+	int wantOut; /*TCP: EPOLLOUT is armed, the socket was full*/
+	int head; /*oldest request in flight*/
+	int inflight;
+	unsigned long long *issued; /*send time of every request in flight, slots entries*/
+}echoLoadConn;
+
+typedef struct echoLoadThread_t
+{
+	int id;
+	int epfd;
+	pthread_t threadId;
+	echoClientGlobal_t *pClient; /*server address, protocol and settings*/
+	echoLoadConn *conns;
+	int slots; /*capacity of every issued FIFO*/
+	char *pattern; /*payload of every request*/
+	char *recvBuffer;
+	unsigned long long endNs;
+	unsigned long long nextNs; /*open loop: when the next request is due*/
+	unsigned long long intervalNs; /*open loop: time between two requests of this thread*/
+	int nextConn; /*open loop: connections take turns*/
+	echoLoadStats stats;
+	echoHist latency;
+}echoLoadThread;
+
+void *echoLoadWorker(void *pThread);
+
+ECHO_STATUS echoLoadStart(char **arg_values, echoClientConfig *pConfig);
+
+#endif /* _ECHO_LOAD_H_ */
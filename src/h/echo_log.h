@@ -0,0 +1,39 @@
+#ifndef _ECHO_LOG_H_
+#define _ECHO_LOG_H_
+
+/*Log levels, a message is kept when its level <= echoLogLevel*/
+#define ECHO_LOG_ERR 0
+#define ECHO_LOG_WARN 1
+#define ECHO_LOG_INFO 2
+#define ECHO_LOG_DEBUG 3
+#define ECHO_LOG_LEVEL_DEFAULT ECHO_LOG_INFO
+
+#define ECHO_LOG_RING_RECORDS 1024 /*messages a thread can have waiting for the writer, power of 2*/
+#define ECHO_LOG_RECORD_TEXT 240 /*longer messages are truncated*/
+#define ECHO_LOG_FLUSH_MS 20 /*how long the idle writer sleeps*/
+
+extern int echoLogLevel;
+
+/*Every call is filtered by level before anything is formatted. While the
+  asynchronous writer runs (the server) a message is only copied to the
+  calling thread's ring; otherwise it is printed to stderr right away*/
+#define echo_log(level, format, argum...) \
+	({if ((level) <= __atomic_load_n(&echoLogLevel, __ATOMIC_RELAXED)) echoLogWrite((level), " "format"\r\n", ##argum);})
+
+#define log_echo_err(format, argum...) echo_log(ECHO_LOG_ERR, format, ##argum)
+#define log_echo_warn(format, argum...) echo_log(ECHO_LOG_WARN, format, ##argum)
+
+/*Release builds (make RELEASE=1) drop the debug call sites completely,
+  arguments included*/
+#ifdef ECHO_RELEASE
+#define log_echo_debug(format, argum...) ({(void)0;})
+#else
+#define log_echo_debug(format, argum...) echo_log(ECHO_LOG_DEBUG, format, ##argum)
+#endif
+
+int echoLogLevelParse(const char *szLevel);
+ECHO_STATUS echoLogStart(const char *szPath);
+void echoLogStop(void);
+void echoLogWrite(int level, const char *szFormat, ...) __attribute__((format(printf, 2, 3)));
+
+#endif /* _ECHO_LOG_H_ */
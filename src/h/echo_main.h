@@ -20,15 +20,37 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
-
-#define log_echo(format, argum...) ({fprintf(stderr," "format"\r\n",##argum);})
+#include <sys/un.h>
 
 /*Default echo port is 7, if you use it execute the program as priviledged user;
   You can execute as unpriviledged user for numbers higher that 1024*/
 #define ECHO_PORT_DEFAULT 7 
-#define ECHO_TCP_BACKLOG 100
+#define ECHO_TCP_BACKLOG 4096 /*default listen() backlog, capped by net.core.somaxconn*/
 #define ECHO_BUFSIZE 1024
-#define ECHO_MAX_MSG_SIZE 260 /*Extra 4 bytes just in case*/
+#define ECHO_BUFSIZE_MAX (16 * 1024 * 1024) /*--buffer-size*/
+#define ECHO_SOCKBUF_MAX (1024 * 1024 * 1024) /*--sndbuf, --rcvbuf*/
+#define ECHO_MSG_SHOW_MAX 256 /*client: longer messages are shown cut*/
+#define ECHO_LEGACY_STACK_SIZE (64 * 1024) /*stack of a legacy client thread instead of the default 8 MB*/
+#define ECHO_FD_RESERVE 4096 /*descriptors beyond the clients: listeners, pooled pipes, the log*/
+
+/*--buffer-size of a server, or the default of the I/O model*/
+#define ECHO_CONFIG_BUFSIZE(pConfig, def) ((pConfig)->bufSize > 0 ? (pConfig)->bufSize : (def))
+
+/*Server I/O models*/
+#define ECHO_IO_LEGACY 0 /*thread per TCP client*/
+#define ECHO_IO_EPOLL 1 /*edge-triggered epoll reactor*/
+#define ECHO_IO_URING 2 /*io_uring with multishot operations, falls back to epoll*/
+
+#define ECHO_MAX_WORKERS 256
+#define ECHO_XDP_MAX_QUEUES 64 /*AF_XDP sockets, one per RX queue*/
+#define ECHO_AUX_MAX_THREADS 2 /*the reactor of the unix sockets (and TLS beside uring/legacy), the shared-memory echo*/
+#define ECHO_UDP_BATCH_DEFAULT 32
+#define ECHO_UDP_BATCH_MAX 1024 /*UIO_MAXIOV*/
+#define ECHO_UDP_BUFSIZE 65535 /*default datagram buffer of the servers, nothing a client can send is cut*/
+#define ECHO_UDP_GRO_BUFSIZE 65535 /*a coalesced GRO datagram can be as big as an IP packet*/
+#define ECHO_CMSG_TIMESTAMP_SPACE 256 /*control buffer for a timestamp and an extended error*/
+#define ECHO_PROTO_SHM 256 /*client <protocol> "shm": shared-memory rings, <ip> is the --shm name*/
+#define ECHO_PROTO_TLS 257 /*server: the TCP listener of --tls-port, its clients speak TLS*/
 
 //create an alias for int
 typedef int ECHO_STATUS;	
@@ -50,6 +72,12 @@ typedef int ECHO_STATUS;
 #define ECHO_PTHREAD_ERR 15
 #define ECHO_NO_ROUTE_TO_HOST 16
 
+#include "echo_log.h"
+#include "echo_affinity.h"
+
+/*Informational messages; see echo_log.h for the other levels*/
+#define log_echo(format, argum...) echo_log(ECHO_LOG_INFO, format, ##argum)
+
 extern const char *arrErrors[];
 
 typedef struct echoServersData_t
@@ -58,17 +86,94 @@ typedef struct echoServersData_t
 	int tcpStatus;
 	int udpSocket;
 	int tcpSocket;
-	int BytesRecv;
 	int tcpMaxConnections;
 	unsigned int iClientsCount;
 }echoServersData;
 
+/*Server settings given on the command line*/
+typedef struct echoServerConfig_t
+{
+	int ioMode;
+	int workers; /*reactors, each with its own SO_REUSEPORT sockets*/
+	int udpBatch; /*datagrams per recvmmsg()/sendmmsg()*/
+	int udpGro; /*receive coalesced datagrams, echo them with UDP_SEGMENT*/
+	int tcpSplice; /*zero-copy TCP echo socket -> pipe -> socket*/
+	int statsInterval; /*seconds between counter reports, 0 - off*/
+	int poolBuffers; /*preallocated echo buffers per reactor*/
+	int hugePages; /*back the buffers with 2 MB pages*/
+	int udpReflect; /*stamp reflector test datagrams with receive/transmit times*/
+	int tcpBacklog; /*listen() backlog*/
+	int deferAccept; /*TCP_DEFER_ACCEPT seconds, 0 - off*/
+	int fastOpen; /*TCP_FASTOPEN queue length, 0 - off*/
+	echoCpuList cpus; /*worker n (legacy: every echo thread) runs on cpus[n]*/
+	echoCpuList listenerCpus; /*legacy TCP listener thread*/
+	int incomingCpu; /*SO_INCOMING_CPU: steer the flows of a CPU to the worker pinned there*/
+	int busyPoll; /*us a worker busy polls before it blocks, also SO_BUSY_POLL; 0 - never spin*/
+	char *xdpIfname; /*AF_XDP fast path for the UDP echo on this interface, NULL - off*/
+	int xdpQueues; /*RX queues of xdpIfname served by AF_XDP sockets*/
+	int xdpNative; /*attach in driver mode instead of generic (SKB) mode*/
+	char *unixStream; /*unix stream listener path, '@' - abstract namespace, NULL - off*/
+	char *unixDgram; /*unix datagram socket path, '@' - abstract namespace, NULL - off*/
+	char *shmName; /*shared-memory ring echo /dev/shm/<shmName>, NULL - off*/
+	int tlsPort; /*TLS echo listener, 0 - off*/
+	char *tlsCert; /*PEM certificate chain, NULL - generate a self-signed one*/
+	char *tlsKey; /*PEM private key, NULL - in tlsCert*/
+	int tlsVersion; /*ECHO_TLS_VERSION_*, 0 - TLS 1.2 or 1.3*/
+	int ktlsOff; /*keep the TLS record layer in user space*/
+	int bufSize; /*TCP receive/echo buffer and UDP datagram slot, 0 - the default of the mode*/
+	int sndBuf; /*SO_SNDBUF of the sockets, 0 - kernel default*/
+	int rcvBuf; /*SO_RCVBUF of the sockets, 0 - kernel default*/
+	int zeroCopy; /*MSG_ZEROCOPY for TCP echoes of at least this many bytes, 0 - off*/
+	int tcpMaxConnections;
+	int port;
+}echoServerConfig;
+
 typedef struct thread_data
 {
 	echoServersData* pData;
 	int sock;	
+	struct echoBuf_t *pBuf; /*pooled buffer the client is echoed through*/
+	int reflect; /*UDP: stamp reflector test datagrams*/
 }pthread_params;
 
+/*Client settings given on the command line*/
+typedef struct echoClientConfig_t
+{
+	int udpGso; /*UDP_SEGMENT size for sends (and UDP_GRO on receive), 0 - off*/
+	int threads; /*load mode: sender threads*/
+	int connections; /*load mode: connections per thread*/
+	int duration; /*load mode: seconds*/
+	int size; /*load mode: payload bytes of one request*/
+	int depth; /*load mode: requests kept in flight per connection*/
+	int timeoutMs; /*load mode: a request without echo after this long is a timeout*/
+	int rate; /*load mode: requests/s sent on a fixed schedule (open loop), 0 - closed loop*/
+	int count; /*ping mode: probes to send*/
+	int interval; /*ping mode: ms between probes*/
+	int port;
+	char *output; /*load mode: CSV file the results are appended to, NULL - none*/
+	int timestamping; /*client and ping mode: SO_TIMESTAMPING, report the kernel-to-kernel (wire) RTT too*/
+	int reflect; /*ping mode: send reflector test datagrams, split the RTT into its legs*/
+	int fastOpen; /*churn mode: open the connections with TCP Fast Open*/
+	echoCpuList cpus; /*load and churn thread n runs on cpus[n], ping on any of them*/
+	int busyPoll; /*shm: us to poll for an echo before sleeping on the futex*/
+	int tls; /*TCP: speak TLS to the server's --tls-port*/
+	int tlsVersion; /*ECHO_TLS_VERSION_*, 0 - TLS 1.2 or 1.3*/
+	int ktlsOff; /*keep the TLS record layer in user space*/
+	int sndBuf; /*SO_SNDBUF of the client sockets, 0 - kernel default*/
+	int rcvBuf; /*SO_RCVBUF of the client sockets, 0 - kernel default*/
+	unsigned long long streamBytes; /*stream mode: payload to echo, 0 - the size of streamFile*/
+	char *streamFile; /*stream mode: file mapped as the payload, NULL - generated*/
+}echoClientConfig;
+
+/*Server address of the client: IPv4, or a unix socket when <ip> is a
+  path or an @abstract name*/
+typedef union echoSockAddr_t
+{
+	struct sockaddr sa;
+	struct sockaddr_in in;
+	struct sockaddr_un un;
+}echoSockAddr;
+
 typedef struct echoClientInstance_t
 {
 	int sockfd;
@@ -77,32 +182,54 @@ typedef struct echoClientInstance_t
 	int waitTime;
 	int sendBytes;
 	int recvMsgLen;
-	char message[ECHO_MAX_MSG_SIZE];
-	char recvMesg[ECHO_MAX_MSG_SIZE];
-	struct timeval startTime;
+	char *message; /*as given on the command line*/
+	char *recvMesg; /*msgLen + 1 bytes, one more shows an echo that is too long*/
+	unsigned long long startNs; /*CLOCK_MONOTONIC time the message was sent*/
 	struct timeval timeout;
-	struct sockaddr_in servAddr;
+	echoSockAddr servAddr;
+	socklen_t servAddrLen;
+	char *szServer; /*<ip> as given: address, unix socket path or shm name*/
+	struct echoShmConn_t *pShm; /*ECHO_PROTO_SHM: the channel, NULL - closed*/
+	struct ssl_st *pTls; /*--tls: the session on sockfd, NULL - plain*/
 	char lastEchoResponse[ECHO_BUFSIZE];
+	echoClientConfig config;
 }echoClientGlobal_t;
 
 typedef struct Echo_Global_Data
 {
 	echoServersData echoServersData;
+	echoServerConfig config;
 } EchoGlobal_t;
 
 void *echoTcpCallback(void *params);
 void *echoTcpListener(void *psGlobal);
-void *echoUdpCallback(void *client_socket);
+void *echoUdpCallback(void *params);
 
 ECHO_STATUS echoHandleErrors(int err);
 ECHO_STATUS echoPrintHelp(char *szProgName);
 ECHO_STATUS echod_SetShutdown (int iEchoProto);
-ECHO_STATUS echoClientStart(char** arg_values);
-ECHO_STATUS echoServersStart(int tcp_max_connection);
+ECHO_STATUS echoClientStart(char** arg_values, echoClientConfig *pConfig);
+ECHO_STATUS echoClientOpen(echoClientGlobal_t* clData);
+ECHO_STATUS echoClientGlobalInit(echoClientGlobal_t **ppGlobal);
+unsigned long long echoClientNowNs(void);
+void echoSocketBuffers(int sock, int sndBuf, int rcvBuf);
+void echoFdLimit(int fds);
+ECHO_STATUS echoClientTimestampEnable(int sockfd);
+unsigned long long echoClientCmsgTimestamp(struct msghdr *pMsg);
+ECHO_STATUS echoClientTxTimestamp(int sockfd, unsigned int *pKey, unsigned long long *pNs);
+ECHO_STATUS echoClientSetServer(echoClientGlobal_t *clData, char *szIp, char *szProtocol);
+const char *echoClientProtoName(echoClientGlobal_t *clData);
+void echoClientClose(echoClientGlobal_t *clData);
+ECHO_STATUS echoServersStart(echoServerConfig *pConfig);
 ECHO_STATUS echoSetSocket(EchoGlobal_t *pGlobal, int iEchoProto);
+ECHO_STATUS echoOpenServerSocket(int iEchoProto, echoServerConfig *pConfig, int reusePort, int *pSock);
+socklen_t echoUnixAddr(const char *szPath, struct sockaddr_un *pAddr);
+ECHO_STATUS echoOpenUnixSocket(int type, const char *szPath, echoServerConfig *pConfig, int *pSock);
+int echoAuxSlots(echoServerConfig *pConfig);
+ECHO_STATUS echoAuxServersStart(EchoGlobal_t *pGlobal, int firstSlot);
 ECHO_STATUS echoServerStart(EchoGlobal_t *pGlobal, int iEchoProto);
 ECHO_STATUS incomingConnections(EchoGlobal_t *pGlobal,int iEchoProto);
-ECHO_STATUS echoGlobalInit(EchoGlobal_t** ppGlobal, int tcp_max_connection);
+ECHO_STATUS echoGlobalInit(EchoGlobal_t** ppGlobal, echoServerConfig *pConfig);
 ECHO_STATUS echoServerCloseConnections(EchoGlobal_t *pGlobal, int iEchoProto);
 
 #endif /* _ECHO_MAIN_H_ */
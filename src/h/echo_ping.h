@@ -0,0 +1,64 @@
+#ifndef _ECHO_PING_H_
+#define _ECHO_PING_H_
+
+#include "echo_main.h"
+
+#define ECHO_PING_COUNT_DEFAULT 10
+#define ECHO_PING_INTERVAL_DEFAULT 1000 /*ms*/
+#define ECHO_PING_MAGIC 0x6563686f /*"echo"*/
+
+/*Probe states*/
+#define ECHO_PING_PENDING 1
+#define ECHO_PING_RECEIVED 2
+#define ECHO_PING_LOST 3
+
+/*Head of every probe, the rest of the payload is padding up to size*/
+typedef struct echoPingProbe_t
+{
+	unsigned int magic;
+	unsigned int seq;
+	unsigned long long sentNs;
+}echoPingProbe;
+
+typedef struct echoPingStats_t
+{
+	int sent;
+	int received;
+	int lost;
+	int late; /*echo arrived after the probe timed out*/
+	int reordered; /*echo of an older probe arrived after a newer one*/
+	int duplicates;
+	int corrupted;
+	unsigned long long rttMin;
+	unsigned long long rttMax;
+	double rttSum;
+	double rttSumSq;
+	double jitterSum; /*sum of |rtt - previous rtt|*/
+	int jitterCount;
+	int wireReceived; /*echoes with both kernel timestamps*/
+	unsigned long long wireMin;
+	unsigned long long wireMax;
+	double wireSum;
+	double wireSumSq;
+	double overheadSum; /*sum of rtt - wire rtt of those echoes*/
+	int reflected; /*echoes stamped by a reflector*/
+	long long fwdMin; /*client -> server, may be negative if the clocks are apart*/
+	long long retMin; /*server -> client*/
+	long long dwellMax; /*receive to send inside the server*/
+	double fwdSum;
+	double dwellSum;
+	double retSum;
+}echoPingStats;
+
+/*--timestamp: kernel TX times of the probes, RX times come with the echoes*/
+typedef struct echoPingTimestamps_t
+{
+	unsigned long long *pTxNs; /*CLOCK_REALTIME, 0 - not known yet*/
+	unsigned int *pTxKey; /*OPT_ID key of every probe's send*/
+	unsigned int nextKey; /*datagrams (UDP) or bytes (TCP) sent so far*/
+	int txSeq; /*TX times arrive in send order - first probe without one*/
+}echoPingTimestamps;
+
+ECHO_STATUS echoPingStart(char **arg_values, echoClientConfig *pConfig);
+
+#endif /* _ECHO_PING_H_ */
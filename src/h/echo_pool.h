@@ -0,0 +1,64 @@
+#ifndef _ECHO_POOL_H_
+#define _ECHO_POOL_H_
+
+#include <stddef.h>
+#include "echo_main.h"
+
+#define ECHO_CACHE_LINE 64
+#define ECHO_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define ECHO_POOL_BUFFERS_DEFAULT 256 /*buffers preallocated per reactor*/
+#define ECHO_POOL_GROW_BUFFERS 64 /*buffers mapped at a time once the preallocated ones are in use*/
+
+/*Round n up to a multiple of align (a power of 2)*/
+#define ECHO_ALIGN_UP(n, align) (((n) + (align) - 1) & ~((size_t)(align) - 1))
+
+/*One pooled buffer; len tracks how many bytes of data are valid, so
+  payloads are echoed exactly, including NUL bytes*/
+typedef struct echoBuf_t
+{
+	char *data;
+	unsigned int len;
+	unsigned int cap;
+	struct echoBuf_t *next; /*free list link while the buffer is idle, in-flight list while it is pinned*/
+	unsigned int zcFirst; /*MSG_ZEROCOPY: number of the first send from the buffer*/
+	unsigned int zcLast;
+	unsigned int zcPending; /*sends from the buffer the kernel has not reported complete*/
+}echoBuf;
+
+/*Buffers added to a pool by echoBufPoolGrow(), one mapping each*/
+typedef struct echoBufChunk_t
+{
+	struct echoBufChunk_t *next;
+	char *region;
+	size_t regionSize;
+	echoBuf bufs[];
+}echoBufChunk;
+
+/*Equally sized buffers carved out of one mapping, plus the chunks it
+  grew by. Every buffer starts on a cache line; the pool is not locked,
+  it belongs to one thread (or its users serialize access themselves)*/
+typedef struct echoBufPool_t
+{
+	int count;
+	int freeCount;
+	int hugePages;
+	unsigned int bufSize;
+	size_t stride; /*bufSize rounded up to a cache line*/
+	echoBuf *bufs;
+	echoBuf *freeList;
+	char *region;
+	size_t regionSize;
+	echoBufChunk *pChunks; /*never unmapped before echoBufPoolRelease()*/
+}echoBufPool;
+
+void *echoPoolRegionAlloc(size_t size, int hugePages, size_t *pMapped);
+void echoPoolRegionFree(void *pRegion, size_t mapped);
+
+ECHO_STATUS echoBufPoolInit(echoBufPool *pPool, int count, unsigned int bufSize, int hugePages);
+ECHO_STATUS echoBufPoolGrow(echoBufPool *pPool, int count);
+void echoBufPoolRelease(echoBufPool *pPool);
+
+echoBuf *echoBufGet(echoBufPool *pPool);
+void echoBufPut(echoBufPool *pPool, echoBuf *pBuf);
+
+#endif /* _ECHO_POOL_H_ */
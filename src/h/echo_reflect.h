@@ -0,0 +1,37 @@
+#ifndef _ECHO_REFLECT_H_
+#define _ECHO_REFLECT_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "echo_main.h"
+
+#define ECHO_REFLECT_MAGIC 0x7265666c /*"refl"*/
+
+/*Head of a reflector (TWAMP-light style) test datagram; all fields in
+  network byte order, times are CLOCK_REALTIME ns. The client fills the
+  first three fields, the reflector the rest; the padding up to the
+  probe size is echoed as it is*/
+typedef struct echoReflectHeader_t
+{
+	uint32_t magic;
+	uint32_t seq; /*client's sequence number*/
+	uint64_t clientTxNs;
+	uint32_t serverSeq; /*reflector's own counter, one per server thread*/
+	uint32_t reserved;
+	uint64_t serverRxNs; /*kernel receive time of the datagram*/
+	uint64_t serverTxNs; /*time the reflector handed the echo to the kernel*/
+}echoReflectHeader;
+
+/*Ancillary data of a received datagram - its SO_TIMESTAMPNS time*/
+typedef union echoReflectControl_t
+{
+	char buf[CMSG_SPACE(sizeof(struct timespec))];
+	struct cmsghdr align;
+}echoReflectControl;
+
+unsigned long long echoReflectNowNs(void);
+ECHO_STATUS echoReflectEnable(int udpSocket);
+unsigned long long echoReflectRxNs(struct msghdr *pMsg);
+int echoReflectStamp(char *pData, unsigned int len, unsigned long long rxNs, unsigned int *pSeq);
+
+#endif /* _ECHO_REFLECT_H_ */
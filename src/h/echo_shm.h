@@ -0,0 +1,78 @@
+#ifndef _ECHO_SHM_H_
+#define _ECHO_SHM_H_
+
+#include "echo_main.h"
+#include "echo_pool.h"
+#include "echo_stats.h"
+#include "echo_busypoll.h"
+
+#define ECHO_SHM_MAGIC 0x6572696e /*"erin"*/
+#define ECHO_SHM_VERSION 1
+#define ECHO_SHM_CHANNELS 64 /*clients served at the same time*/
+#define ECHO_SHM_RING_SIZE (256 * 1024) /*bytes of one direction of a channel, power of 2*/
+#define ECHO_SHM_ALIGN 8 /*every message starts on 8 bytes*/
+#define ECHO_SHM_WRAP 0xffffffffU /*length of the filler at the end of the ring, the next message is at offset 0*/
+#define ECHO_SHM_MAX_MSG (ECHO_SHM_RING_SIZE / 2 - ECHO_SHM_ALIGN) /*biggest message, a ring holds at least two*/
+#define ECHO_SHM_FULL_WAIT_MS 1 /*server wait while a client's replies fill its ring*/
+
+/*Ring with one producer and one consumer in different processes. head
+  and tail are free-running byte counts; a message is its length (32
+  bits) followed by the payload, padded to ECHO_SHM_ALIGN. The consumer
+  sleeps on head (futex) after setting waiting, the producer wakes it
+  only when waiting is set - a busy ring costs no syscall*/
+typedef struct echoShmRing_t
+{
+	unsigned int head __attribute__((aligned(ECHO_CACHE_LINE))); /*written by the producer*/
+	unsigned int waiting; /*written by the consumer*/
+	unsigned int tail __attribute__((aligned(ECHO_CACHE_LINE))); /*written by the consumer*/
+	char data[ECHO_SHM_RING_SIZE] __attribute__((aligned(ECHO_CACHE_LINE)));
+}echoShmRing;
+
+/*A client's connection: requests go to the server, echoes come back*/
+typedef struct echoShmChannel_t
+{
+	int owner __attribute__((aligned(ECHO_CACHE_LINE))); /*thread id of the client, 0 - free*/
+	echoShmRing toServer;
+	echoShmRing toClient;
+}echoShmChannel;
+
+/*Layout of the shared-memory object /<name> of --shm <name>; the
+  server thread serves every channel and sleeps on doorbell*/
+typedef struct echoShmSegment_t
+{
+	unsigned int magic;
+	unsigned int version;
+	int pid; /*server process*/
+	unsigned int doorbell __attribute__((aligned(ECHO_CACHE_LINE))); /*bumped by a client that finds the server asleep*/
+	unsigned int serverWaiting;
+	echoShmChannel channel[ECHO_SHM_CHANNELS];
+}echoShmSegment;
+
+/*Client end of one channel*/
+typedef struct echoShmConn_t
+{
+	echoShmSegment *pSeg;
+	echoShmChannel *pChan;
+	unsigned long long spinNs; /*poll this long before sleeping on the futex*/
+}echoShmConn;
+
+/*Server thread*/
+typedef struct echoShmServer_t
+{
+	pthread_t threadId;
+	echoShmSegment *pSeg;
+	echoStatsSlot *pStats;
+	echoBusyPoll busyPoll;
+}echoShmServer;
+
+void *echoShmWorker(void *pServer);
+
+int echoShmSlots(echoServerConfig *pConfig);
+ECHO_STATUS echoShmServerStart(EchoGlobal_t *pGlobal, int slot);
+ECHO_STATUS echoShmOpen(const char *szName, int spinUs, echoShmConn **ppConn);
+void echoShmClose(echoShmConn *pConn);
+ECHO_STATUS echoShmSend(echoShmConn *pConn, const char *pData, unsigned int len);
+int echoShmRecv(echoShmConn *pConn, char *pBuf, unsigned int size);
+int echoShmWait(echoShmConn *pConn, unsigned long long untilNs);
+
+#endif /* _ECHO_SHM_H_ */
@@ -0,0 +1,29 @@
+#ifndef _ECHO_SLAB_H_
+#define _ECHO_SLAB_H_
+
+#include <stddef.h>
+#include "echo_main.h"
+
+#define ECHO_SLAB_SIZE (256 * 1024) /*bytes mapped at a time, about 3600 client states*/
+
+/*Allocator for many small objects of one size - the state of the
+  clients of one reactor. Objects are carved from slabs mapped as they
+  are needed; there is no header per object and a slab page is touched
+  only when the first object on it is handed out, so memory follows the
+  peak number of clients. Freed objects are reused first (LIFO, still
+  warm in the cache). Not locked, it belongs to one thread*/
+typedef struct echoSlab_t
+{
+	size_t objSize; /*rounded up to a pointer, a free object holds the free list link*/
+	int inUse;
+	int slabs; /*mapped so far, never unmapped*/
+	void *freeList;
+	char *pCarve; /*next object of the newest slab that was never used*/
+	char *pCarveEnd;
+}echoSlab;
+
+void echoSlabInit(echoSlab *pSlab, size_t objSize);
+void *echoSlabAlloc(echoSlab *pSlab);
+void echoSlabFree(echoSlab *pSlab, void *pObj);
+
+#endif /* _ECHO_SLAB_H_ */
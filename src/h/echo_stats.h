@@ -0,0 +1,82 @@
+#ifndef _ECHO_STATS_H_
+#define _ECHO_STATS_H_
+
+#include "echo_main.h"
+#include "echo_pool.h"
+
+#define ECHO_STATS_SHM_NAME "/echo_stats" /*shm_open() name, the segment is /dev/shm/echo_stats[.<port>]*/
+#define ECHO_STATS_MAGIC 0x65737473 /*"ests"*/
+#define ECHO_STATS_VERSION 5
+#define ECHO_STATS_SLOTS (ECHO_MAX_WORKERS + ECHO_AUX_MAX_THREADS + ECHO_XDP_MAX_QUEUES) /*the unix, shm and AF_XDP threads follow the workers*/
+#define ECHO_STATS_INTERVAL_DEFAULT 1 /*seconds between two samples of the reader*/
+
+/*Legacy model: the listener and its (joined) client thread take turns on
+  one slot, the UDP thread has its own*/
+#define ECHO_STATS_SLOT_LEGACY_TCP 0
+#define ECHO_STATS_SLOT_LEGACY_UDP 1
+
+/*Every slot has a single writer, so a relaxed store is enough for a
+  reader to see the counters without tearing - no lock, no atomic RMW*/
+#define ECHO_STAT_ADD(counter, n) __atomic_store_n(&(counter), (counter) + (n), __ATOMIC_RELAXED)
+#define ECHO_STAT_GET(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+/*Counters of one server thread; a slot fills whole cache lines, so two
+  threads never write the same line*/
+typedef struct echoStatsSlot_t
+{
+	unsigned long accepted; /*TCP connections*/
+	unsigned long closed; /*TCP connections, active = accepted - closed*/
+	unsigned long bytesIn;
+	unsigned long bytesOut;
+	unsigned long datagrams; /*UDP datagrams received*/
+	unsigned long sendErrors; /*sends that failed, the echo was lost*/
+	unsigned long shortWrites; /*sends the socket took only partly*/
+	unsigned long udpBatches; /*recvmmsg() calls that returned datagrams*/
+	unsigned long udpDropped; /*datagrams that could not be reflected or did not fit the buffer*/
+	unsigned long udpGroSegments; /*wire datagrams carried by GRO super-packets*/
+	unsigned long tcpQueuedBytes; /*echo bytes the socket did not take at once*/
+	unsigned long tcpReadPauses; /*times a slow reader filled its ring past the high-water mark*/
+	unsigned long tcpRingsExhausted; /*clients closed because no memory was left for an output ring*/
+	unsigned long busySpinNs; /*busy poll: time spent polling without finding work*/
+	unsigned long busyWorkNs; /*busy poll: time spent handling the events found*/
+	unsigned long busySleeps; /*busy poll: idle spins that ended in a blocking wait*/
+	unsigned long xdpPackets; /*datagrams echoed through AF_XDP, also counted in datagrams*/
+	unsigned long ipcMessages; /*messages echoed through the shared-memory rings*/
+	unsigned long tlsHandshakes; /*TLS sessions established*/
+	unsigned long tlsFailed; /*TLS handshakes that failed*/
+	unsigned long tlsKtlsTx; /*sessions the kernel encrypts for (kTLS)*/
+	unsigned long tlsKtlsRx; /*sessions the kernel decrypts for*/
+	unsigned long zcSends; /*TCP echoes sent with MSG_ZEROCOPY*/
+	unsigned long zcCompletions; /*zerocopy sends the kernel reported complete*/
+	unsigned long zcCopied; /*completions that say the kernel copied the data anyway*/
+	unsigned long zcFallbacks; /*echoes copied: below the threshold, no spare buffer or optmem exhausted*/
+}__attribute__((aligned(ECHO_CACHE_LINE))) echoStatsSlot;
+
+/*Layout of the shared-memory segment; the server writes, any number of
+  readers map it read-only*/
+typedef struct echoStatsShm_t
+{
+	unsigned int magic;
+	unsigned int version;
+	int pid; /*server process*/
+	int slots; /*slots in use*/
+	int ioMode;
+	int udpBatch;
+	int busyPoll; /*us a worker spins before it blocks, 0 - off*/
+	int xdpQueues; /*AF_XDP queues, the last slots*/
+	int shm; /*the shared-memory echo is served*/
+	int tlsPort; /*port of the TLS listener, 0 - none*/
+	int zeroCopy; /*MSG_ZEROCOPY threshold of the TCP echo, 0 - off*/
+	unsigned long long startNs; /*CLOCK_MONOTONIC time the server started*/
+	echoStatsSlot slot[ECHO_STATS_SLOTS];
+}echoStatsShm;
+
+ECHO_STATUS echoStatsInit(echoServerConfig *pConfig, int slots);
+echoStatsSlot *echoStatsSlotGet(int id);
+void echoStatsSum(echoStatsShm *pShm, echoStatsSlot *pSum);
+void echoStatsPrint(echoStatsShm *pShm, echoStatsSlot *pNow, echoStatsSlot *pLast, double seconds);
+void echoStatsReportLoop(int interval);
+int echoStatsServerPid(int port);
+ECHO_STATUS echoStatsWatch(int interval, int count, int port);
+
+#endif /* _ECHO_STATS_H_ */
@@ -0,0 +1,34 @@
+#ifndef _ECHO_STREAM_H_
+#define _ECHO_STREAM_H_
+
+#include "echo_main.h"
+
+#define ECHO_STREAM_CHUNK (256 * 1024) /*bytes offered to one send()/recv()*/
+#define ECHO_STREAM_PERIOD 65521 /*the generated payload repeats after this many bytes - a prime, so it never lines up with a chunk*/
+#define ECHO_STREAM_REPORT_NS 1000000000ULL /*throughput of every second*/
+
+/*One streamed echo; byte i of the payload is pSource[i % period], the
+  echo is compared with it as it arrives, so neither side ever holds
+  more than a chunk of the stream*/
+typedef struct echoStream_t
+{
+	echoClientGlobal_t *pClient; /*server address, protocol and settings*/
+	char *pSource; /*the mapped file, or one period of the pattern and a chunk more*/
+	size_t sourceSize; /*bytes mapped or allocated for pSource*/
+	unsigned long long period; /*a file is not repeated: its size*/
+	unsigned long long total; /*payload bytes*/
+	unsigned long long txOff; /*payload bytes sent*/
+	unsigned long long rxOff; /*payload bytes echoed and verified*/
+	char *pRecvBuf;
+	unsigned long long startNs; /*the first byte is sent*/
+	unsigned long long firstByteNs; /*the first byte of the echo arrived, 0 - not yet*/
+	unsigned long long lastByteNs;
+	unsigned long long reportNs; /*end of the current report interval*/
+	unsigned long long reportOff; /*rxOff when the interval began*/
+	double minGbps; /*slowest full interval*/
+	double maxGbps;
+}echoStream;
+
+ECHO_STATUS echoStreamStart(char **arg_values, echoClientConfig *pConfig);
+
+#endif /* _ECHO_STREAM_H_ */
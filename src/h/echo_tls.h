@@ -0,0 +1,30 @@
+#ifndef _ECHO_TLS_H_
+#define _ECHO_TLS_H_
+
+#include "echo_main.h"
+
+#define ECHO_TLS_KTLS_TX 1 /*the kernel encrypts what is sent*/
+#define ECHO_TLS_KTLS_RX 2 /*the kernel decrypts what is received*/
+#define ECHO_TLS_KTLS_BOTH (ECHO_TLS_KTLS_TX | ECHO_TLS_KTLS_RX)
+#define ECHO_TLS_VERSION_12 0x0303 /*--tls-version 1.2, OpenSSL's TLS1_2_VERSION*/
+#define ECHO_TLS_VERSION_13 0x0304 /*--tls-version 1.3*/
+#define ECHO_TLS_CERT_DAYS 30 /*validity of the generated certificate*/
+#define ECHO_TLS_CERT_CN "echo_protocol" /*subject of the generated certificate*/
+
+/*Sessions are OpenSSL's SSL objects; struct ssl_st is what SSL stands
+  for, so the users of this header need no OpenSSL headers, and builds
+  without TLS (make NO_TLS=1) keep the same types*/
+struct ssl_st;
+
+ECHO_STATUS echoTlsServerInit(echoServerConfig *pConfig);
+ECHO_STATUS echoTlsClientInit(echoClientConfig *pConfig);
+struct ssl_st *echoTlsAccept(int fd);
+ECHO_STATUS echoTlsConnect(int fd, struct ssl_st **ppTls);
+int echoTlsHandshake(struct ssl_st *pTls);
+int echoTlsKernel(struct ssl_st *pTls);
+ssize_t echoTlsSend(struct ssl_st *pTls, int fd, const void *pBuf, size_t len);
+ssize_t echoTlsRecv(struct ssl_st *pTls, int fd, void *pBuf, size_t len);
+void echoTlsFree(struct ssl_st *pTls, int notify);
+void echoTlsClientReport(void);
+
+#endif /* _ECHO_TLS_H_ */
@@ -0,0 +1,126 @@
+#ifndef _ECHO_URING_H_
+#define _ECHO_URING_H_
+
+#include <linux/io_uring.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+#include "echo_stats.h"
+#include "echo_busypoll.h"
+
+#define ECHO_URING_ENTRIES 4096
+#define ECHO_URING_TCP_BUFFERS 4096 /*power of 2 - size of the provided buffer ring*/
+#define ECHO_URING_UDP_BUFFERS 1024
+#define ECHO_URING_MIN_BUFFERS 64 /*fewest buffers of a ring with a large --buffer-size*/
+#define ECHO_URING_BGID_TCP 0
+#define ECHO_URING_BGID_UDP 1
+#define ECHO_URING_CHAIN_MAX 32 /*linked sends submitted per connection at once*/
+
+/*What a completion belongs to; kept in the top byte of user_data, the
+  buffer id and the file descriptor fill the rest*/
+#define ECHO_URING_OP_ACCEPT 1
+#define ECHO_URING_OP_RECV 2
+#define ECHO_URING_OP_SEND 3
+#define ECHO_URING_OP_UDP_RECV 4
+#define ECHO_URING_OP_UDP_SEND 5
+#define ECHO_URING_OP_CANCEL 6
+#define ECHO_URING_OP_TIMEOUT 7
+
+/*NAPI busy polling for the sockets of a ring, Linux >= 6.9; older
+  headers lack it*/
+#ifndef IORING_REGISTER_NAPI
+#define IORING_REGISTER_NAPI 27
+struct io_uring_napi
+{
+	__u32 busy_poll_to;
+	__u8 prefer_busy_poll;
+	__u8 pad[3];
+	__u64 resv;
+};
+#endif
+
+/*Submission and completion queues shared with the kernel*/
+typedef struct echoUring_t
+{
+	int fd;
+	unsigned int sqEntries;
+	unsigned int sqMask;
+	unsigned int sqTail; /*local tail, published before io_uring_enter()*/
+	unsigned int *ksqHead;
+	unsigned int *ksqTail;
+	unsigned int *ksqArray;
+	struct io_uring_sqe *sqes;
+	unsigned int cqMask;
+	unsigned int *kcqHead;
+	unsigned int *kcqTail;
+	struct io_uring_cqe *cqes;
+	void *sqRing;
+	void *cqRing;
+	size_t sqRingSize;
+	size_t cqRingSize;
+	size_t sqesSize;
+}echoUring;
+
+/*A provided buffer ring: the kernel picks a free buffer when data
+  arrives, the buffer comes back to the ring after it was echoed*/
+typedef struct echoUringBufGroup_t
+{
+	int bgid;
+	int count;
+	int bufSize;
+	int freeCount;
+	unsigned short tail;
+	struct io_uring_buf_ring *ring;
+	size_t ringSize;
+	char *buffers;
+	size_t buffersSize; /*bytes mapped for buffers*/
+	int *lens; /*TCP: bytes received into the buffer*/
+	int *next; /*TCP: next buffer queued on the same connection*/
+	struct msghdr *msgs; /*UDP: sendmsg() header of the echo*/
+	struct iovec *iovs;
+}echoUringBufGroup;
+
+typedef struct echoUringConn_t
+{
+	int active;
+	int closing; /*no more reads - EOF, error or a failed send*/
+	int failed; /*a send failed, queued data is dropped*/
+	int recvArmed;
+	int stalled; /*recv ran out of buffers, re-armed when some are returned*/
+	int parked; /*accepted above tcpMaxConnections, served once there is room*/
+	int sendsInflight;
+	int queueHead; /*buffers waiting for the running send chain, -1 if none*/
+	int queueTail;
+}echoUringConn;
+
+typedef struct echoUringWorker_t
+{
+	int id;
+	int tcpSocket;
+	int udpSocket;
+	int acceptArmed;
+	int acceptCancelled;
+	int timeoutArmed;
+	int udpArmed;
+	int udpStalled;
+	int stalledCount; /*connections waiting for free buffers*/
+	int parkedCount;
+	unsigned int reflectSeq; /*reflector counter of this worker*/
+	pthread_t threadId;
+	EchoGlobal_t *pGlobal;
+	echoStatsSlot *pStats; /*this worker's counters in the shared segment*/
+	echoUring ring;
+	echoUringBufGroup tcpBufs;
+	echoUringBufGroup udpBufs;
+	struct msghdr udpRecvMsg;
+	struct __kernel_timespec pauseTs;
+	echoUringConn *conns; /*indexed by file descriptor*/
+	int connsSize;
+	echoBusyPoll busyPoll; /*--busy-poll: spin state, spinNs 0 - always block*/
+}echoUringWorker;
+
+void *echoUringWorkerLoop(void *pWorker);
+
+ECHO_STATUS echoUringProbe(void);
+ECHO_STATUS echoUringServersStart(EchoGlobal_t *pGlobal);
+
+#endif /* _ECHO_URING_H_ */
@@ -0,0 +1,58 @@
+#ifndef _ECHO_XDP_H_
+#define _ECHO_XDP_H_
+
+#include <linux/if_xdp.h>
+#include "echo_main.h"
+#include "echo_stats.h"
+#include "echo_busypoll.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define ECHO_XDP_FRAME_SIZE 2048 /*UMEM chunk, holds one Ethernet frame*/
+#define ECHO_XDP_FRAMES 4096 /*UMEM frames of one queue, power of 2*/
+#define ECHO_XDP_RING_SIZE 2048 /*RX/TX/completion descriptors, power of 2*/
+#define ECHO_XDP_BATCH 64 /*frames taken from the RX ring at once*/
+#define ECHO_XDP_WAIT_MS 1 /*wait of a queue with frames still on the TX ring*/
+
+/*One ring shared with the kernel; the queue is the only producer of the
+  fill and TX rings and the only consumer of the RX and completion rings*/
+typedef struct echoXdpRing_t
+{
+	unsigned int *producer;
+	unsigned int *consumer;
+	unsigned int *flags; /*XDP_RING_NEED_WAKEUP*/
+	void *descs; /*struct xdp_desc (RX, TX) or __u64 frame addresses (fill, completion)*/
+	unsigned int size;
+	void *map;
+	size_t mapSize;
+}echoXdpRing;
+
+/*AF_XDP socket of one RX queue of the interface with its UMEM; a frame
+  goes fill ring -> RX ring -> (echoed in place) TX ring -> completion
+  ring -> fill ring, it is never copied*/
+typedef struct echoXdpQueue_t
+{
+	int queue;
+	int fd;
+	pthread_t threadId;
+	EchoGlobal_t *pGlobal;
+	echoStatsSlot *pStats;
+	char *umem;
+	size_t umemSize;
+	echoXdpRing rx;
+	echoXdpRing tx;
+	echoXdpRing fill;
+	echoXdpRing comp;
+	unsigned int outstanding; /*frames on the TX ring not completed yet*/
+	unsigned int reflectSeq; /*reflector counter of this queue*/
+	echoBusyPoll busyPoll;
+}echoXdpQueue;
+
+void *echoXdpWorker(void *pQueue);
+
+int echoXdpSlots(echoServerConfig *pConfig);
+ECHO_STATUS echoXdpStart(EchoGlobal_t *pGlobal, int firstSlot);
+
+#endif /* _ECHO_XDP_H_ */
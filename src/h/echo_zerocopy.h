@@ -0,0 +1,35 @@
+#ifndef _ECHO_ZEROCOPY_H_
+#define _ECHO_ZEROCOPY_H_
+
+#include <sys/types.h>
+#include "echo_main.h"
+#include "echo_pool.h"
+#include "echo_stats.h"
+
+#define ECHO_ZC_THRESHOLD_DEFAULT (10 * 1024) /*smaller echoes are copied - pinning pages and the completion cost more than the copy*/
+#define ECHO_ZC_LEGACY_BUFFERS 64 /*legacy: buffers one client may have in flight*/
+#define ECHO_ZC_WAIT_MS 1000 /*legacy: longest wait for the kernel to release a buffer*/
+#define ECHO_ZC_POLL_MS 10
+#define ECHO_ZC_RESERVE(count) ((count) / 4) /*epoll: pool buffers pinned sends leave to the output rings*/
+#define ECHO_ZC_CLOSE_MS 10000 /*epoll: longest a closed client's socket waits for its completions before it is reset*/
+
+/*Buffers of one socket the kernel still sends from, in the order they
+  were pinned. The kernel numbers the MSG_ZEROCOPY sends of a socket 0,
+  1, 2... and reports ranges of completed sends on the error queue, not
+  necessarily in order*/
+typedef struct echoZcInflight_t
+{
+	echoBuf *pHead;
+	echoBuf *pTail;
+	int count;
+	unsigned int nextSeq; /*number of the next zerocopy send of the socket*/
+}echoZcInflight;
+
+void echoZcSocket(int sock, echoServerConfig *pConfig);
+ssize_t echoZcSend(int fd, echoZcInflight *pZc, echoBuf *pBuf, unsigned int off, unsigned int len, echoStatsSlot *pStats);
+int echoZcPin(echoZcInflight *pZc, echoBuf *pBuf);
+int echoZcReap(int fd, echoZcInflight *pZc, echoBufPool *pPool, echoStatsSlot *pStats);
+int echoZcWait(int fd, echoZcInflight *pZc, echoBufPool *pPool, echoStatsSlot *pStats);
+void echoZcDrop(echoZcInflight *pZc, echoBufPool *pPool);
+
+#endif /* _ECHO_ZEROCOPY_H_ */